@@ -1,10 +1,9 @@
 extends Control
 
 var _llama: GodotLlama
+var _session: LlamaChatSession
 var _streaming_active := false
 var _model_path := ""
-var _pending_user_text := ""
-var _chat_history: Array[Dictionary] = []
 var _saved_state_blob := PackedByteArray()
 
 const DEFAULT_SYSTEM_PROMPT := "You are Bran, a blacksmith in Oakridge. Stay in character, be concise, and be helpful. Never mention being an AI."
@@ -49,6 +48,8 @@ func _ready() -> void:
     _llama.context.token_generated.connect(_on_token_generated)
     _llama.context.generation_finished.connect(_on_generation_finished)
     _llama.context.generation_error.connect(_on_generation_error)
+    _session = LlamaChatSession.new()
+    _session.context = _llama.context
 
     _select_model_button.pressed.connect(_on_select_model_pressed)
     _model_file_dialog.file_selected.connect(_on_model_file_selected)
@@ -114,10 +115,12 @@ func _on_generate_pressed() -> void:
         _set_status("prompt is empty")
         return
 
-    # The demo rebuilds the full conversation prompt each turn, so reset context first.
-    _llama.context.reset()
+    # The session keeps the conversation in the KV cache and only decodes the
+    # turns added since the last reply.
+    _sync_system_messages()
+    _session.trim_history(max(0, int(_history_turns_spin.value)) * 2)
+    _session.add_message("user", user_text)
 
-    var prompt := _build_chat_prompt(user_text)
     var max_tokens := int(_max_tokens_spin.value)
     var params := {
         "temperature": float(_temperature_spin.value),
@@ -134,25 +137,19 @@ func _on_generate_pressed() -> void:
         params["stop_sequences"] = stop_sequences
 
     _output_text.clear()
-    _pending_user_text = user_text
     if _streaming_check.button_pressed:
         _streaming_active = true
         _set_status("generating (streaming)...")
-        _llama.context.set_prompt(prompt)
-        _llama.context.generate_stream(max_tokens, params)
+        _session.generate_stream(max_tokens, params)
         return
 
     _set_status("generating...")
-    var result := _llama.generate(prompt, max_tokens, params)
-    var clean_result := _clean_assistant_output(result)
-    _output_text.text = clean_result
-    _append_chat_turn("user", user_text)
-    _append_chat_turn("assistant", clean_result)
+    var result := _session.generate(max_tokens, params)
+    _output_text.text = _clean_assistant_output(result)
     _set_status("generation finished")
 
 func _on_clear_memory_pressed() -> void:
-    _chat_history.clear()
-    _pending_user_text = ""
+    _session.clear()
     _set_status("memory cleared")
 
 func _on_clear_kv_pressed() -> void:
@@ -219,10 +216,7 @@ func _on_token_generated(token_text: String, _token_id: int) -> void:
 
 func _on_generation_finished(_full_text: String) -> void:
     if _streaming_active:
-        var clean_text := _clean_assistant_output(_full_text)
-        _output_text.text = clean_text
-        _append_chat_turn("user", _pending_user_text)
-        _append_chat_turn("assistant", clean_text)
+        _output_text.text = _clean_assistant_output(_full_text)
         _streaming_active = false
     _set_status("generation finished")
 
@@ -233,50 +227,27 @@ func _on_generation_error(message: String) -> void:
 func _set_status(message: String) -> void:
     _status_label.text = "Status: %s" % message
 
-func _build_chat_prompt(user_text: String) -> String:
-    var parts := PackedStringArray()
-    var clean_system := _system_prompt_edit.text.strip_edges()
-    var clean_world := _world_state_edit.text.strip_edges()
-
-    if not clean_system.is_empty():
-        parts.append("<|im_start|>system")
-        parts.append(clean_system)
-        parts.append("<|im_end|>")
-
-    if not clean_world.is_empty():
-        parts.append("<|im_start|>system")
-        parts.append(clean_world)
-        parts.append("<|im_end|>")
-
-    for turn in _chat_history:
-        var role := String(turn.get("role", ""))
-        var content := String(turn.get("content", "")).strip_edges()
-        if role.is_empty() or content.is_empty():
-            continue
-        parts.append("<|im_start|>%s" % role)
-        parts.append(content)
-        parts.append("<|im_end|>")
-
-    parts.append("<|im_start|>user")
-    parts.append(user_text.strip_edges())
-    parts.append("<|im_end|>")
-    parts.append("<|im_start|>assistant")
-    return "\n".join(parts)
-
-func _append_chat_turn(role: String, content: String) -> void:
-    var clean := content.strip_edges()
-    if clean.is_empty():
+func _sync_system_messages() -> void:
+    var wanted := PackedStringArray()
+    for text in [_system_prompt_edit.text.strip_edges(), _world_state_edit.text.strip_edges()]:
+        if not text.is_empty():
+            wanted.append(text)
+
+    var messages := _session.get_messages()
+    var existing := 0
+    while existing < messages.size() and String(messages[existing]["role"]) == "system":
+        existing += 1
+
+    # Editing a prompt only re-decodes from that message on; adding or removing
+    # one restarts the chat.
+    if existing != wanted.size():
+        _session.clear()
+        for text in wanted:
+            _session.add_message("system", text)
         return
-    _chat_history.append({
-        "role": role,
-        "content": clean,
-    })
-    var max_items : int = max(0, int(_history_turns_spin.value)) * 2
-    if max_items == 0:
-        _chat_history.clear()
-        return
-    while max_items > 0 and _chat_history.size() > max_items:
-        _chat_history.remove_at(0)
+    for i in wanted.size():
+        if String(messages[i]["content"]) != wanted[i]:
+            _session.set_message(i, wanted[i])
 
 func _clean_assistant_output(text: String) -> String:
     var out := text
@@ -17,3 +17,6 @@ func create_context(params: Dictionary = {}) -> Error:
 func generate(prompt: String, max_tokens: int = 128, params: Dictionary = {}) -> String:
     context.set_prompt(prompt)
     return context.generate(max_tokens, params)
+
+func generate_batch(requests: Array, params: Dictionary = {}) -> Array:
+    return context.generate_batch(requests, params)
@@ -0,0 +1,152 @@
+extends SceneTree
+
+# Headless bulk generation for content builds.
+#
+#   godot --headless --path . --script res://addons/godot_llama/tools/batch_generate.gd -- \
+#       --model res://models/model.gguf --in prompts.jsonl --out results.jsonl \
+#       [--n-seq 8] [--n-ctx 2048] [--n-batch 2048] [--max-tokens 128] [--threads N] \
+#       [--chunk 512] [--resume]
+#
+# Every input line is a JSON object with "prompt", an optional "id" and
+# either sampling keys inline or a "params" dictionary. Every output line
+# holds the result dictionary of LlamaContext.generate_batch(), written and
+# flushed as soon as the item finishes so an interrupted run can --resume.
+
+const USAGE := "usage: --model <path> --in <prompts.jsonl> --out <results.jsonl> [--n-seq N] [--n-ctx N] [--n-batch N] [--max-tokens N] [--threads N] [--chunk N] [--resume]"
+
+var _out: FileAccess
+var _written := 0
+var _failed := 0
+var _generated_tokens := 0
+var _input_error := false
+
+func _init() -> void:
+    var args := _parse_args(OS.get_cmdline_user_args())
+    if not args.has("model") or not args.has("in") or not args.has("out"):
+        printerr(USAGE)
+        quit(1)
+        return
+    quit(_run(args))
+
+func _parse_args(argv: PackedStringArray) -> Dictionary:
+    var args := {}
+    var i := 0
+    while i < argv.size():
+        var arg := argv[i]
+        if not arg.begins_with("--"):
+            i += 1
+            continue
+        var key := arg.substr(2)
+        if key == "resume":
+            args[key] = true
+        elif i + 1 < argv.size():
+            args[key] = argv[i + 1]
+            i += 1
+        i += 1
+    return args
+
+func _run(args: Dictionary) -> int:
+    var resume := bool(args.get("resume", false))
+    var done_ids := _read_done_ids(args["out"]) if resume else {}
+    var items := _read_items(args["in"], done_ids)
+    if _input_error:
+        return 1
+    if items.is_empty():
+        print("batch_generate: nothing to do")
+        return 0
+
+    var n_seq := int(args.get("n-seq", "8"))
+    var n_ctx := int(args.get("n-ctx", "2048"))
+    var context_params := {
+        "n_seq_max": n_seq,
+        "n_ctx": n_ctx * n_seq,
+        "n_batch": int(args.get("n-batch", "2048")),
+    }
+    if args.has("threads"):
+        context_params["threads"] = int(args["threads"])
+        context_params["threads_batch"] = int(args["threads"])
+
+    var model := LlamaModel.new()
+    var err := model.load(args["model"])
+    if err != OK:
+        printerr("batch_generate: failed to load model: ", error_string(err))
+        return 1
+    var context := LlamaContext.new()
+    err = context.create(model, context_params)
+    if err != OK:
+        printerr("batch_generate: failed to create context: ", error_string(err))
+        return 1
+
+    _out = FileAccess.open(args["out"], FileAccess.READ_WRITE if resume and FileAccess.file_exists(args["out"]) else FileAccess.WRITE)
+    if _out == null:
+        printerr("batch_generate: cannot open output: ", error_string(FileAccess.get_open_error()))
+        return 1
+    _out.seek_end()
+    context.batch_item_finished.connect(_on_item_finished)
+
+    var batch_params := {"max_tokens": int(args.get("max-tokens", "128"))}
+    var chunk := maxi(1, int(args.get("chunk", "512")))
+    var start_usec := Time.get_ticks_usec()
+    print("batch_generate: %d items, %d sequences, %d tokens of context each" % [items.size(), n_seq, n_ctx])
+    for offset in range(0, items.size(), chunk):
+        context.generate_batch(items.slice(offset, offset + chunk), batch_params)
+        print("batch_generate: %d/%d" % [mini(offset + chunk, items.size()), items.size()])
+    _out.close()
+
+    var seconds := float(Time.get_ticks_usec() - start_usec) / 1000000.0
+    var stats := context.get_stats()
+    print("batch_generate: %d written, %d failed, %d tokens in %.1fs (%.1f tok/s, %.1f tokens per decode)" % [
+        _written, _failed, _generated_tokens, seconds,
+        float(_generated_tokens) / maxf(seconds, 0.001),
+        float(stats.get("batch_avg_tokens_per_step", 0.0))])
+    return 0 if _failed == 0 else 2
+
+# Sets _input_error when the file cannot be read at all.
+func _read_items(path: String, done_ids: Dictionary) -> Array:
+    var file := FileAccess.open(path, FileAccess.READ)
+    if file == null:
+        printerr("batch_generate: cannot open input: ", error_string(FileAccess.get_open_error()))
+        _input_error = true
+        return []
+    var items := []
+    var line_number := 0
+    while not file.eof_reached():
+        var line := file.get_line().strip_edges()
+        line_number += 1
+        if line.is_empty():
+            continue
+        var item = JSON.parse_string(line)
+        if typeof(item) != TYPE_DICTIONARY or not item.has("prompt"):
+            printerr("batch_generate: skipping line %d: expected an object with \"prompt\"" % line_number)
+            continue
+        if not item.has("id"):
+            item["id"] = line_number
+        if done_ids.has(_id_key(item["id"])):
+            continue
+        items.append(item)
+    return items
+
+func _read_done_ids(path: String) -> Dictionary:
+    var done := {}
+    var file := FileAccess.open(path, FileAccess.READ)
+    if file == null:
+        return done
+    while not file.eof_reached():
+        var result = JSON.parse_string(file.get_line())
+        if typeof(result) == TYPE_DICTIONARY and result.has("id") and not result.has("error"):
+            done[_id_key(result["id"])] = true
+    return done
+
+# JSON numbers come back as floats; 7 and 7.0 must name the same item.
+func _id_key(id: Variant) -> String:
+    if typeof(id) == TYPE_FLOAT and id == floorf(id):
+        return str(int(id))
+    return str(id)
+
+func _on_item_finished(result: Dictionary) -> void:
+    _out.store_line(JSON.stringify(result))
+    _out.flush()
+    _written += 1
+    _generated_tokens += int(result.get("n_tokens", 0))
+    if result.has("error"):
+        _failed += 1
@@ -0,0 +1,91 @@
+extends SceneTree
+
+# Headless inference server: one resident model shared by every process on
+# the machine through a LlamaServer.
+#
+#   godot --headless --path . --script res://addons/godot_llama/tools/serve.gd -- \
+#       --model res://models/model.gguf [--port 8765] [--bind 127.0.0.1] \
+#       [--n-seq 8] [--n-ctx 2048] [--n-batch 2048] [--max-tokens 128] [--threads N] \
+#       [--max-queue 256] [--stats-interval 10]
+#
+# Clients send one JSON request per line and read one JSON message per line
+# back; see the "Local inference server" section of the README. Runs until
+# the process is killed.
+
+const USAGE := "usage: --model <path> [--port N] [--bind ADDRESS] [--n-seq N] [--n-ctx N] [--n-batch N] [--max-tokens N] [--threads N] [--max-queue N] [--stats-interval SECONDS]"
+
+var _server: LlamaServer
+var _stats_interval_msec := 0
+var _next_stats_msec := 0
+
+func _init() -> void:
+    var args := _parse_args(OS.get_cmdline_user_args())
+    if not args.has("model"):
+        printerr(USAGE)
+        quit(1)
+        return
+    var err := _start(args)
+    if err != OK:
+        quit(1)
+
+func _parse_args(argv: PackedStringArray) -> Dictionary:
+    var args := {}
+    var i := 0
+    while i < argv.size():
+        var arg := argv[i]
+        if arg.begins_with("--") and i + 1 < argv.size():
+            args[arg.substr(2)] = argv[i + 1]
+            i += 1
+        i += 1
+    return args
+
+func _start(args: Dictionary) -> Error:
+    var n_seq := int(args.get("n-seq", "8"))
+    var n_ctx := int(args.get("n-ctx", "2048"))
+    var context_params := {
+        "n_seq_max": n_seq,
+        "n_ctx": n_ctx * n_seq,
+        "n_batch": int(args.get("n-batch", "2048")),
+    }
+    if args.has("threads"):
+        context_params["threads"] = int(args["threads"])
+        context_params["threads_batch"] = int(args["threads"])
+
+    var model := LlamaModel.new()
+    var err := model.load(args["model"])
+    if err != OK:
+        printerr("serve: failed to load model: ", error_string(err))
+        return err
+    var context := LlamaContext.new()
+    err = context.create(model, context_params)
+    if err != OK:
+        printerr("serve: failed to create context: ", error_string(err))
+        return err
+
+    _server = LlamaServer.new()
+    _server.default_params = {"max_tokens": int(args.get("max-tokens", "128"))}
+    _server.max_queue = int(args.get("max-queue", "256"))
+    var bind_address: String = args.get("bind", "127.0.0.1")
+    err = _server.start(context, int(args.get("port", "8765")), bind_address)
+    if err != OK:
+        printerr("serve: failed to start server: ", error_string(err))
+        return err
+    print("serve: listening on %s:%d, %d sequences, %d tokens of context each" % [bind_address, _server.get_port(), n_seq, n_ctx])
+
+    _stats_interval_msec = int(float(args.get("stats-interval", "10")) * 1000.0)
+    _next_stats_msec = Time.get_ticks_msec() + _stats_interval_msec
+    return OK
+
+func _process(_delta: float) -> bool:
+    if _stats_interval_msec > 0 and Time.get_ticks_msec() >= _next_stats_msec:
+        _next_stats_msec = Time.get_ticks_msec() + _stats_interval_msec
+        var stats := _server.get_stats()
+        print("serve: %d clients, %d active, %d queued, %d completed, %d cancelled, %d failed, %d tokens" % [
+            stats["clients"], stats["active_requests"], stats["queued_requests"],
+            stats["requests_completed"], stats["requests_cancelled"], stats["requests_failed"],
+            stats["tokens_generated"]])
+    return false
+
+func _finalize() -> void:
+    if _server != null:
+        _server.stop()
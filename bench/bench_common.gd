@@ -0,0 +1,16 @@
+extends RefCounted
+
+# Helpers shared by the bench scripts. Load with preload(); scripts run with
+# --script do not see class_name globals until the project has been imported.
+
+# "--key value" pairs after the "--" separator, values as strings.
+static func parse_args(argv: PackedStringArray) -> Dictionary:
+    var args := {}
+    for i in range(0, argv.size() - 1):
+        if argv[i].begins_with("--"):
+            args[argv[i].substr(2)] = argv[i + 1]
+    return args
+
+# First calls pay for allocations that steady state does not.
+static func warm_up(context: LlamaContext, max_tokens: int, params: Dictionary) -> void:
+    context.generate(max_tokens, params)
@@ -0,0 +1,122 @@
+extends SceneTree
+
+# Per-token overhead of the binding, measured against the mock backend
+# (LLAMA_CPP_MOCK=1), whose decode and sampling cost next to nothing.
+#
+#   godot --headless --path . --script res://bench/bench_glue.gd -- \
+#       [--iterations 20] [--out bench.json] [--baseline bench.json] [--max-regression 0.25]
+#
+# Every case generates the same scripted reply, so ns/token differences come
+# from the glue: batch building, detokenization, stop-sequence scanning,
+# signal emission and JSON field parsing. With --baseline the run fails when
+# any case got slower than the allowed ratio.
+
+const BenchCommon := preload("res://bench/bench_common.gd")
+
+const MODEL_PATH := "user://godot_llama_mock_bench.txt"
+const REPLY_REPEAT := 8
+const REPLY_UNIT := "The smith wipes his hands and looks at the blade. {\"price\": 40, \"days\": [1, 2]} "
+
+var _tokens_seen := 0
+
+func _init() -> void:
+    var args := BenchCommon.parse_args(OS.get_cmdline_user_args())
+    var iterations := int(args.get("iterations", "20"))
+
+    var file := FileAccess.open(MODEL_PATH, FileAccess.WRITE)
+    file.store_string(REPLY_UNIT.repeat(REPLY_REPEAT))
+    file.close()
+
+    var model := LlamaModel.new()
+    var context := LlamaContext.new()
+    if model.load(MODEL_PATH) != OK or context.create(model, {"n_ctx": 8192, "n_seq_max": 8, "n_batch": 512}) != OK:
+        printerr("bench_glue: could not create the mock context; build with LLAMA_CPP_MOCK=1")
+        quit(1)
+        return
+    context.token_generated.connect(_on_token)
+    context.field_completed.connect(_on_field)
+
+    var stops := ["<|im_end|>", "\nUser:", "\nPlayer:", "###", "</s>", "[END]", "\n\n\n", "Narrator:"]
+    var cases := [
+        ["generate", false, {}],
+        ["generate_stream", true, {}],
+        ["stop_sequences_x8", false, {"stop": stops}],
+        ["json_stream", true, {"json_stream": true, "json_stop": false}],
+        ["lookup_draft_8", false, {"lookup_draft": 8}],
+        ["fused_sampler", false, {"fused_sampler": true}],
+    ]
+
+    var results := {}
+    print("%-20s %12s %12s %12s" % ["case", "tokens", "ns/token", "mock ns/tok"])
+    for entry in cases:
+        results[entry[0]] = _run_case(context, entry[0], entry[1], entry[2], iterations)
+    results["generate_batch_x16"] = _run_batch(context, iterations)
+
+    if args.has("out"):
+        var out := FileAccess.open(args["out"], FileAccess.WRITE)
+        out.store_string(JSON.stringify(results, "  "))
+        out.close()
+    quit(_compare(results, args))
+
+func _on_token(_text: String, _token: int) -> void:
+    _tokens_seen += 1
+
+func _on_field(_path: String, _value: Variant) -> void:
+    pass
+
+func _run_case(context: LlamaContext, name: String, streaming: bool, params: Dictionary, iterations: int) -> Dictionary:
+    context.set_prompt("Customer: Can you fix my sword?\n")
+    var call_params := params.merged({"cache": false})
+    BenchCommon.warm_up(context, 1024, call_params)
+
+    var tokens := 0
+    var mock_ms := 0.0
+    var start := Time.get_ticks_usec()
+    for i in iterations:
+        var before: Dictionary = context.get_stats()
+        if streaming:
+            context.generate_stream(1024, call_params)
+        else:
+            context.generate(1024, call_params)
+        var after: Dictionary = context.get_stats()
+        tokens += context.get_last_tokens().size()
+        mock_ms += float(after["t_eval_ms"]) + float(after["t_p_eval_ms"]) - float(before["t_eval_ms"]) - float(before["t_p_eval_ms"])
+    return _report(name, tokens, Time.get_ticks_usec() - start, mock_ms)
+
+func _run_batch(context: LlamaContext, iterations: int) -> Dictionary:
+    var requests := []
+    for i in 16:
+        requests.append({"id": i, "prompt": "Villager %d:" % i, "max_tokens": 1024})
+    context.generate_batch(requests)
+
+    var tokens := 0
+    var start := Time.get_ticks_usec()
+    for i in iterations:
+        for result in context.generate_batch(requests):
+            tokens += int(result["n_tokens"])
+    return _report("generate_batch_x16", tokens, Time.get_ticks_usec() - start, 0.0)
+
+func _report(name: String, tokens: int, elapsed_usec: int, mock_ms: float) -> Dictionary:
+    var ns_per_token := float(elapsed_usec) * 1000.0 / maxf(1.0, float(tokens))
+    var mock_ns_per_token := mock_ms * 1000000.0 / maxf(1.0, float(tokens))
+    print("%-20s %12d %12.0f %12.0f" % [name, tokens, ns_per_token, mock_ns_per_token])
+    return {"tokens": tokens, "ns_per_token": ns_per_token, "mock_ns_per_token": mock_ns_per_token}
+
+func _compare(results: Dictionary, args: Dictionary) -> int:
+    if not args.has("baseline"):
+        return 0
+    var baseline = JSON.parse_string(FileAccess.get_file_as_string(args["baseline"]))
+    if typeof(baseline) != TYPE_DICTIONARY:
+        printerr("bench_glue: cannot read baseline ", args["baseline"])
+        return 1
+    var allowed := 1.0 + float(args.get("max-regression", "0.25"))
+    var regressions := 0
+    for name in results:
+        if not baseline.has(name):
+            continue
+        var ratio := float(results[name]["ns_per_token"]) / maxf(1.0, float(baseline[name]["ns_per_token"]))
+        if ratio > allowed:
+            printerr("bench_glue: %s regressed %.0f%% (%.0f -> %.0f ns/token)" % [name, (ratio - 1.0) * 100.0,
+                    float(baseline[name]["ns_per_token"]), float(results[name]["ns_per_token"])])
+            regressions += 1
+    return 1 if regressions > 0 else 0
@@ -0,0 +1,59 @@
+extends SceneTree
+
+# Sampling cost per token, llama.cpp sampler chain against the fused sampler,
+# on a real model. The mock's 258-token vocabulary is too small to show the
+# difference; pick a model with a large vocabulary and a fast decode.
+#
+#   godot --headless --path . --script res://bench/bench_sampler.gd -- \
+#       --model res://models/model.gguf [--tokens 256] [--iterations 5]
+#
+# Each configuration runs with the same seed under both samplers and reports
+# the context's t_sample_ms / n_sample, so decode time is left out.
+
+const BenchCommon := preload("res://bench/bench_common.gd")
+
+const PROMPT := "The blacksmith looked up from the anvil and said:"
+
+func _init() -> void:
+    var args := BenchCommon.parse_args(OS.get_cmdline_user_args())
+    if not args.has("model"):
+        printerr("usage: --model <path> [--tokens N] [--iterations N]")
+        quit(1)
+        return
+    var tokens := int(args.get("tokens", "256"))
+    var iterations := int(args.get("iterations", "5"))
+
+    var model := LlamaModel.new()
+    var context := LlamaContext.new()
+    if model.load(args["model"]) != OK or context.create(model, {"n_ctx": 2048}) != OK:
+        printerr("bench_sampler: could not load ", args["model"])
+        quit(1)
+        return
+
+    var configs := [
+        ["greedy", {"temperature": 0.0}],
+        ["default", {}],
+        ["top_k_0", {"top_k": 0, "top_p": 0.95}],
+        ["min_p", {"top_k": 0, "top_p": 1.0, "min_p": 0.05}],
+        ["penalties", {"repeat_penalty": 1.1, "frequency_penalty": 0.2, "presence_penalty": 0.2}],
+    ]
+    print("vocabulary: %d tokens" % model.get_vocab_size())
+    print("%-12s %14s %14s %8s" % ["config", "chain ns/tok", "fused ns/tok", "speedup"])
+    for config in configs:
+        var chain := _measure(context, config[1].merged({"fused_sampler": false}), tokens, iterations)
+        var fused := _measure(context, config[1].merged({"fused_sampler": true}), tokens, iterations)
+        print("%-12s %14.0f %14.0f %7.2fx" % [config[0], chain, fused, chain / maxf(1.0, fused)])
+    quit(0)
+
+func _measure(context: LlamaContext, params: Dictionary, tokens: int, iterations: int) -> float:
+    var call_params := params.merged({"seed": 1234, "cache": false})
+    context.set_prompt(PROMPT)
+    BenchCommon.warm_up(context, 16, call_params)
+
+    var before := context.get_stats()
+    for i in iterations:
+        context.generate(tokens, call_params)
+    var after := context.get_stats()
+    var sampled := int(after["n_sample"]) - int(before["n_sample"])
+    var sample_ms := float(after["t_sample_ms"]) - float(before["t_sample_ms"])
+    return sample_ms * 1000000.0 / maxf(1.0, float(sampled))
@@ -0,0 +1,1035 @@
+// Link-time stand-in for the part of llama.h / ggml.h that godot_llama uses.
+//
+// Built instead of the real libraries with LLAMA_CPP_MOCK=1 (see SConstruct).
+// The "model" file is plain text: the script every sequence generates. The
+// vocabulary is byte-level (tokens 0-255 are bytes, then BOS and EOS), and
+// the logits at every position peak on the next byte of the script, following
+// whatever prefix of the script the sequence already ends with. Generation
+// therefore reproduces the script and ends with EOS, regardless of prompt,
+// sampler settings or batching, and costs close to nothing. Timings measured
+// against this backend are the binding's own overhead.
+
+#include <llama.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr llama_token MOCK_BOS = 256;
+constexpr llama_token MOCK_EOS = 257;
+constexpr int32_t MOCK_N_VOCAB = 258;
+constexpr llama_token MOCK_HOLE = -1;
+constexpr float MOCK_PEAK_LOGIT = 10.0f;
+constexpr uint32_t MOCK_STATE_MAGIC = 0x4b434f4d; // "MOCK"
+
+const char *const MOCK_META_KEYS[] = { "general.architecture", "general.name" };
+const char *const MOCK_META_VALUES[] = { "mock", "godot_llama mock backend" };
+
+double _mock_now_ms() {
+    using namespace std::chrono;
+    return duration<double, std::milli>(steady_clock::now().time_since_epoch()).count();
+}
+
+// snprintf-style copy: returns the full length even when the buffer is short.
+int32_t _mock_copy_string(const char *p_value, char *r_buf, size_t p_buf_size) {
+    const size_t length = std::strlen(p_value);
+    if (r_buf != nullptr && p_buf_size > 0) {
+        const size_t n = std::min(length, p_buf_size - 1);
+        std::memcpy(r_buf, p_value, n);
+        r_buf[n] = '\0';
+    }
+    return static_cast<int32_t>(length);
+}
+
+struct MockSequence {
+    // Indexed by position; MOCK_HOLE marks removed cells.
+    std::vector<llama_token> tokens;
+    // Length of the script prefix the sequence ends with at each position.
+    std::vector<int32_t> match;
+};
+
+struct MockChain {
+    std::vector<llama_sampler *> samplers;
+};
+
+} // namespace
+
+struct llama_vocab {
+    int32_t n_tokens = MOCK_N_VOCAB;
+};
+
+struct llama_model {
+    std::string path;
+    std::string script;
+    llama_vocab vocab;
+};
+
+struct llama_adapter_lora {
+    std::string path;
+};
+
+struct llama_memory_i {
+    llama_context *context = nullptr;
+};
+
+struct ggml_backend_reg {
+    const char *name;
+};
+
+struct ggml_backend_device {
+    const char *name;
+    const char *description;
+    ggml_backend_reg *reg;
+};
+
+struct llama_context {
+    llama_model *model = nullptr;
+    llama_context_params params = {};
+    llama_memory_i memory;
+    std::vector<MockSequence> sequences;
+    std::vector<float> logits;
+    std::vector<int32_t> output_rows;
+    int32_t n_outputs = 0;
+    llama_perf_context_data perf = {};
+};
+
+namespace {
+
+int32_t _mock_n_ctx_seq(const llama_context *p_ctx) {
+    if (p_ctx->params.kv_unified || p_ctx->params.n_seq_max <= 1) {
+        return static_cast<int32_t>(p_ctx->params.n_ctx);
+    }
+    return static_cast<int32_t>(p_ctx->params.n_ctx / p_ctx->params.n_seq_max);
+}
+
+void _mock_update_match(const std::string &p_script, MockSequence &r_seq, size_t p_pos) {
+    const llama_token token = r_seq.tokens[p_pos];
+    const int32_t previous = p_pos > 0 ? r_seq.match[p_pos - 1] : 0;
+    const int32_t length = static_cast<int32_t>(p_script.size());
+    int32_t match = 0;
+    if (token == MOCK_HOLE || token >= 256) {
+        match = 0;
+    } else if (previous < length && static_cast<unsigned char>(p_script[previous]) == token) {
+        match = previous + 1;
+    } else if (length > 0 && static_cast<unsigned char>(p_script[0]) == token) {
+        match = 1;
+    }
+    r_seq.match[p_pos] = match;
+}
+
+void _mock_recompute(const std::string &p_script, MockSequence &r_seq, size_t p_from) {
+    while (!r_seq.tokens.empty() && r_seq.tokens.back() == MOCK_HOLE) {
+        r_seq.tokens.pop_back();
+    }
+    r_seq.match.resize(r_seq.tokens.size());
+    for (size_t pos = p_from; pos < r_seq.tokens.size(); pos++) {
+        _mock_update_match(p_script, r_seq, pos);
+    }
+}
+
+llama_token _mock_next_token(const llama_model *p_model, const MockSequence &p_seq, size_t p_pos) {
+    const int32_t match = p_seq.match[p_pos];
+    if (match >= static_cast<int32_t>(p_model->script.size())) {
+        return MOCK_EOS;
+    }
+    return static_cast<unsigned char>(p_model->script[match]);
+}
+
+const char *_mock_sampler_name(const llama_sampler *) {
+    return "mock";
+}
+
+void _mock_sampler_select_max(llama_sampler *, llama_token_data_array *r_cur) {
+    int64_t best = 0;
+    for (size_t i = 1; i < r_cur->size; i++) {
+        if (r_cur->data[i].logit > r_cur->data[best].logit) {
+            best = static_cast<int64_t>(i);
+        }
+    }
+    r_cur->selected = best;
+}
+
+void _mock_sampler_passthrough(llama_sampler *, llama_token_data_array *) {
+}
+
+// Stand-ins for the built-in samplers: the script decides the token, so
+// filtering stages are no-ops and both final stages pick the peak.
+const llama_sampler_i *_mock_select_iface() {
+    static llama_sampler_i iface = {};
+    iface.name = _mock_sampler_name;
+    iface.apply = _mock_sampler_select_max;
+    return &iface;
+}
+
+const llama_sampler_i *_mock_filter_iface() {
+    static llama_sampler_i iface = {};
+    iface.name = _mock_sampler_name;
+    iface.apply = _mock_sampler_passthrough;
+    return &iface;
+}
+
+const char *_mock_chain_name(const llama_sampler *) {
+    return "chain";
+}
+
+void _mock_chain_accept(llama_sampler *p_chain, llama_token p_token) {
+    for (llama_sampler *sampler : static_cast<MockChain *>(p_chain->ctx)->samplers) {
+        llama_sampler_accept(sampler, p_token);
+    }
+}
+
+void _mock_chain_apply(llama_sampler *p_chain, llama_token_data_array *r_cur) {
+    for (llama_sampler *sampler : static_cast<MockChain *>(p_chain->ctx)->samplers) {
+        llama_sampler_apply(sampler, r_cur);
+    }
+}
+
+void _mock_chain_reset(llama_sampler *p_chain) {
+    for (llama_sampler *sampler : static_cast<MockChain *>(p_chain->ctx)->samplers) {
+        llama_sampler_reset(sampler);
+    }
+}
+
+void _mock_chain_free(llama_sampler *p_chain) {
+    MockChain *chain = static_cast<MockChain *>(p_chain->ctx);
+    for (llama_sampler *sampler : chain->samplers) {
+        llama_sampler_free(sampler);
+    }
+    delete chain;
+}
+
+const llama_sampler_i *_mock_chain_iface() {
+    static llama_sampler_i iface = {};
+    iface.name = _mock_chain_name;
+    iface.accept = _mock_chain_accept;
+    iface.apply = _mock_chain_apply;
+    iface.reset = _mock_chain_reset;
+    iface.free = _mock_chain_free;
+    return &iface;
+}
+
+void _mock_write_u32(std::vector<uint8_t> &r_out, uint32_t p_value) {
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(&p_value);
+    r_out.insert(r_out.end(), bytes, bytes + sizeof(p_value));
+}
+
+bool _mock_read_u32(const uint8_t *p_data, size_t p_size, size_t &r_offset, uint32_t &r_value) {
+    if (r_offset + sizeof(r_value) > p_size) {
+        return false;
+    }
+    std::memcpy(&r_value, p_data + r_offset, sizeof(r_value));
+    r_offset += sizeof(r_value);
+    return true;
+}
+
+void _mock_write_sequence(std::vector<uint8_t> &r_out, const MockSequence &p_seq) {
+    _mock_write_u32(r_out, static_cast<uint32_t>(p_seq.tokens.size()));
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(p_seq.tokens.data());
+    r_out.insert(r_out.end(), bytes, bytes + p_seq.tokens.size() * sizeof(llama_token));
+}
+
+bool _mock_read_sequence(const llama_model *p_model, const uint8_t *p_data, size_t p_size, size_t &r_offset, MockSequence &r_seq) {
+    uint32_t count = 0;
+    if (!_mock_read_u32(p_data, p_size, r_offset, count) || r_offset + count * sizeof(llama_token) > p_size) {
+        return false;
+    }
+    r_seq.tokens.resize(count);
+    std::memcpy(r_seq.tokens.data(), p_data + r_offset, count * sizeof(llama_token));
+    r_offset += count * sizeof(llama_token);
+    _mock_recompute(p_model->script, r_seq, 0);
+    return true;
+}
+
+std::vector<uint8_t> _mock_serialize(const llama_context *p_ctx, llama_seq_id p_seq) {
+    std::vector<uint8_t> out;
+    _mock_write_u32(out, MOCK_STATE_MAGIC);
+    if (p_seq >= 0) {
+        _mock_write_u32(out, 1);
+        _mock_write_sequence(out, p_ctx->sequences[p_seq]);
+        return out;
+    }
+    _mock_write_u32(out, static_cast<uint32_t>(p_ctx->sequences.size()));
+    for (const MockSequence &seq : p_ctx->sequences) {
+        _mock_write_sequence(out, seq);
+    }
+    return out;
+}
+
+size_t _mock_deserialize(llama_context *p_ctx, const uint8_t *p_data, size_t p_size, llama_seq_id p_seq) {
+    size_t offset = 0;
+    uint32_t magic = 0;
+    uint32_t count = 0;
+    if (!_mock_read_u32(p_data, p_size, offset, magic) || magic != MOCK_STATE_MAGIC || !_mock_read_u32(p_data, p_size, offset, count)) {
+        return 0;
+    }
+    if (p_seq >= 0) {
+        MockSequence seq;
+        if (count != 1 || !_mock_read_sequence(p_ctx->model, p_data, p_size, offset, seq)) {
+            return 0;
+        }
+        p_ctx->sequences[p_seq] = seq;
+        return offset;
+    }
+    if (count != p_ctx->sequences.size()) {
+        return 0;
+    }
+    std::vector<MockSequence> sequences(count);
+    for (MockSequence &seq : sequences) {
+        if (!_mock_read_sequence(p_ctx->model, p_data, p_size, offset, seq)) {
+            return 0;
+        }
+    }
+    p_ctx->sequences = sequences;
+    return offset;
+}
+
+bool _mock_read_file(const char *p_path, std::vector<uint8_t> &r_data) {
+    std::ifstream file(p_path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    r_data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+bool _mock_write_file(const char *p_path, const std::vector<uint8_t> &p_data) {
+    std::ofstream file(p_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(p_data.data()), static_cast<std::streamsize>(p_data.size()));
+    return static_cast<bool>(file);
+}
+
+bool _mock_seq_valid(const llama_context *p_ctx, llama_seq_id p_seq) {
+    return p_seq >= 0 && p_seq < static_cast<llama_seq_id>(p_ctx->sequences.size());
+}
+
+} // namespace
+
+extern "C" {
+
+// ggml type helpers used by the memory planner and the GGUF reader.
+
+size_t ggml_type_size(enum ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_F32:
+            return 4;
+        case GGML_TYPE_F16:
+        case GGML_TYPE_BF16:
+            return 2;
+        case GGML_TYPE_Q4_0:
+            return 18;
+        case GGML_TYPE_Q4_1:
+            return 20;
+        case GGML_TYPE_Q5_0:
+            return 22;
+        case GGML_TYPE_Q5_1:
+            return 24;
+        case GGML_TYPE_Q8_0:
+            return 34;
+        case GGML_TYPE_IQ4_NL:
+            return 18;
+        default:
+            return 0;
+    }
+}
+
+int64_t ggml_blck_size(enum ggml_type type) {
+    return type == GGML_TYPE_F32 || type == GGML_TYPE_F16 || type == GGML_TYPE_BF16 ? 1 : 32;
+}
+
+size_t ggml_row_size(enum ggml_type type, int64_t ne) {
+    return ggml_type_size(type) * static_cast<size_t>(ne / ggml_blck_size(type));
+}
+
+const char *ggml_type_name(enum ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_F32:
+            return "f32";
+        case GGML_TYPE_F16:
+            return "f16";
+        case GGML_TYPE_BF16:
+            return "bf16";
+        case GGML_TYPE_Q4_0:
+            return "q4_0";
+        case GGML_TYPE_Q4_1:
+            return "q4_1";
+        case GGML_TYPE_Q5_0:
+            return "q5_0";
+        case GGML_TYPE_Q5_1:
+            return "q5_1";
+        case GGML_TYPE_Q8_0:
+            return "q8_0";
+        case GGML_TYPE_IQ4_NL:
+            return "iq4_nl";
+        default:
+            return "NONE";
+    }
+}
+
+bool ggml_is_quantized(enum ggml_type type) {
+    return ggml_blck_size(type) > 1;
+}
+
+// Backend registry: one CPU backend with one device, always registered.
+
+namespace {
+
+ggml_backend_reg mock_cpu_reg = { "CPU" };
+ggml_backend_device mock_cpu_device = { "CPU", "godot_llama mock CPU", &mock_cpu_reg };
+ggml_backend_feature mock_cpu_features[] = { { "MOCK", "1" }, { nullptr, nullptr } };
+
+ggml_backend_feature *_mock_get_features(ggml_backend_reg_t reg) {
+    return mock_cpu_features;
+}
+
+} // namespace
+
+void ggml_backend_load_all_from_path(const char *dir_path) {
+}
+
+size_t ggml_backend_reg_count(void) {
+    return 1;
+}
+
+ggml_backend_reg_t ggml_backend_reg_get(size_t index) {
+    return index == 0 ? &mock_cpu_reg : nullptr;
+}
+
+ggml_backend_reg_t ggml_backend_reg_by_name(const char *name) {
+    return std::strcmp(name, mock_cpu_reg.name) == 0 ? &mock_cpu_reg : nullptr;
+}
+
+const char *ggml_backend_reg_name(ggml_backend_reg_t reg) {
+    return reg->name;
+}
+
+void *ggml_backend_reg_get_proc_address(ggml_backend_reg_t reg, const char *name) {
+    return std::strcmp(name, "ggml_backend_get_features") == 0 ? reinterpret_cast<void *>(&_mock_get_features) : nullptr;
+}
+
+size_t ggml_backend_dev_count(void) {
+    return 1;
+}
+
+ggml_backend_dev_t ggml_backend_dev_get(size_t index) {
+    return index == 0 ? &mock_cpu_device : nullptr;
+}
+
+const char *ggml_backend_dev_name(ggml_backend_dev_t device) {
+    return device->name;
+}
+
+const char *ggml_backend_dev_description(ggml_backend_dev_t device) {
+    return device->description;
+}
+
+enum ggml_backend_dev_type ggml_backend_dev_type(ggml_backend_dev_t device) {
+    return GGML_BACKEND_DEVICE_TYPE_CPU;
+}
+
+ggml_backend_reg_t ggml_backend_dev_backend_reg(ggml_backend_dev_t device) {
+    return device->reg;
+}
+
+void ggml_backend_dev_memory(ggml_backend_dev_t device, size_t *free, size_t *total) {
+    *free = 0;
+    *total = 0;
+}
+
+// Backend and model.
+
+void llama_backend_init(void) {
+}
+
+void llama_backend_free(void) {
+}
+
+struct llama_model_params llama_model_default_params(void) {
+    llama_model_params params = {};
+    params.use_mmap = true;
+    return params;
+}
+
+struct llama_model *llama_model_load_from_file(const char *path_model, struct llama_model_params params) {
+    std::vector<uint8_t> data;
+    if (!_mock_read_file(path_model, data)) {
+        return nullptr;
+    }
+    llama_model *model = new llama_model();
+    model->path = path_model;
+    model->script.assign(data.begin(), data.end());
+    return model;
+}
+
+void llama_model_free(struct llama_model *model) {
+    delete model;
+}
+
+const struct llama_vocab *llama_model_get_vocab(const struct llama_model *model) {
+    return &model->vocab;
+}
+
+int32_t llama_model_n_ctx_train(const struct llama_model *model) {
+    return 32768;
+}
+
+int32_t llama_model_n_embd(const struct llama_model *model) {
+    return 64;
+}
+
+int32_t llama_model_n_layer(const struct llama_model *model) {
+    return 1;
+}
+
+int32_t llama_model_n_head(const struct llama_model *model) {
+    return 1;
+}
+
+int32_t llama_model_n_head_kv(const struct llama_model *model) {
+    return 1;
+}
+
+int32_t llama_model_meta_count(const struct llama_model *model) {
+    return static_cast<int32_t>(std::size(MOCK_META_KEYS));
+}
+
+int32_t llama_model_meta_key_by_index(const struct llama_model *model, int32_t i, char *buf, size_t buf_size) {
+    if (i < 0 || i >= llama_model_meta_count(model)) {
+        return -1;
+    }
+    return _mock_copy_string(MOCK_META_KEYS[i], buf, buf_size);
+}
+
+int32_t llama_model_meta_val_str_by_index(const struct llama_model *model, int32_t i, char *buf, size_t buf_size) {
+    if (i < 0 || i >= llama_model_meta_count(model)) {
+        return -1;
+    }
+    return _mock_copy_string(MOCK_META_VALUES[i], buf, buf_size);
+}
+
+int32_t llama_model_desc(const struct llama_model *model, char *buf, size_t buf_size) {
+    return _mock_copy_string("mock byte-level", buf, buf_size);
+}
+
+uint64_t llama_model_size(const struct llama_model *model) {
+    return model->script.size();
+}
+
+uint64_t llama_model_n_params(const struct llama_model *model) {
+    return 0;
+}
+
+const char *llama_model_chat_template(const struct llama_model *model, const char *name) {
+    return nullptr;
+}
+
+struct llama_adapter_lora *llama_adapter_lora_init(struct llama_model *model, const char *path_lora) {
+    std::vector<uint8_t> data;
+    if (!_mock_read_file(path_lora, data)) {
+        return nullptr;
+    }
+    llama_adapter_lora *adapter = new llama_adapter_lora();
+    adapter->path = path_lora;
+    return adapter;
+}
+
+void llama_adapter_lora_free(struct llama_adapter_lora *adapter) {
+    delete adapter;
+}
+
+int32_t llama_set_adapter_lora(struct llama_context *ctx, struct llama_adapter_lora *adapter, float scale) {
+    return 0;
+}
+
+void llama_clear_adapter_lora(struct llama_context *ctx) {
+}
+
+// Context.
+
+struct llama_context_params llama_context_default_params(void) {
+    llama_context_params params = {};
+    params.n_ctx = 512;
+    params.n_batch = 2048;
+    params.n_ubatch = 512;
+    params.n_seq_max = 1;
+    params.n_threads = 4;
+    params.n_threads_batch = 4;
+    params.flash_attn_type = LLAMA_FLASH_ATTN_TYPE_AUTO;
+    params.type_k = GGML_TYPE_F16;
+    params.type_v = GGML_TYPE_F16;
+    return params;
+}
+
+struct llama_context *llama_init_from_model(struct llama_model *model, struct llama_context_params params) {
+    if (model == nullptr || params.n_ctx == 0 || params.n_seq_max == 0) {
+        return nullptr;
+    }
+    llama_context *ctx = new llama_context();
+    ctx->model = model;
+    ctx->params = params;
+    ctx->memory.context = ctx;
+    ctx->sequences.resize(params.n_seq_max);
+    ctx->perf.t_start_ms = _mock_now_ms();
+    return ctx;
+}
+
+void llama_free(struct llama_context *ctx) {
+    delete ctx;
+}
+
+uint32_t llama_n_ctx(const struct llama_context *ctx) {
+    return ctx->params.n_ctx;
+}
+
+uint32_t llama_n_ctx_seq(const struct llama_context *ctx) {
+    return static_cast<uint32_t>(_mock_n_ctx_seq(ctx));
+}
+
+uint32_t llama_n_batch(const struct llama_context *ctx) {
+    return ctx->params.n_batch;
+}
+
+uint32_t llama_n_ubatch(const struct llama_context *ctx) {
+    return ctx->params.n_ubatch;
+}
+
+uint32_t llama_n_seq_max(const struct llama_context *ctx) {
+    return ctx->params.n_seq_max;
+}
+
+void llama_set_n_threads(struct llama_context *ctx, int32_t n_threads, int32_t n_threads_batch) {
+    ctx->params.n_threads = n_threads;
+    ctx->params.n_threads_batch = n_threads_batch;
+}
+
+llama_memory_t llama_get_memory(const struct llama_context *ctx) {
+    return const_cast<llama_memory_i *>(&ctx->memory);
+}
+
+int32_t llama_decode(struct llama_context *ctx, struct llama_batch batch) {
+    if (batch.n_tokens <= 0 || batch.token == nullptr) {
+        return -1;
+    }
+
+    // Validate first so a failed decode leaves the memory untouched.
+    const int32_t n_ctx_seq = _mock_n_ctx_seq(ctx);
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        const llama_seq_id seq = batch.seq_id != nullptr ? batch.seq_id[i][0] : 0;
+        const llama_pos pos = batch.pos != nullptr ? batch.pos[i] : 0;
+        if (!_mock_seq_valid(ctx, seq) || pos < 0 || batch.token[i] < 0 || batch.token[i] >= MOCK_N_VOCAB) {
+            return -1;
+        }
+        if (pos >= n_ctx_seq) {
+            return 1;
+        }
+    }
+
+    const double start_ms = _mock_now_ms();
+    ctx->n_outputs = 0;
+    ctx->output_rows.assign(batch.n_tokens, -1);
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        const bool wants_logits = batch.logits != nullptr ? batch.logits[i] != 0 : i == batch.n_tokens - 1;
+        if (wants_logits) {
+            ctx->output_rows[i] = ctx->n_outputs++;
+        }
+    }
+    ctx->logits.assign(static_cast<size_t>(ctx->n_outputs) * MOCK_N_VOCAB, 0.0f);
+
+    const std::string &script = ctx->model->script;
+    for (int32_t i = 0; i < batch.n_tokens; i++) {
+        const int32_t n_seq = batch.seq_id != nullptr ? batch.n_seq_id[i] : 1;
+        const size_t pos = batch.pos != nullptr ? static_cast<size_t>(batch.pos[i]) : 0;
+        for (int32_t s = 0; s < n_seq; s++) {
+            MockSequence &seq = ctx->sequences[batch.seq_id != nullptr ? batch.seq_id[i][s] : 0];
+            // Writing a cell drops everything after it and leaves holes
+            // before it; callers only ever append in practice.
+            seq.tokens.resize(pos, MOCK_HOLE);
+            seq.tokens.push_back(batch.token[i]);
+            seq.match.resize(seq.tokens.size(), 0);
+            _mock_update_match(script, seq, pos);
+        }
+        if (ctx->output_rows[i] >= 0) {
+            const MockSequence &seq = ctx->sequences[batch.seq_id != nullptr ? batch.seq_id[i][0] : 0];
+            float *row = ctx->logits.data() + static_cast<size_t>(ctx->output_rows[i]) * MOCK_N_VOCAB;
+            row[_mock_next_token(ctx->model, seq, pos)] = MOCK_PEAK_LOGIT;
+        }
+    }
+
+    if (batch.n_tokens > 1) {
+        ctx->perf.n_p_eval += batch.n_tokens;
+        ctx->perf.t_p_eval_ms += _mock_now_ms() - start_ms;
+    } else {
+        ctx->perf.n_eval += 1;
+        ctx->perf.t_eval_ms += _mock_now_ms() - start_ms;
+    }
+    return 0;
+}
+
+float *llama_get_logits(struct llama_context *ctx) {
+    return ctx->logits.empty() ? nullptr : ctx->logits.data();
+}
+
+float *llama_get_logits_ith(struct llama_context *ctx, int32_t i) {
+    int32_t row = -1;
+    if (i < 0) {
+        row = ctx->n_outputs + i;
+    } else if (i < static_cast<int32_t>(ctx->output_rows.size())) {
+        row = ctx->output_rows[i];
+    }
+    if (row < 0 || row >= ctx->n_outputs) {
+        return nullptr;
+    }
+    return ctx->logits.data() + static_cast<size_t>(row) * MOCK_N_VOCAB;
+}
+
+struct llama_perf_context_data llama_perf_context(const struct llama_context *ctx) {
+    return ctx->perf;
+}
+
+void llama_perf_context_reset(struct llama_context *ctx) {
+    ctx->perf = {};
+    ctx->perf.t_start_ms = _mock_now_ms();
+}
+
+// Memory.
+
+void llama_memory_clear(llama_memory_t mem, bool data) {
+    for (MockSequence &seq : mem->context->sequences) {
+        seq = MockSequence();
+    }
+}
+
+bool llama_memory_seq_rm(llama_memory_t mem, llama_seq_id seq_id, llama_pos p0, llama_pos p1) {
+    llama_context *ctx = mem->context;
+    if (seq_id >= static_cast<llama_seq_id>(ctx->sequences.size())) {
+        return false;
+    }
+    const size_t first = static_cast<size_t>(std::max<llama_pos>(0, p0));
+    for (size_t s = 0; s < ctx->sequences.size(); s++) {
+        if (seq_id >= 0 && static_cast<llama_seq_id>(s) != seq_id) {
+            continue;
+        }
+        MockSequence &seq = ctx->sequences[s];
+        const size_t last = p1 < 0 ? seq.tokens.size() : std::min(seq.tokens.size(), static_cast<size_t>(p1));
+        for (size_t pos = first; pos < last; pos++) {
+            seq.tokens[pos] = MOCK_HOLE;
+        }
+        _mock_recompute(ctx->model->script, seq, std::min(first, seq.tokens.size()));
+    }
+    return true;
+}
+
+void llama_memory_seq_add(llama_memory_t mem, llama_seq_id seq_id, llama_pos p0, llama_pos p1, llama_pos delta) {
+    llama_context *ctx = mem->context;
+    if (!_mock_seq_valid(ctx, seq_id) || delta == 0) {
+        return;
+    }
+    MockSequence &seq = ctx->sequences[seq_id];
+    const llama_pos end = p1 < 0 ? static_cast<llama_pos>(seq.tokens.size()) : std::min<llama_pos>(p1, static_cast<llama_pos>(seq.tokens.size()));
+    const llama_pos begin = std::max<llama_pos>(0, p0);
+    std::vector<llama_token> shifted(seq.tokens.size() + static_cast<size_t>(std::max<llama_pos>(0, delta)), MOCK_HOLE);
+    for (llama_pos pos = 0; pos < static_cast<llama_pos>(seq.tokens.size()); pos++) {
+        const llama_token token = seq.tokens[pos];
+        if (token == MOCK_HOLE) {
+            continue;
+        }
+        const llama_pos target = pos >= begin && pos < end ? pos + delta : pos;
+        if (target >= 0) {
+            shifted[target] = token;
+        }
+    }
+    seq.tokens = shifted;
+    _mock_recompute(ctx->model->script, seq, 0);
+}
+
+llama_pos llama_memory_seq_pos_max(llama_memory_t mem, llama_seq_id seq_id) {
+    const llama_context *ctx = mem->context;
+    if (!_mock_seq_valid(ctx, seq_id)) {
+        return -1;
+    }
+    return static_cast<llama_pos>(ctx->sequences[seq_id].tokens.size()) - 1;
+}
+
+bool llama_memory_can_shift(llama_memory_t mem) {
+    return true;
+}
+
+// State.
+
+size_t llama_state_get_size(struct llama_context *ctx) {
+    return _mock_serialize(ctx, -1).size();
+}
+
+size_t llama_state_get_data(struct llama_context *ctx, uint8_t *dst, size_t size) {
+    const std::vector<uint8_t> state = _mock_serialize(ctx, -1);
+    if (state.size() > size) {
+        return 0;
+    }
+    std::memcpy(dst, state.data(), state.size());
+    return state.size();
+}
+
+size_t llama_state_set_data(struct llama_context *ctx, const uint8_t *src, size_t size) {
+    return _mock_deserialize(ctx, src, size, -1);
+}
+
+bool llama_state_save_file(struct llama_context *ctx, const char *path_session, const llama_token *tokens, size_t n_token_count) {
+    std::vector<uint8_t> data;
+    _mock_write_u32(data, static_cast<uint32_t>(n_token_count));
+    const uint8_t *token_bytes = reinterpret_cast<const uint8_t *>(tokens);
+    data.insert(data.end(), token_bytes, token_bytes + n_token_count * sizeof(llama_token));
+    const std::vector<uint8_t> state = _mock_serialize(ctx, -1);
+    data.insert(data.end(), state.begin(), state.end());
+    return _mock_write_file(path_session, data);
+}
+
+bool llama_state_load_file(struct llama_context *ctx, const char *path_session, llama_token *tokens_out, size_t n_token_capacity, size_t *n_token_count_out) {
+    std::vector<uint8_t> data;
+    size_t offset = 0;
+    uint32_t n_tokens = 0;
+    if (!_mock_read_file(path_session, data) || !_mock_read_u32(data.data(), data.size(), offset, n_tokens) || n_tokens > n_token_capacity) {
+        return false;
+    }
+    if (offset + n_tokens * sizeof(llama_token) > data.size()) {
+        return false;
+    }
+    if (n_tokens > 0) {
+        std::memcpy(tokens_out, data.data() + offset, n_tokens * sizeof(llama_token));
+    }
+    offset += n_tokens * sizeof(llama_token);
+    if (n_token_count_out != nullptr) {
+        *n_token_count_out = n_tokens;
+    }
+    return _mock_deserialize(ctx, data.data() + offset, data.size() - offset, -1) > 0;
+}
+
+size_t llama_state_seq_get_size(struct llama_context *ctx, llama_seq_id seq_id) {
+    return _mock_seq_valid(ctx, seq_id) ? _mock_serialize(ctx, seq_id).size() : 0;
+}
+
+size_t llama_state_seq_get_data(struct llama_context *ctx, uint8_t *dst, size_t size, llama_seq_id seq_id) {
+    if (!_mock_seq_valid(ctx, seq_id)) {
+        return 0;
+    }
+    const std::vector<uint8_t> state = _mock_serialize(ctx, seq_id);
+    if (state.size() > size) {
+        return 0;
+    }
+    std::memcpy(dst, state.data(), state.size());
+    return state.size();
+}
+
+size_t llama_state_seq_set_data(struct llama_context *ctx, const uint8_t *src, size_t size, llama_seq_id dest_seq_id) {
+    return _mock_seq_valid(ctx, dest_seq_id) ? _mock_deserialize(ctx, src, size, dest_seq_id) : 0;
+}
+
+size_t llama_state_seq_save_file(struct llama_context *ctx, const char *filepath, llama_seq_id seq_id, const llama_token *tokens, size_t n_token_count) {
+    if (!_mock_seq_valid(ctx, seq_id)) {
+        return 0;
+    }
+    const std::vector<uint8_t> state = _mock_serialize(ctx, seq_id);
+    return _mock_write_file(filepath, state) ? state.size() : 0;
+}
+
+size_t llama_state_seq_load_file(struct llama_context *ctx, const char *filepath, llama_seq_id dest_seq_id, llama_token *tokens_out, size_t n_token_capacity, size_t *n_token_count_out) {
+    std::vector<uint8_t> data;
+    if (!_mock_seq_valid(ctx, dest_seq_id) || !_mock_read_file(filepath, data)) {
+        return 0;
+    }
+    if (n_token_count_out != nullptr) {
+        *n_token_count_out = 0;
+    }
+    return _mock_deserialize(ctx, data.data(), data.size(), dest_seq_id);
+}
+
+// Vocabulary.
+
+int32_t llama_vocab_n_tokens(const struct llama_vocab *vocab) {
+    return vocab->n_tokens;
+}
+
+bool llama_vocab_is_eog(const struct llama_vocab *vocab, llama_token token) {
+    return token == MOCK_EOS;
+}
+
+int32_t llama_tokenize(const struct llama_vocab *vocab, const char *text, int32_t text_len, llama_token *tokens, int32_t n_tokens_max, bool add_special, bool parse_special) {
+    const int32_t needed = text_len + (add_special ? 1 : 0);
+    if (needed > n_tokens_max) {
+        return -needed;
+    }
+    int32_t n = 0;
+    if (add_special) {
+        tokens[n++] = MOCK_BOS;
+    }
+    for (int32_t i = 0; i < text_len; i++) {
+        tokens[n++] = static_cast<unsigned char>(text[i]);
+    }
+    return n;
+}
+
+int32_t llama_token_to_piece(const struct llama_vocab *vocab, llama_token token, char *buf, int32_t length, int32_t lstrip, bool special) {
+    if (token < 0 || token >= MOCK_N_VOCAB) {
+        return 0;
+    }
+    if (token < 256) {
+        if (length < 1) {
+            return -1;
+        }
+        buf[0] = static_cast<char>(token);
+        return 1;
+    }
+    if (!special) {
+        return 0;
+    }
+    const char *piece = token == MOCK_BOS ? "<s>" : "</s>";
+    const int32_t piece_length = static_cast<int32_t>(std::strlen(piece));
+    if (length < piece_length) {
+        return -piece_length;
+    }
+    std::memcpy(buf, piece, piece_length);
+    return piece_length;
+}
+
+int32_t llama_detokenize(const struct llama_vocab *vocab, const llama_token *tokens, int32_t n_tokens, char *text, int32_t text_len_max, bool remove_special, bool unparse_special) {
+    std::string out;
+    char piece[8];
+    for (int32_t i = 0; i < n_tokens; i++) {
+        const bool is_special = tokens[i] >= 256;
+        if (is_special && remove_special) {
+            continue;
+        }
+        const int32_t n = llama_token_to_piece(vocab, tokens[i], piece, sizeof(piece), 0, unparse_special);
+        out.append(piece, std::max(0, n));
+    }
+    if (static_cast<int32_t>(out.size()) > text_len_max) {
+        return -static_cast<int32_t>(out.size());
+    }
+    std::memcpy(text, out.data(), out.size());
+    return static_cast<int32_t>(out.size());
+}
+
+int32_t llama_chat_apply_template(const char *tmpl, const struct llama_chat_message *chat, size_t n_msg, bool add_ass, char *buf, int32_t length) {
+    // Every template renders as ChatML; the script decides the reply anyway.
+    std::string out;
+    for (size_t i = 0; i < n_msg; i++) {
+        out += "<|im_start|>";
+        out += chat[i].role;
+        out += "\n";
+        out += chat[i].content;
+        out += "<|im_end|>\n";
+    }
+    if (add_ass) {
+        out += "<|im_start|>assistant\n";
+    }
+    if (buf != nullptr && length > 0) {
+        std::memcpy(buf, out.data(), std::min(out.size(), static_cast<size_t>(length)));
+    }
+    return static_cast<int32_t>(out.size());
+}
+
+// Samplers.
+
+struct llama_sampler *llama_sampler_init(const struct llama_sampler_i *iface, llama_sampler_context_t ctx) {
+    llama_sampler *sampler = new llama_sampler();
+    sampler->iface = iface;
+    sampler->ctx = ctx;
+    return sampler;
+}
+
+void llama_sampler_accept(struct llama_sampler *smpl, llama_token token) {
+    if (smpl->iface->accept != nullptr) {
+        smpl->iface->accept(smpl, token);
+    }
+}
+
+void llama_sampler_apply(struct llama_sampler *smpl, llama_token_data_array *cur_p) {
+    smpl->iface->apply(smpl, cur_p);
+}
+
+void llama_sampler_reset(struct llama_sampler *smpl) {
+    if (smpl->iface->reset != nullptr) {
+        smpl->iface->reset(smpl);
+    }
+}
+
+void llama_sampler_free(struct llama_sampler *smpl) {
+    if (smpl == nullptr) {
+        return;
+    }
+    if (smpl->iface->free != nullptr) {
+        smpl->iface->free(smpl);
+    }
+    delete smpl;
+}
+
+struct llama_sampler_chain_params llama_sampler_chain_default_params(void) {
+    llama_sampler_chain_params params = {};
+    params.no_perf = true;
+    return params;
+}
+
+struct llama_sampler *llama_sampler_chain_init(struct llama_sampler_chain_params params) {
+    return llama_sampler_init(_mock_chain_iface(), new MockChain());
+}
+
+void llama_sampler_chain_add(struct llama_sampler *chain, struct llama_sampler *smpl) {
+    static_cast<MockChain *>(chain->ctx)->samplers.push_back(smpl);
+}
+
+struct llama_sampler *llama_sampler_init_greedy(void) {
+    return llama_sampler_init(_mock_select_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_dist(uint32_t seed) {
+    return llama_sampler_init(_mock_select_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_top_k(int32_t k) {
+    return llama_sampler_init(_mock_filter_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_top_p(float p, size_t min_keep) {
+    return llama_sampler_init(_mock_filter_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_min_p(float p, size_t min_keep) {
+    return llama_sampler_init(_mock_filter_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_temp(float t) {
+    return llama_sampler_init(_mock_filter_iface(), nullptr);
+}
+
+struct llama_sampler *llama_sampler_init_penalties(int32_t penalty_last_n, float penalty_repeat, float penalty_freq, float penalty_present) {
+    return llama_sampler_init(_mock_filter_iface(), nullptr);
+}
+
+llama_token llama_sampler_sample(struct llama_sampler *smpl, struct llama_context *ctx, int32_t idx) {
+    const float *logits = llama_get_logits_ith(ctx, idx);
+    if (logits == nullptr) {
+        return MOCK_EOS;
+    }
+
+    thread_local std::vector<llama_token_data> candidates;
+    candidates.resize(MOCK_N_VOCAB);
+    for (llama_token token = 0; token < MOCK_N_VOCAB; token++) {
+        candidates[token] = { token, logits[token], 0.0f };
+    }
+    llama_token_data_array cur_p = { candidates.data(), candidates.size(), -1, false };
+    llama_sampler_apply(smpl, &cur_p);
+    if (cur_p.selected < 0 || cur_p.selected >= static_cast<int64_t>(cur_p.size)) {
+        _mock_sampler_select_max(smpl, &cur_p);
+    }
+
+    const llama_token token = cur_p.data[cur_p.selected].id;
+    llama_sampler_accept(smpl, token);
+    return token;
+}
+
+} // extern "C"
@@ -0,0 +1,352 @@
+extends SceneTree
+
+# Functional checks of the binding against the mock backend (LLAMA_CPP_MOCK=1).
+#
+#   godot --headless --path . --script res://bench/test_glue.gd
+#
+# The mock model replays SCRIPT for every sequence, so every result below is
+# exact. Exits with the number of failed checks.
+
+const MODEL_PATH := "user://godot_llama_mock_model.txt"
+const SCRIPT := "The smith nods. {\"mood\": \"calm\", \"items\": [1, 2]} Come back tomorrow."
+
+const STATE_PATH := "user://godot_llama_test_state.glst"
+
+var _failures := 0
+var _checks := 0
+var _pending_async := 0
+var _async_deadline := 0
+
+func _init() -> void:
+    var file := FileAccess.open(MODEL_PATH, FileAccess.WRITE)
+    file.store_string(SCRIPT)
+    file.close()
+
+    var backend := LlamaModel.get_backend_info()
+    _check("backend info lists the CPU backend", Array(backend["backends"]).has("CPU") and not String(backend["cpu_variant"]).is_empty(), backend)
+    var model := LlamaModel.new()
+    _check("model loads", model.load(MODEL_PATH) == OK)
+    var context := LlamaContext.new()
+    _check("context creates", context.create(model, {"n_ctx": 4096, "n_seq_max": 4, "n_batch": 256}) == OK)
+    if _failures == 0:
+        _test_generate(context)
+        _test_stream(context)
+        _test_json_stream(context)
+        _test_phrase_filter(model, context)
+        _test_lookup_draft(context)
+        _test_fused_sampler(model, context)
+        _test_conversations(context)
+        _test_result_cache(context)
+        _test_state(context)
+        _test_chat_session(context)
+        _test_prompt_builder(model, context)
+        _test_autotuner(model)
+        _test_metrics(model)
+        _test_batch(context)
+        _test_server(context)
+        _test_state_async(context)
+    if _pending_async == 0:
+        _finish()
+
+# Async checks complete through deferred signals, which need the main loop.
+func _process(_delta: float) -> bool:
+    if _pending_async > 0 and Time.get_ticks_msec() > _async_deadline:
+        _check("async checks finish in time", false, _pending_async)
+        _pending_async = 0
+        _finish()
+    return false
+
+func _finish() -> void:
+    print("test_glue: %d/%d checks passed" % [_checks - _failures, _checks])
+    quit(_failures)
+
+func _check(name: String, ok: bool, detail: Variant = null) -> void:
+    _checks += 1
+    if ok:
+        return
+    _failures += 1
+    printerr("FAIL %s%s" % [name, "" if detail == null else ": " + str(detail)])
+
+func _test_generate(context: LlamaContext) -> void:
+    context.set_prompt("Customer: Can you fix my sword?\n")
+    var text := context.generate(512)
+    _check("generate replays the script", text == SCRIPT, text)
+    _check("last tokens cover the reply", context.get_last_tokens().size() == SCRIPT.length())
+
+    text = context.generate(9)
+    _check("max_tokens caps the reply", text == SCRIPT.substr(0, 9), text)
+
+    text = context.generate(512, {"stop": ["nods", "tomorrow"]})
+    _check("earliest stop sequence wins", text == "The smith ", text)
+
+func _test_stream(context: LlamaContext) -> void:
+    # Lambdas capture locals by value; an Array is shared by reference.
+    var pieces := []
+    var on_token := func(token_text: String, _token_id: int) -> void: pieces.append(token_text)
+    context.token_generated.connect(on_token)
+    context.set_prompt("Customer: Hello?\n")
+    context.generate_stream(512)
+    context.token_generated.disconnect(on_token)
+    _check("stream emits one signal per token", pieces.size() == SCRIPT.length(), pieces.size())
+    _check("streamed pieces join to the reply", "".join(PackedStringArray(pieces)) == SCRIPT)
+
+func _test_json_stream(context: LlamaContext) -> void:
+    var fields := {}
+    var on_field := func(path: String, value: Variant) -> void: fields[path] = value
+    context.field_completed.connect(on_field)
+    context.set_prompt("Reply as JSON.\n")
+    var text := context.generate(512, {"json_stream": true})
+    context.field_completed.disconnect(on_field)
+    _check("json fields complete", fields.get("mood") == "calm" and fields.get("items[1]") == 2, fields)
+    _check("json_stop ends at the closing brace", text.ends_with("}"), text)
+
+func _test_phrase_filter(model: LlamaModel, context: LlamaContext) -> void:
+    var filter := LlamaPhraseFilter.new()
+    _check("phrase filter compiles", filter.compile(model, ["smith"]) == OK and filter.is_compiled())
+    var pieces := []
+    var on_token := func(token_text: String, _token_id: int) -> void: pieces.append(token_text)
+    context.token_generated.connect(on_token)
+    context.set_prompt("Customer: Who are you?\n")
+    context.generate_stream(64, {"phrase_filter": filter})
+    context.token_generated.disconnect(on_token)
+    var text := "".join(PackedStringArray(pieces))
+    var stats := context.get_stats()
+    _check("banned phrase is rewound", text.begins_with("The ") and not text.to_lower().contains("smith"), text)
+    _check("phrase rewinds are counted", int(stats.get("phrase_rewinds", 0)) > 0, stats)
+
+func _test_lookup_draft(context: LlamaContext) -> void:
+    # Quoting the reply in the prompt gives the n-gram lookup something to find.
+    context.set_prompt("Repeat after me: " + SCRIPT + "\n")
+    var before := context.get_stats()
+    var text := context.generate(512, {"lookup_draft": 8, "stop": ["tomorrow"]})
+    var after := context.get_stats()
+    var accepted := int(after["lookup_accepted_tokens"]) - int(before["lookup_accepted_tokens"])
+    _check("lookup drafts keep the exact reply", text == SCRIPT.substr(0, SCRIPT.find("tomorrow")), text)
+    _check("lookup drafts are accepted", accepted > 0, after)
+    context.set_prompt("Repeat after me: " + SCRIPT + "\n")
+    text = context.generate(512, {"lookup_draft": 8, "conversation": "lookup"})
+    var length := context.get_conversation_length("lookup")
+    _check("rejected drafts leave no KV behind", text == SCRIPT and length == context.get_last_tokens().size() + ("Repeat after me: " + SCRIPT + "\n").length() + 1, length)
+    context.drop_conversation("lookup")
+
+func _test_fused_sampler(model: LlamaModel, context: LlamaContext) -> void:
+    context.set_prompt("Customer: Can you fix my sword?\n")
+    var before := context.get_stats()
+    var text := context.generate(512, {"fused_sampler": true, "temperature": 0.0, "cache": false})
+    var after := context.get_stats()
+    _check("fused greedy replays the script", text == SCRIPT, text)
+    _check("sampling time is counted per token", int(after["n_sample"]) - int(before["n_sample"]) == SCRIPT.length() + 1, after)
+    text = context.generate(512, {"fused_sampler": true, "seed": 7, "min_p": 0.05, "repeat_penalty": 1.1, "presence_penalty": 0.5, "cache": false})
+    _check("fused sampling with cutoffs and penalties replays the script", text == SCRIPT, text)
+    var filter := LlamaPhraseFilter.new()
+    filter.compile(model, ["smith"])
+    text = context.generate(64, {"fused_sampler": true, "phrase_filter": filter, "cache": false})
+    _check("fused sampler runs after the phrase filter", text.begins_with("The ") and not text.to_lower().contains("smith"), text)
+    var results := context.generate_batch([{"prompt": "A:", "fused_sampler": true}, {"prompt": "B:"}])
+    _check("fused and chain samplers agree in a batch", results.size() == 2 and results[0]["text"] == results[1]["text"], results)
+
+func _test_conversations(context: LlamaContext) -> void:
+    context.set_prompt("Guard: Halt!\n")
+    context.generate(16, {"conversation": "guard"})
+    var length := context.get_conversation_length("guard")
+    _check("conversation keeps its KV", length > 16, length)
+    _check("truncate conversation", context.truncate_conversation("guard", 4) == OK and context.get_conversation_length("guard") == 4)
+    _check("evict conversation", context.evict_conversation("guard") and context.get_conversation_length("guard") == 4)
+    context.set_prompt("Player: Let me pass.\n")
+    var text := context.generate(512, {"conversation": "guard"})
+    _check("evicted conversation restores and continues", text == SCRIPT, text)
+    _check("drop conversation", context.drop_conversation("guard") and not context.has_conversation("guard"))
+
+func _test_result_cache(context: LlamaContext) -> void:
+    context.result_cache = LlamaResultCache.new()
+    context.set_prompt("Merchant: Welcome!\n")
+    var first := context.generate(512, {"seed": 7})
+    context.set_prompt("Merchant: Goodbye!\n")
+    context.generate(512, {"seed": 7, "cache": false})
+    context.set_prompt("Merchant: Welcome!\n")
+    var second := context.generate(512, {"seed": 7})
+    var stats := context.get_stats()
+    context.result_cache = null
+    _check("result cache hit replays the reply", first == second and int(stats.get("result_cache_hits", 0)) == 1, stats)
+    # The hit decoded nothing, so the goodbye exchange must not be continued.
+    context.set_prompt("Merchant: Anything else?\n")
+    context.generate(512, {"reuse_kv": true})
+    var length := context.get_conversation_length("")
+    _check("reuse_kv after a cache hit starts from a fresh KV", length == context.get_last_tokens().size() + "Merchant: Anything else?\n".length() + 1, length)
+
+func _test_state(context: LlamaContext) -> void:
+    context.set_prompt("Save me.\n")
+    context.generate(8)
+    var state := context.save_state()
+    _check("save_state returns data", not state.is_empty())
+    _check("load_state accepts it", context.load_state(state) == OK)
+
+func _test_state_async(context: LlamaContext) -> void:
+    context.set_prompt("Autosave me.\n")
+    context.generate(8)
+    var expected := context.save_state()
+    var saved := []
+    context.state_saved.connect(func(path: String, error: int) -> void:
+        saved.append(error)
+        if saved.size() < 2:
+            return
+        _check("async saves complete", saved == [OK, OK] and FileAccess.file_exists(path), saved)
+        context.clear_kv_cache()
+        _check("async load queues", context.load_state_file_async(path) == OK)
+        _check("only one async load at a time", context.load_state_file_async(path) == ERR_BUSY))
+    context.state_loaded.connect(func(_path: String, error: int) -> void:
+        _check("async load applies the snapshot", error == OK and context.save_state() == expected, error)
+        _pending_async -= 1
+        if _pending_async == 0:
+            _finish())
+    _pending_async += 1
+    _async_deadline = Time.get_ticks_msec() + 10000
+    _check("async save queues", context.save_state_file_async(STATE_PATH) == OK)
+    _check("next snapshot takes the other buffer", context.save_state_file_async(STATE_PATH) == OK)
+
+func _test_chat_session(context: LlamaContext) -> void:
+    var session := LlamaChatSession.new()
+    session.context = context
+    session.add_message("system", "You are a blacksmith.")
+    session.add_message("user", "Can you fix my sword?")
+    var reply := session.generate(512)
+    _check("chat reply", reply == SCRIPT, reply)
+    session.add_message("user", "How much?")
+    reply = session.generate(512)
+    var stats := session.get_stats()
+    _check("second turn reuses the KV", reply == SCRIPT and int(stats["tokens_reused"]) > 0, stats)
+    # Template work per turn must not grow with the history.
+    var renders := []
+    for turn in 3:
+        var before := int(session.get_stats()["template_renders"])
+        session.add_message("user", "And turn %d?" % turn)
+        session.generate(512)
+        renders.append(int(session.get_stats()["template_renders"]) - before)
+    _check("template renders per turn stay flat", renders[1] == renders[2] and renders[2] <= 4, renders)
+    session.clear()
+
+func _test_prompt_builder(model: LlamaModel, context: LlamaContext) -> void:
+    var builder := LlamaPromptBuilder.new()
+    builder.context = context
+    builder.token_budget = 41
+    builder.set_section("system", "You are a smith.\n", 10)
+    builder.set_section("lore", ["Oakridge has a forge.\n", "The forge is old.\n"])
+    builder.set_section("history", ["Player: Hi\n", "Smith: Hello\n", "Player: Fix it\n"], 5, 0, true)
+    var tokens := builder.build(16)
+    # The mock vocabulary is one token per byte plus BOS, so the budget is 40 bytes.
+    _check("prompt builder fills the exact budget", tokens.size() == 41 and tokens[0] == model.tokenize("", true)[0], tokens.size())
+    var text := model.detokenize(tokens.slice(1))
+    _check("prompt builder keeps priorities in layout order", text == "You are a smith.\nOakridgePlayer: Fix it\n", text)
+    var tokenized := int(builder.get_stats()["items_tokenized"])
+    builder.set_section("history", ["Player: Hi\n", "Smith: Hello\n", "Player: Fix it\n", "Smith: Done\n"], 5, 0, true)
+    builder.build(16)
+    _check("prompt builder only tokenizes new items", int(builder.get_stats()["items_tokenized"]) == tokenized + 1, builder.get_stats())
+    builder.token_budget = 0
+    _check("prompt builder generates from its tokens", builder.generate(512) == SCRIPT)
+
+func _test_autotuner(model: LlamaModel) -> void:
+    # One candidate per knob keeps the run short; n_batch must fit the prompt.
+    var result := LlamaAutotuner.run(model, {"save": true, "prompt_tokens": 64, "generate_tokens": 8, "repeats": 1,
+            "threads": [1], "n_ubatch": [32], "n_batch": [64]})
+    _check("autotuner picks the only candidates", result.get("n_batch") == 64 and result.get("n_ubatch") == 32 and result.get("threads") == 1, result)
+    var tuned := LlamaAutotuner.lookup(model)
+    _check("autotuner lookup returns the winner", tuned.get("n_batch") == 64 and tuned.get("n_ubatch") == 32 and tuned.get("threads") == 1, tuned)
+
+    var tuned_context := LlamaContext.new()
+    tuned_context.create(model, {"n_ctx": 512})
+    var stats := tuned_context.get_stats()
+    _check("create applies the tuned batch sizes", stats["autotuned"] == true and int(stats["n_batch"]) == 64 and int(stats["n_ubatch"]) == 32, stats)
+    var untuned_context := LlamaContext.new()
+    untuned_context.create(model, {"n_ctx": 512, "autotune": false})
+    stats = untuned_context.get_stats()
+    _check("autotune=false ignores the tuning", stats["autotuned"] == false and int(stats["n_batch"]) != 64, stats)
+
+    LlamaAutotuner.clear(model)
+    _check("autotuner clear forgets the model", LlamaAutotuner.lookup(model).is_empty())
+
+func _test_metrics(model: LlamaModel) -> void:
+    _check("metrics monitors are registered", Performance.has_custom_monitor("godot_llama/tokens_per_second"))
+    var before := LlamaContext.get_global_metrics()
+    var metrics_context := LlamaContext.new()
+    metrics_context.create(model, {"n_ctx": 512, "autotune": false})
+    var created := LlamaContext.get_global_metrics()
+    _check("metrics count the new context", int(created["contexts"]) == int(before["contexts"]) + 1
+            and int(created["kv_cells_total"]) == int(before["kv_cells_total"]) + 512, created)
+    metrics_context.set_prompt("Guard: Halt!\n")
+    metrics_context.generate(16)
+    var generated := LlamaContext.get_global_metrics()
+    _check("metrics count generated tokens", int(generated["generated_tokens_total"]) == int(created["generated_tokens_total"]) + 16, generated)
+    metrics_context = null
+    var released := LlamaContext.get_global_metrics()
+    _check("metrics release a freed context", int(released["contexts"]) == int(before["contexts"])
+            and int(released["kv_cells_total"]) == int(before["kv_cells_total"]), released)
+
+func _test_batch(context: LlamaContext) -> void:
+    var requests := []
+    for i in 10:
+        requests.append({"id": "bark_%d" % i, "prompt": "Villager %d:" % i, "max_tokens": 512 if i % 3 else 5})
+    var finished := []
+    var on_finished := func(result: Dictionary) -> void: finished.append(result["id"])
+    context.batch_item_finished.connect(on_finished)
+    var results := context.generate_batch(requests)
+    context.batch_item_finished.disconnect(on_finished)
+    _check("batch returns every item", results.size() == requests.size() and finished.size() == requests.size())
+    for i in results.size():
+        var result: Dictionary = results[i]
+        var expected := SCRIPT if i % 3 else SCRIPT.substr(0, 5)
+        _check("batch item %d" % i, result["id"] == "bark_%d" % i and result["text"] == expected
+                and result["stop_reason"] == ("eos" if i % 3 else "length"), result)
+    var stats := context.get_stats()
+    _check("batch packs several sequences per decode", float(stats.get("batch_avg_tokens_per_step", 0.0)) > 1.5, stats)
+
+func _test_server(context: LlamaContext) -> void:
+    var server := LlamaServer.new()
+    _check("server starts", server.start(context, 0) == OK and server.get_port() > 0)
+    _check("served context refuses direct generation", context.is_serving() and context.generate(4) == "")
+    var peer := StreamPeerTCP.new()
+    peer.connect_to_host("127.0.0.1", server.get_port())
+    var deadline := Time.get_ticks_msec() + 5000
+    while peer.get_status() == StreamPeerTCP.STATUS_CONNECTING and Time.get_ticks_msec() < deadline:
+        peer.poll()
+        OS.delay_msec(1)
+    _check("client connects", peer.get_status() == StreamPeerTCP.STATUS_CONNECTED, peer.get_status())
+    var requests := [
+        {"id": "a", "prompt": "Guard:", "stream": true},
+        {"id": "b", "prompt": "Smith:", "max_tokens": 5},
+        {"id": "c", "prompt": "Nobody:", "stream": true},
+        {"cancel": "c"},
+    ]
+    var payload := ""
+    for request in requests:
+        payload += JSON.stringify(request) + "\n"
+    peer.put_data(payload.to_utf8_buffer())
+
+    var pieces := []
+    var done := {}
+    var buffer := ""
+    while done.size() < 3 and Time.get_ticks_msec() < deadline:
+        peer.poll()
+        if peer.get_available_bytes() == 0:
+            OS.delay_msec(1)
+            continue
+        buffer += peer.get_utf8_string(peer.get_available_bytes())
+        var newline := buffer.find("\n")
+        while newline >= 0:
+            var message: Dictionary = JSON.parse_string(buffer.substr(0, newline))
+            buffer = buffer.substr(newline + 1)
+            newline = buffer.find("\n")
+            if message.get("done", false):
+                done[message["id"]] = message
+            elif message["id"] == "a":
+                pieces.append(message["text"])
+    peer.disconnect_from_host()
+    var stats := server.get_stats()
+    server.stop()
+
+    _check("server answers every request", done.size() == 3, done.keys())
+    _check("server streams tokens", "".join(PackedStringArray(pieces)) == SCRIPT, pieces)
+    _check("server result", done.has("a") and done["a"]["text"] == SCRIPT, done.get("a"))
+    _check("server applies request params", done.has("b") and done["b"]["text"] == SCRIPT.substr(0, 5), done.get("b"))
+    _check("server cancels by id", done.has("c") and done["c"]["stop_reason"] == "cancelled", done.get("c"))
+    _check("server counts requests", int(stats["requests_accepted"]) == 3, stats)
+    _check("stopped server releases the context", not context.is_serving() and context.generate(4) == SCRIPT.substr(0, 4))
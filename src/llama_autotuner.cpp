@@ -0,0 +1,368 @@
+#include "llama_autotuner.h"
+
+#include <godot_cpp/classes/config_file.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+#include <vector>
+
+using namespace godot;
+
+namespace {
+
+const char *const AUTOTUNE_PATH = "user://godot_llama_autotune.cfg";
+const char *const AUTOTUNE_KEYS[] = { "n_batch", "n_ubatch", "threads", "threads_batch" };
+
+struct TuneConfig {
+    int32_t n_batch = 512;
+    int32_t n_ubatch = 512;
+    int32_t threads = 1;
+    int32_t threads_batch = 1;
+};
+
+std::vector<int32_t> _int_candidates(const Dictionary &p_options, const char *p_key, const std::vector<int32_t> &p_defaults) {
+    std::vector<int32_t> values;
+    if (p_options.has(p_key) && p_options[p_key].get_type() == Variant::ARRAY) {
+        const Array array = p_options[p_key];
+        for (int64_t i = 0; i < array.size(); i++) {
+            values.push_back(static_cast<int32_t>(int64_t(array[i])));
+        }
+    } else {
+        values = p_defaults;
+    }
+    values.erase(std::remove_if(values.begin(), values.end(), [](int32_t p_value) { return p_value <= 0; }), values.end());
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
+}
+
+// Decodes p_count tokens of p_tokens starting at p_pos in n_batch chunks,
+// requesting logits only for the last token like a real prompt would.
+bool _decode(llama_context *p_ctx, const std::vector<llama_token> &p_tokens, int32_t p_pos, int32_t p_count, int32_t p_n_batch) {
+    int32_t offset = 0;
+    while (offset < p_count) {
+        const int32_t chunk = std::min(p_n_batch, p_count - offset);
+        std::vector<llama_pos> positions(chunk);
+        std::vector<int32_t> n_seq_id(chunk, 1);
+        std::vector<llama_seq_id> seq_ids(chunk, 0);
+        std::vector<llama_seq_id *> seq_id_ptrs(chunk);
+        std::vector<int8_t> logits(chunk, 0);
+        for (int32_t i = 0; i < chunk; i++) {
+            positions[i] = p_pos + offset + i;
+            seq_id_ptrs[i] = &seq_ids[i];
+        }
+        logits[chunk - 1] = 1;
+
+        llama_batch batch = {};
+        batch.n_tokens = chunk;
+        batch.token = const_cast<llama_token *>(p_tokens.data()) + offset;
+        batch.pos = positions.data();
+        batch.n_seq_id = n_seq_id.data();
+        batch.seq_id = seq_id_ptrs.data();
+        batch.logits = logits.data();
+        if (llama_decode(p_ctx, batch) != 0) {
+            return false;
+        }
+        offset += chunk;
+    }
+    return true;
+}
+
+class TuneRun {
+    llama_model *model = nullptr;
+    std::vector<llama_token> tokens;
+    int32_t n_ctx = 0;
+    int32_t prompt_tokens = 0;
+    int32_t generate_tokens = 0;
+    int32_t repeats = 1;
+
+    llama_context *context = nullptr;
+    int32_t context_n_batch = 0;
+    int32_t context_n_ubatch = 0;
+
+public:
+    Array measurements;
+
+    TuneRun(llama_model *p_model, int32_t p_prompt_tokens, int32_t p_generate_tokens, int32_t p_repeats) :
+            model(p_model),
+            prompt_tokens(p_prompt_tokens),
+            generate_tokens(p_generate_tokens),
+            repeats(p_repeats) {
+        n_ctx = prompt_tokens + generate_tokens + 16;
+        // Arbitrary but fixed ids: throughput does not depend on the text.
+        const int32_t n_vocab = std::max(1, llama_vocab_n_tokens(llama_model_get_vocab(model)));
+        uint32_t state = 0x9e3779b9u;
+        tokens.resize(static_cast<size_t>(n_ctx));
+        for (llama_token &token : tokens) {
+            state = state * 1664525u + 1013904223u;
+            token = static_cast<llama_token>((state >> 8) % static_cast<uint32_t>(n_vocab));
+        }
+    }
+
+    ~TuneRun() {
+        if (context != nullptr) {
+            llama_free(context);
+        }
+    }
+
+    bool prepare(const TuneConfig &p_config) {
+        if (context != nullptr && context_n_batch == p_config.n_batch && context_n_ubatch == p_config.n_ubatch) {
+            llama_set_n_threads(context, p_config.threads, p_config.threads_batch);
+            return true;
+        }
+        if (context != nullptr) {
+            llama_free(context);
+        }
+        llama_context_params cparams = llama_context_default_params();
+        cparams.n_ctx = static_cast<uint32_t>(n_ctx);
+        cparams.n_batch = static_cast<uint32_t>(p_config.n_batch);
+        cparams.n_ubatch = static_cast<uint32_t>(p_config.n_ubatch);
+        cparams.n_seq_max = 1;
+        cparams.n_threads = p_config.threads;
+        cparams.n_threads_batch = p_config.threads_batch;
+        cparams.no_perf = true;
+        context = llama_init_from_model(model, cparams);
+        context_n_batch = p_config.n_batch;
+        context_n_ubatch = p_config.n_ubatch;
+        return context != nullptr;
+    }
+
+    // Best of `repeats` runs after one warm-up; returns tokens per second, or
+    // a negative value when the configuration failed.
+    double measure(const char *p_stage, const TuneConfig &p_config, bool p_generation) {
+        if (!prepare(p_config)) {
+            return -1.0;
+        }
+
+        const int32_t context_tokens = p_generation ? 16 : 0;
+        const int32_t n_tokens = p_generation ? generate_tokens : prompt_tokens;
+        double best = -1.0;
+        for (int32_t run = 0; run <= repeats; run++) {
+            llama_memory_clear(llama_get_memory(context), true);
+            if (context_tokens > 0 && !_decode(context, tokens, 0, context_tokens, p_config.n_batch)) {
+                return -1.0;
+            }
+
+            const uint64_t start = Time::get_singleton()->get_ticks_usec();
+            bool ok = true;
+            if (p_generation) {
+                for (int32_t i = 0; i < n_tokens && ok; i++) {
+                    const std::vector<llama_token> next = { tokens[context_tokens + i] };
+                    ok = _decode(context, next, context_tokens + i, 1, 1);
+                }
+            } else {
+                ok = _decode(context, tokens, 0, n_tokens, p_config.n_batch);
+            }
+            const uint64_t elapsed = std::max<uint64_t>(1, Time::get_singleton()->get_ticks_usec() - start);
+            if (!ok) {
+                return -1.0;
+            }
+            if (run > 0) {
+                best = std::max(best, static_cast<double>(n_tokens) * 1000000.0 / static_cast<double>(elapsed));
+            }
+        }
+
+        Dictionary entry;
+        entry["stage"] = p_stage;
+        entry["n_batch"] = p_config.n_batch;
+        entry["n_ubatch"] = p_config.n_ubatch;
+        entry["threads"] = p_config.threads;
+        entry["threads_batch"] = p_config.threads_batch;
+        entry["tokens_per_second"] = best;
+        measurements.append(entry);
+        return best;
+    }
+};
+
+} // namespace
+
+void LlamaAutotuner::_bind_methods() {
+    ClassDB::bind_static_method("LlamaAutotuner", D_METHOD("run", "model", "options"), &LlamaAutotuner::run, DEFVAL(Dictionary()));
+    ClassDB::bind_static_method("LlamaAutotuner", D_METHOD("lookup", "model"), &LlamaAutotuner::lookup);
+    ClassDB::bind_static_method("LlamaAutotuner", D_METHOD("clear", "model"), &LlamaAutotuner::clear);
+    ClassDB::bind_static_method("LlamaAutotuner", D_METHOD("get_tuning_key", "model"), &LlamaAutotuner::get_tuning_key);
+}
+
+String LlamaAutotuner::get_tuning_key(const Ref<LlamaModel> &p_model) {
+    if (p_model.is_null() || !p_model->is_loaded()) {
+        return String();
+    }
+    // The model part ignores the file path: a moved or reinstalled copy of
+    // the same weights keeps its tuning.
+    const llama_model *model = p_model->get_native_model();
+    char desc[256] = {};
+    llama_model_desc(model, desc, sizeof(desc));
+    const String cpu = vformat("%s|%d", OS::get_singleton()->get_processor_name(), OS::get_singleton()->get_processor_count());
+    const String weights = vformat("%s|%d|%d", String::utf8(desc), static_cast<int64_t>(llama_model_size(model)), static_cast<int64_t>(llama_model_n_params(model)));
+    return (cpu + "|" + weights).md5_text();
+}
+
+Dictionary LlamaAutotuner::run(const Ref<LlamaModel> &p_model, const Dictionary &p_options) {
+    Dictionary result;
+    if (p_model.is_null() || !p_model->is_loaded()) {
+        UtilityFunctions::push_error("godot_llama: autotune needs a loaded model");
+        return result;
+    }
+
+    const int32_t prompt_tokens = std::max<int32_t>(32, static_cast<int32_t>(int64_t(p_options.get("prompt_tokens", 1024))));
+    const int32_t generate_tokens = std::max<int32_t>(4, static_cast<int32_t>(int64_t(p_options.get("generate_tokens", 32))));
+    const int32_t repeats = std::max<int32_t>(1, static_cast<int32_t>(int64_t(p_options.get("repeats", 2))));
+    const int32_t cores = std::max(1, OS::get_singleton()->get_processor_count());
+    // Hybrid CPUs often peak at the performance-core count, which is well
+    // below the logical processor count; sample the whole range.
+    const std::vector<int32_t> threads = _int_candidates(p_options, "threads", { std::max(1, cores / 4), std::max(1, cores / 2), std::max(1, cores * 3 / 4), std::max(1, cores - 1), cores });
+    const std::vector<int32_t> ubatches = _int_candidates(p_options, "n_ubatch", { 128, 256, 512 });
+    const std::vector<int32_t> batches = _int_candidates(p_options, "n_batch", { 256, 512, 1024, 2048 });
+    if (threads.empty() || ubatches.empty() || batches.empty()) {
+        UtilityFunctions::push_error("godot_llama: autotune candidate lists must contain positive values");
+        return result;
+    }
+
+    TuneRun tune(const_cast<llama_model *>(p_model->get_native_model()), prompt_tokens, generate_tokens, repeats);
+    TuneConfig best;
+    best.threads = std::max(1, cores - 1);
+    best.threads_batch = best.threads;
+
+    // One knob at a time: generation threads, then prompt threads, then the
+    // physical batch, then the logical batch. The knobs barely interact, and
+    // a full grid would take minutes on small machines.
+    double best_tg = -1.0;
+    for (int32_t value : threads) {
+        TuneConfig config = best;
+        config.threads = value;
+        const double speed = tune.measure("threads", config, true);
+        if (speed > best_tg) {
+            best_tg = speed;
+            best.threads = value;
+        }
+    }
+
+    double best_pp = -1.0;
+    for (int32_t value : threads) {
+        TuneConfig config = best;
+        config.threads_batch = value;
+        const double speed = tune.measure("threads_batch", config, false);
+        if (speed > best_pp) {
+            best_pp = speed;
+            best.threads_batch = value;
+        }
+    }
+
+    best_pp = -1.0;
+    for (int32_t value : ubatches) {
+        TuneConfig config = best;
+        config.n_ubatch = value;
+        config.n_batch = std::max(best.n_batch, value);
+        const double speed = tune.measure("n_ubatch", config, false);
+        if (speed > best_pp) {
+            best_pp = speed;
+            best.n_ubatch = value;
+            best.n_batch = config.n_batch;
+        }
+    }
+
+    // When no n_batch candidate fits the test prompt, the stage keeps the
+    // current n_batch and its n_ubatch-stage speed.
+    const double ubatch_pp = best_pp;
+    best_pp = -1.0;
+    for (int32_t value : batches) {
+        // llama.cpp clamps n_batch to n_ctx, so batches beyond the test prompt
+        // cannot be told apart.
+        if (value < best.n_ubatch || value > prompt_tokens) {
+            continue;
+        }
+        TuneConfig config = best;
+        config.n_batch = value;
+        const double speed = tune.measure("n_batch", config, false);
+        // Larger logical batches also mean longer uninterruptible decodes, so
+        // only switch for a clear win.
+        if (speed > 0.0 && (best_pp < 0.0 || speed > best_pp * 1.03)) {
+            best_pp = speed;
+            best.n_batch = value;
+        }
+    }
+    if (best_pp < 0.0) {
+        best_pp = ubatch_pp;
+    }
+
+    if (best_tg < 0.0 || best_pp < 0.0) {
+        UtilityFunctions::push_error("godot_llama: autotune could not run the model with any candidate configuration");
+        return result;
+    }
+
+    result["n_batch"] = best.n_batch;
+    result["n_ubatch"] = best.n_ubatch;
+    result["threads"] = best.threads;
+    result["threads_batch"] = best.threads_batch;
+    result["pp_tokens_per_second"] = best_pp;
+    result["tg_tokens_per_second"] = best_tg;
+    result["cpu"] = OS::get_singleton()->get_processor_name();
+    result["key"] = get_tuning_key(p_model);
+    result["measurements"] = tune.measurements;
+
+    if (bool(p_options.get("save", true))) {
+        Ref<ConfigFile> config;
+        config.instantiate();
+        config->load(AUTOTUNE_PATH);
+        const String section = result["key"];
+        for (const char *key : AUTOTUNE_KEYS) {
+            config->set_value(section, key, result[key]);
+        }
+        config->set_value(section, "pp_tokens_per_second", best_pp);
+        config->set_value(section, "tg_tokens_per_second", best_tg);
+        config->set_value(section, "cpu", result["cpu"]);
+        config->set_value(section, "model", p_model->get_model_path().get_file());
+        config->set_value(section, "tuned_at", Time::get_singleton()->get_datetime_string_from_system());
+        const Error err = config->save(AUTOTUNE_PATH);
+        if (err != OK) {
+            UtilityFunctions::push_error(vformat("godot_llama: failed to save autotune results to %s (error %d)", AUTOTUNE_PATH, static_cast<int64_t>(err)));
+        }
+    }
+    return result;
+}
+
+Dictionary LlamaAutotuner::lookup(const Ref<LlamaModel> &p_model) {
+    Dictionary tuned;
+    const String section = get_tuning_key(p_model);
+    if (section.is_empty()) {
+        return tuned;
+    }
+    Ref<ConfigFile> config;
+    config.instantiate();
+    if (config->load(AUTOTUNE_PATH) != OK || !config->has_section(section)) {
+        return tuned;
+    }
+    for (const char *key : AUTOTUNE_KEYS) {
+        const int64_t value = config->get_value(section, key, 0);
+        if (value > 0) {
+            tuned[key] = value;
+        }
+    }
+    return tuned;
+}
+
+bool LlamaAutotuner::clear(const Ref<LlamaModel> &p_model) {
+    Ref<ConfigFile> config;
+    config.instantiate();
+    if (config->load(AUTOTUNE_PATH) != OK) {
+        return false;
+    }
+    if (p_model.is_null()) {
+        const PackedStringArray sections = config->get_sections();
+        for (int64_t i = 0; i < sections.size(); i++) {
+            config->erase_section(sections[i]);
+        }
+    } else {
+        const String section = get_tuning_key(p_model);
+        if (!config->has_section(section)) {
+            return false;
+        }
+        config->erase_section(section);
+    }
+    return config->save(AUTOTUNE_PATH) == OK;
+}
@@ -0,0 +1,30 @@
+#ifndef GODOT_LLAMA_AUTOTUNER_H
+#define GODOT_LLAMA_AUTOTUNER_H
+
+#include "llama_model.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+namespace godot {
+
+// Benchmarks thread counts and batch sizes for one model on this machine and
+// remembers the fastest settings in user://, keyed by CPU and model.
+// LlamaContext::create picks them up for every param the caller leaves out.
+class LlamaAutotuner : public RefCounted {
+    GDCLASS(LlamaAutotuner, RefCounted);
+
+protected:
+    static void _bind_methods();
+
+public:
+    static Dictionary run(const Ref<LlamaModel> &p_model, const Dictionary &p_options = Dictionary());
+    static Dictionary lookup(const Ref<LlamaModel> &p_model);
+    static bool clear(const Ref<LlamaModel> &p_model);
+    static String get_tuning_key(const Ref<LlamaModel> &p_model);
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,130 @@
+#include "llama_backend.h"
+
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/godot.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <ggml-backend.h>
+
+using namespace godot;
+
+namespace {
+
+// Highest first; the CPU backend reports every ISA extension it was compiled
+// for, so the first hit names the variant that ggml picked.
+const char *const BACKEND_CPU_LEVELS[] = {
+    "AMX_INT8",
+    "AVX512_BF16",
+    "AVX512_VNNI",
+    "AVX512",
+    "AVX_VNNI",
+    "AVX2",
+    "AVX",
+    "SSE3",
+    "SME",
+    "SVE",
+    "MATMUL_INT8",
+    "DOTPROD",
+    "NEON",
+};
+
+String backend_module_dir;
+
+const char *_backend_device_type_name(enum ggml_backend_dev_type p_type) {
+    switch (p_type) {
+        case GGML_BACKEND_DEVICE_TYPE_CPU:
+            return "cpu";
+        case GGML_BACKEND_DEVICE_TYPE_GPU:
+            return "gpu";
+        case GGML_BACKEND_DEVICE_TYPE_IGPU:
+            return "igpu";
+        case GGML_BACKEND_DEVICE_TYPE_ACCEL:
+            return "accel";
+    }
+    return "unknown";
+}
+
+Dictionary _backend_features(ggml_backend_reg_t p_reg) {
+    Dictionary features;
+    const ggml_backend_get_features_t get_features = reinterpret_cast<ggml_backend_get_features_t>(ggml_backend_reg_get_proc_address(p_reg, "ggml_backend_get_features"));
+    if (get_features == nullptr) {
+        return features;
+    }
+    for (const ggml_backend_feature *feature = get_features(p_reg); feature != nullptr && feature->name != nullptr; feature++) {
+        features[String::utf8(feature->name)] = String::utf8(feature->value);
+    }
+    return features;
+}
+
+String _backend_cpu_variant(const Dictionary &p_features) {
+    for (const char *level : BACKEND_CPU_LEVELS) {
+        if (p_features.has(level)) {
+            return String(level).to_lower();
+        }
+    }
+    return "baseline";
+}
+
+} // namespace
+
+void LlamaBackend::load_modules() {
+#ifdef GODOT_LLAMA_BACKEND_DL
+    backend_module_dir = OS::get_singleton()->get_environment("GODOT_LLAMA_BACKEND_PATH");
+    if (backend_module_dir.is_empty()) {
+        String library_path;
+        internal::gdextension_interface_get_library_path(internal::library, library_path._native_ptr());
+        backend_module_dir = library_path.get_base_dir();
+    }
+    ggml_backend_load_all_from_path(backend_module_dir.utf8().get_data());
+
+    if (ggml_backend_reg_by_name("CPU") == nullptr) {
+        UtilityFunctions::push_error(vformat("godot_llama: No ggml CPU backend could be loaded from \"%s\". Ship the ggml-cpu-* modules next to the extension library.", backend_module_dir));
+        return;
+    }
+    UtilityFunctions::print_verbose(vformat("godot_llama: CPU backend variant %s", get_info()["cpu_variant"]));
+#endif
+}
+
+String LlamaBackend::get_module_dir() {
+    return backend_module_dir;
+}
+
+Dictionary LlamaBackend::get_info() {
+    Dictionary info;
+#ifdef GODOT_LLAMA_BACKEND_DL
+    info["dynamic_loading"] = true;
+#else
+    info["dynamic_loading"] = false;
+#endif
+    info["module_dir"] = backend_module_dir;
+
+    Array backends;
+    for (size_t i = 0; i < ggml_backend_reg_count(); i++) {
+        backends.push_back(String::utf8(ggml_backend_reg_name(ggml_backend_reg_get(i))));
+    }
+    info["backends"] = backends;
+
+    Array devices;
+    for (size_t i = 0; i < ggml_backend_dev_count(); i++) {
+        ggml_backend_dev_t device = ggml_backend_dev_get(i);
+        size_t memory_free = 0;
+        size_t memory_total = 0;
+        ggml_backend_dev_memory(device, &memory_free, &memory_total);
+        Dictionary entry;
+        entry["name"] = String::utf8(ggml_backend_dev_name(device));
+        entry["description"] = String::utf8(ggml_backend_dev_description(device));
+        entry["type"] = _backend_device_type_name(ggml_backend_dev_type(device));
+        entry["backend"] = String::utf8(ggml_backend_reg_name(ggml_backend_dev_backend_reg(device)));
+        entry["memory_free"] = static_cast<int64_t>(memory_free);
+        entry["memory_total"] = static_cast<int64_t>(memory_total);
+        devices.push_back(entry);
+    }
+    info["devices"] = devices;
+
+    ggml_backend_reg_t cpu = ggml_backend_reg_by_name("CPU");
+    const Dictionary cpu_features = cpu != nullptr ? _backend_features(cpu) : Dictionary();
+    info["cpu_features"] = cpu_features;
+    info["cpu_variant"] = cpu != nullptr ? _backend_cpu_variant(cpu_features) : String();
+    return info;
+}
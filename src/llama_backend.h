@@ -0,0 +1,22 @@
+#ifndef GODOT_LLAMA_BACKEND_H
+#define GODOT_LLAMA_BACKEND_H
+
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+namespace godot {
+
+// ggml backend discovery. Builds with GODOT_LLAMA_BACKEND_DL link llama.cpp
+// without a CPU backend and load ggml-cpu-* modules at startup instead;
+// ggml scores every variant against the running CPU and registers the best.
+class LlamaBackend {
+public:
+    // Called once from module initialization, before any model loads.
+    static void load_modules();
+    static String get_module_dir();
+    static Dictionary get_info();
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,342 @@
+#include "llama_batch_scheduler.h"
+
+#include <godot_cpp/classes/time.hpp>
+
+#include <llama.h>
+#include <algorithm>
+
+using namespace godot;
+
+static uint64_t _batch_scheduler_now_usec() {
+    return Time::get_singleton()->get_ticks_usec();
+}
+
+Dictionary LlamaBatchScheduler::Result::to_dictionary() const {
+    Dictionary result;
+    result["id"] = id;
+    result["index"] = index;
+    result["text"] = text;
+    result["stop_reason"] = stop_reason;
+    result["n_prompt_tokens"] = n_prompt_tokens;
+    result["n_tokens"] = static_cast<int64_t>(tokens.size());
+    result["queue_ms"] = static_cast<double>(queue_usec) / 1000.0;
+    result["first_token_ms"] = static_cast<double>(first_token_usec) / 1000.0;
+    result["total_ms"] = static_cast<double>(total_usec) / 1000.0;
+    const double generate_sec = static_cast<double>(total_usec - std::min(total_usec, first_token_usec)) / 1000000.0;
+    result["tokens_per_second"] = tokens.size() > 1 && generate_sec > 0.0 ? static_cast<double>(tokens.size() - 1) / generate_sec : 0.0;
+    if (!error.is_empty()) {
+        result["error"] = error;
+    }
+    return result;
+}
+
+LlamaBatchScheduler::~LlamaBatchScheduler() {
+    detach();
+}
+
+void LlamaBatchScheduler::attach(struct llama_context *p_context, const struct llama_vocab *p_vocab) {
+    detach();
+    native_context = p_context;
+    vocab = p_vocab;
+    if (native_context == nullptr) {
+        return;
+    }
+
+    slots.assign(llama_n_seq_max(native_context), Slot());
+    batch_capacity = std::max<int32_t>(1, static_cast<int32_t>(llama_n_batch(native_context)));
+    batch_tokens.resize(batch_capacity);
+    batch_positions.resize(batch_capacity);
+    batch_seq_ids.resize(batch_capacity);
+    batch_logits.resize(batch_capacity);
+}
+
+void LlamaBatchScheduler::detach() {
+    for (Slot &slot : slots) {
+        if (slot.sampler != nullptr) {
+            llama_sampler_free(slot.sampler);
+        }
+        if (slot.active && native_context != nullptr) {
+            llama_memory_seq_rm(llama_get_memory(native_context), static_cast<llama_seq_id>(&slot - slots.data()), -1, -1);
+        }
+    }
+    slots.clear();
+    queue.clear();
+    native_context = nullptr;
+    vocab = nullptr;
+    _update_metrics();
+}
+
+void LlamaBatchScheduler::set_token_callback(const TokenCallback &p_callback) {
+    token_callback = p_callback;
+}
+
+void LlamaBatchScheduler::enqueue(Request &&p_request) {
+    p_request.enqueued_usec = _batch_scheduler_now_usec();
+    queue.push_back(std::move(p_request));
+    _update_metrics();
+}
+
+void LlamaBatchScheduler::_update_metrics() {
+    int64_t kv_cells = 0;
+    for (const Slot &slot : slots) {
+        kv_cells += slot.active ? slot.n_past : 0;
+    }
+    metric_active.set(get_active_count());
+    metric_queued.set(static_cast<int64_t>(queue.size()));
+    metric_kv_cells.set(kv_cells);
+}
+
+bool LlamaBatchScheduler::has_work() const {
+    return !queue.empty() || get_active_count() > 0;
+}
+
+int32_t LlamaBatchScheduler::get_active_count() const {
+    int32_t count = 0;
+    for (const Slot &slot : slots) {
+        if (slot.active) {
+            count++;
+        }
+    }
+    return count;
+}
+
+int32_t LlamaBatchScheduler::get_queued_count() const {
+    return static_cast<int32_t>(queue.size());
+}
+
+int32_t LlamaBatchScheduler::get_slot_count() const {
+    return static_cast<int32_t>(slots.size());
+}
+
+String LlamaBatchScheduler::_token_to_piece(int32_t p_token) const {
+    std::vector<char> piece(64, '\0');
+    int32_t rc = llama_token_to_piece(vocab, static_cast<llama_token>(p_token), piece.data(), static_cast<int32_t>(piece.size()), 0, true);
+    if (rc < 0) {
+        piece.resize(-rc + 1);
+        rc = llama_token_to_piece(vocab, static_cast<llama_token>(p_token), piece.data(), static_cast<int32_t>(piece.size()), 0, true);
+    }
+    if (rc <= 0) {
+        return "";
+    }
+    return String::utf8(piece.data(), rc);
+}
+
+void LlamaBatchScheduler::_admit() {
+    const uint64_t now = _batch_scheduler_now_usec();
+    llama_memory_t memory = llama_get_memory(native_context);
+    for (size_t i = 0; i < slots.size() && !queue.empty(); i++) {
+        Slot &slot = slots[i];
+        if (slot.active) {
+            continue;
+        }
+
+        slot = Slot();
+        slot.request = std::move(queue.front());
+        queue.pop_front();
+        slot.active = true;
+        slot.filter_state = slot.request.params.create_phrase_filter_state(vocab);
+        slot.sampler = slot.request.params.create_sampler_chain(slot.filter_state.get());
+        slot.start_usec = now;
+        llama_memory_seq_rm(memory, static_cast<llama_seq_id>(i), -1, -1);
+    }
+}
+
+void LlamaBatchScheduler::_finish(Slot &r_slot, const String &p_stop_reason, std::vector<Result> &r_finished, const String &p_error) {
+    const uint64_t now = _batch_scheduler_now_usec();
+    Result result;
+    result.id = r_slot.request.id;
+    result.index = r_slot.request.index;
+    result.text = r_slot.text;
+    result.tokens = std::move(r_slot.tokens);
+    result.n_prompt_tokens = static_cast<int32_t>(r_slot.request.prompt_tokens.size());
+    result.stop_reason = p_stop_reason;
+    result.error = p_error;
+    if (r_slot.start_usec != 0) {
+        result.queue_usec = r_slot.start_usec - r_slot.request.enqueued_usec;
+        result.first_token_usec = r_slot.first_token_usec != 0 ? r_slot.first_token_usec - r_slot.start_usec : 0;
+        result.total_usec = now - r_slot.start_usec;
+    } else {
+        result.queue_usec = now - r_slot.request.enqueued_usec;
+    }
+    r_finished.push_back(std::move(result));
+
+    if (r_slot.sampler != nullptr) {
+        llama_sampler_free(r_slot.sampler);
+    }
+    if (r_slot.active) {
+        llama_memory_seq_rm(llama_get_memory(native_context), static_cast<llama_seq_id>(&r_slot - slots.data()), -1, -1);
+    }
+    r_slot = Slot();
+}
+
+bool LlamaBatchScheduler::step(std::vector<Result> &r_finished, String &r_error) {
+    if (native_context == nullptr) {
+        r_error = "Batch scheduler is not attached to a context.";
+        return false;
+    }
+
+    _admit();
+
+    const int32_t n_ctx_seq = static_cast<int32_t>(llama_n_ctx_seq(native_context));
+    int32_t n_tokens = 0;
+
+    // Generating requests first: one token each keeps their latency flat
+    // while prompts of new requests soak up the rest of the batch.
+    for (size_t i = 0; i < slots.size(); i++) {
+        Slot &slot = slots[i];
+        slot.logits_index = -1;
+        if (!slot.active || slot.pending_token < 0 || n_tokens >= batch_capacity) {
+            continue;
+        }
+        batch_tokens[n_tokens] = slot.pending_token;
+        batch_positions[n_tokens] = slot.n_past++;
+        batch_seq_ids[n_tokens] = static_cast<int32_t>(i);
+        batch_logits[n_tokens] = 1;
+        slot.logits_index = n_tokens;
+        slot.pending_token = -1;
+        n_tokens++;
+    }
+
+    for (size_t i = 0; i < slots.size() && n_tokens < batch_capacity; i++) {
+        Slot &slot = slots[i];
+        const std::vector<int32_t> &prompt = slot.request.prompt_tokens;
+        if (slot.active && prompt.empty()) {
+            _finish(slot, "error", r_finished, "Prompt is empty.");
+            continue;
+        }
+        if (!slot.active || slot.prompt_pos >= prompt.size() || slot.logits_index >= 0) {
+            continue;
+        }
+        if (prompt.size() + 1 > static_cast<size_t>(n_ctx_seq)) {
+            _finish(slot, "error", r_finished, vformat("Prompt of %d tokens does not fit the %d-token sequence.", static_cast<int64_t>(prompt.size()), n_ctx_seq));
+            continue;
+        }
+
+        const size_t chunk = std::min(prompt.size() - slot.prompt_pos, static_cast<size_t>(batch_capacity - n_tokens));
+        for (size_t j = 0; j < chunk; j++) {
+            batch_tokens[n_tokens] = prompt[slot.prompt_pos + j];
+            batch_positions[n_tokens] = slot.n_past++;
+            batch_seq_ids[n_tokens] = static_cast<int32_t>(i);
+            batch_logits[n_tokens] = 0;
+            n_tokens++;
+        }
+        slot.prompt_pos += chunk;
+        if (slot.prompt_pos == prompt.size()) {
+            batch_logits[n_tokens - 1] = 1;
+            slot.logits_index = n_tokens - 1;
+        }
+    }
+
+    if (n_tokens == 0) {
+        _update_metrics();
+        return false;
+    }
+
+    std::vector<int32_t> n_seq_id(n_tokens, 1);
+    std::vector<llama_seq_id *> seq_id_ptrs(n_tokens);
+    for (int32_t i = 0; i < n_tokens; i++) {
+        seq_id_ptrs[i] = &batch_seq_ids[i];
+    }
+
+    llama_batch batch = {};
+    batch.n_tokens = n_tokens;
+    batch.token = batch_tokens.data();
+    batch.pos = batch_positions.data();
+    batch.n_seq_id = n_seq_id.data();
+    batch.seq_id = seq_id_ptrs.data();
+    batch.logits = batch_logits.data();
+
+    const int32_t rc = llama_decode(native_context, batch);
+    steps++;
+    if (rc != 0) {
+        r_error = vformat("llama_decode rc=%d batch=%d active=%d", rc, n_tokens, get_active_count());
+        for (Slot &slot : slots) {
+            if (slot.active) {
+                _finish(slot, "error", r_finished, r_error);
+            }
+        }
+        _update_metrics();
+        return false;
+    }
+    decoded_tokens += n_tokens;
+
+    const uint64_t now = _batch_scheduler_now_usec();
+    for (Slot &slot : slots) {
+        if (!slot.active || slot.logits_index < 0) {
+            continue;
+        }
+
+        const llama_token token = llama_sampler_sample(slot.sampler, native_context, slot.logits_index);
+        if (slot.first_token_usec == 0) {
+            slot.first_token_usec = now;
+            LlamaMetrics::record_first_token(now - slot.request.enqueued_usec);
+        }
+        if (llama_vocab_is_eog(vocab, token)) {
+            _finish(slot, "eos", r_finished);
+            continue;
+        }
+
+        slot.text += _token_to_piece(token);
+        const PackedStringArray &stop_sequences = slot.request.params.stop_sequences;
+        int64_t first_stop_pos = -1;
+        for (int i = 0; i < stop_sequences.size(); i++) {
+            const int64_t stop_pos = slot.text.find(stop_sequences[i]);
+            if (stop_pos >= 0 && (first_stop_pos < 0 || stop_pos < first_stop_pos)) {
+                first_stop_pos = stop_pos;
+            }
+        }
+        if (first_stop_pos >= 0) {
+            slot.text = slot.text.substr(0, first_stop_pos);
+            _finish(slot, "stop", r_finished);
+            continue;
+        }
+
+        llama_sampler_accept(slot.sampler, token);
+        LlamaMetrics::add_generated_tokens(1);
+        if (slot.filter_state) {
+            slot.filter_state->push(token);
+        }
+        slot.tokens.push_back(token);
+        if (token_callback) {
+            token_callback(slot.request, token, slot.text);
+        }
+        if (static_cast<int32_t>(slot.tokens.size()) >= slot.request.params.max_tokens || slot.n_past + 1 >= n_ctx_seq) {
+            _finish(slot, "length", r_finished);
+            continue;
+        }
+        slot.pending_token = token;
+    }
+    _update_metrics();
+    return true;
+}
+
+void LlamaBatchScheduler::cancel_all(std::vector<Result> &r_finished) {
+    cancel_where([](const Request &) { return true; }, r_finished);
+}
+
+void LlamaBatchScheduler::cancel_where(const std::function<bool(const Request &)> &p_predicate, std::vector<Result> &r_finished) {
+    for (Slot &slot : slots) {
+        if (slot.active && p_predicate(slot.request)) {
+            _finish(slot, "cancelled", r_finished);
+        }
+    }
+    std::deque<Request> kept;
+    while (!queue.empty()) {
+        if (p_predicate(queue.front())) {
+            Slot pending;
+            pending.request = std::move(queue.front());
+            _finish(pending, "cancelled", r_finished);
+        } else {
+            kept.push_back(std::move(queue.front()));
+        }
+        queue.pop_front();
+    }
+    queue.swap(kept);
+    _update_metrics();
+}
+
+void LlamaBatchScheduler::append_stats(Dictionary &r_stats) const {
+    r_stats["batch_steps"] = steps;
+    r_stats["batch_decoded_tokens"] = decoded_tokens;
+    r_stats["batch_avg_tokens_per_step"] = steps > 0 ? static_cast<double>(decoded_tokens) / static_cast<double>(steps) : 0.0;
+}
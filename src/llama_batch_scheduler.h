@@ -0,0 +1,119 @@
+#ifndef GODOT_LLAMA_BATCH_SCHEDULER_H
+#define GODOT_LLAMA_BATCH_SCHEDULER_H
+
+#include "llama_generation_params.h"
+#include "llama_metrics.h"
+
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+#include <godot_cpp/variant/variant.hpp>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct llama_context;
+struct llama_sampler;
+struct llama_vocab;
+
+namespace godot {
+
+// Continuous batching over the sequences of one llama_context. Every step
+// decodes a single batch holding the next token of each generating request
+// plus as many prompt tokens of newly admitted requests as fit in n_batch;
+// a finished request frees its sequence for the next queued one right away.
+class LlamaBatchScheduler {
+public:
+    struct Request {
+        Variant id;
+        int64_t index = 0;
+        std::vector<int32_t> prompt_tokens;
+        LlamaGenerationParams params;
+        uint64_t enqueued_usec = 0;
+    };
+
+    struct Result {
+        Variant id;
+        int64_t index = 0;
+        String text;
+        std::vector<int32_t> tokens;
+        int32_t n_prompt_tokens = 0;
+        String stop_reason;
+        String error;
+        uint64_t queue_usec = 0;
+        uint64_t first_token_usec = 0;
+        uint64_t total_usec = 0;
+
+        Dictionary to_dictionary() const;
+    };
+
+    // Called for every accepted token; used for streaming front ends.
+    typedef std::function<void(const Request &, int32_t, const String &)> TokenCallback;
+
+private:
+    struct Slot {
+        bool active = false;
+        Request request;
+        struct llama_sampler *sampler = nullptr;
+        // Blocking and biases only; rewinding needs the single-sequence loop.
+        std::shared_ptr<LlamaPhraseFilterState> filter_state;
+        size_t prompt_pos = 0;
+        int32_t n_past = 0;
+        int32_t pending_token = -1;
+        int32_t logits_index = -1;
+        String text;
+        std::vector<int32_t> tokens;
+        uint64_t start_usec = 0;
+        uint64_t first_token_usec = 0;
+    };
+
+    struct llama_context *native_context = nullptr;
+    const struct llama_vocab *vocab = nullptr;
+    int32_t batch_capacity = 0;
+    std::vector<int32_t> batch_tokens;
+    std::vector<int32_t> batch_positions;
+    std::vector<int32_t> batch_seq_ids;
+    std::vector<int8_t> batch_logits;
+    std::vector<Slot> slots;
+    std::deque<Request> queue;
+    TokenCallback token_callback;
+
+    int64_t steps = 0;
+    int64_t decoded_tokens = 0;
+    LlamaMetrics::Contribution metric_active{ LlamaMetrics::GAUGE_ACTIVE_GENERATIONS };
+    LlamaMetrics::Contribution metric_queued{ LlamaMetrics::GAUGE_QUEUED_REQUESTS };
+    LlamaMetrics::Contribution metric_kv_cells{ LlamaMetrics::GAUGE_KV_CELLS_USED };
+
+    void _admit();
+    void _update_metrics();
+    void _finish(Slot &r_slot, const String &p_stop_reason, std::vector<Result> &r_finished, const String &p_error = String());
+    String _token_to_piece(int32_t p_token) const;
+
+public:
+    ~LlamaBatchScheduler();
+
+    void attach(struct llama_context *p_context, const struct llama_vocab *p_vocab);
+    void detach();
+    void set_token_callback(const TokenCallback &p_callback);
+
+    void enqueue(Request &&p_request);
+    bool has_work() const;
+    int32_t get_active_count() const;
+    int32_t get_queued_count() const;
+    int32_t get_slot_count() const;
+
+    // Decodes one batch. Returns false when there was nothing to do or the
+    // decode failed; failures finish every active request with an error.
+    bool step(std::vector<Result> &r_finished, String &r_error);
+    void cancel_all(std::vector<Result> &r_finished);
+    // Finishes the active and queued requests matching p_predicate as cancelled.
+    void cancel_where(const std::function<bool(const Request &)> &p_predicate, std::vector<Result> &r_finished);
+
+    void append_stats(Dictionary &r_stats) const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,510 @@
+#include "llama_chat_session.h"
+
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+
+using namespace godot;
+
+static void _append_tokens(std::vector<int32_t> &r_tokens, const PackedInt32Array &p_tokens) {
+    r_tokens.reserve(r_tokens.size() + static_cast<size_t>(p_tokens.size()));
+    for (int i = 0; i < p_tokens.size(); i++) {
+        r_tokens.push_back(p_tokens[i]);
+    }
+}
+
+void LlamaChatSession::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_context", "context"), &LlamaChatSession::set_context);
+    ClassDB::bind_method(D_METHOD("get_context"), &LlamaChatSession::get_context);
+    ClassDB::bind_method(D_METHOD("set_conversation", "conversation"), &LlamaChatSession::set_conversation);
+    ClassDB::bind_method(D_METHOD("get_conversation"), &LlamaChatSession::get_conversation);
+    ClassDB::bind_method(D_METHOD("set_chat_template", "chat_template"), &LlamaChatSession::set_chat_template);
+    ClassDB::bind_method(D_METHOD("get_chat_template"), &LlamaChatSession::get_chat_template);
+    ClassDB::bind_method(D_METHOD("set_max_history_messages", "max_history_messages"), &LlamaChatSession::set_max_history_messages);
+    ClassDB::bind_method(D_METHOD("get_max_history_messages"), &LlamaChatSession::get_max_history_messages);
+    ClassDB::bind_method(D_METHOD("add_message", "role", "content"), &LlamaChatSession::add_message);
+    ClassDB::bind_method(D_METHOD("set_message", "index", "content"), &LlamaChatSession::set_message);
+    ClassDB::bind_method(D_METHOD("remove_message", "index"), &LlamaChatSession::remove_message);
+    ClassDB::bind_method(D_METHOD("trim_history", "max_messages"), &LlamaChatSession::trim_history);
+    ClassDB::bind_method(D_METHOD("get_messages"), &LlamaChatSession::get_messages);
+    ClassDB::bind_method(D_METHOD("get_message_count"), &LlamaChatSession::get_message_count);
+    ClassDB::bind_method(D_METHOD("clear"), &LlamaChatSession::clear);
+    ClassDB::bind_method(D_METHOD("generate", "max_tokens", "params"), &LlamaChatSession::generate, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("generate_stream", "max_tokens", "params"), &LlamaChatSession::generate_stream, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("render_prompt", "add_assistant"), &LlamaChatSession::render_prompt, DEFVAL(true));
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaChatSession::get_stats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "context", PROPERTY_HINT_RESOURCE_TYPE, "LlamaContext"), "set_context", "get_context");
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "conversation"), "set_conversation", "get_conversation");
+    ADD_PROPERTY(PropertyInfo(Variant::STRING, "chat_template"), "set_chat_template", "get_chat_template");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_history_messages"), "set_max_history_messages", "get_max_history_messages");
+}
+
+bool LlamaChatSession::_is_ready() const {
+    return context.is_valid() && context->is_initialized() && context->get_model().is_valid() && context->get_model()->is_loaded();
+}
+
+String LlamaChatSession::_get_conversation() const {
+    if (!conversation.is_empty()) {
+        return conversation;
+    }
+    return vformat("chat_%d", static_cast<int64_t>(get_instance_id()));
+}
+
+bool LlamaChatSession::_render(size_t p_begin, size_t p_end, bool p_add_assistant, String &r_text) const {
+    r_text = "";
+    if (p_begin == p_end && !p_add_assistant) {
+        return true;
+    }
+
+    const char *model_template = llama_model_chat_template(context->get_model()->get_native_model(), nullptr);
+    const CharString template_utf8 = chat_template.is_empty() ? CharString() : chat_template.utf8();
+    const char *tmpl = !chat_template.is_empty() ? template_utf8.get_data() : (model_template != nullptr ? model_template : "chatml");
+
+    std::vector<llama_chat_message> chat;
+    chat.reserve(p_end - p_begin);
+    size_t text_size = 0;
+    for (size_t i = p_begin; i < p_end; i++) {
+        llama_chat_message message;
+        message.role = messages[i].role_utf8.get_data();
+        message.content = messages[i].content_utf8.get_data();
+        chat.push_back(message);
+        text_size += static_cast<size_t>(messages[i].content_utf8.length());
+    }
+
+    template_renders++;
+    std::vector<char> buffer(text_size * 2 + 256, '\0');
+    int32_t length = llama_chat_apply_template(tmpl, chat.data(), chat.size(), p_add_assistant, buffer.data(), static_cast<int32_t>(buffer.size()));
+    if (length > static_cast<int32_t>(buffer.size())) {
+        buffer.resize(static_cast<size_t>(length));
+        length = llama_chat_apply_template(tmpl, chat.data(), chat.size(), p_add_assistant, buffer.data(), static_cast<int32_t>(buffer.size()));
+    }
+    if (length < 0) {
+        return false;
+    }
+    r_text = String::utf8(buffer.data(), length);
+    return true;
+}
+
+bool LlamaChatSession::_full_segment(size_t p_index, String &r_segment, bool &r_folded) {
+    String previous;
+    if (rendered_valid && rendered_count == p_index) {
+        previous = rendered_text;
+    } else if (!_render(0, p_index, false, previous)) {
+        return false;
+    }
+    String rendered;
+    if (!_render(0, p_index + 1, false, rendered)) {
+        return false;
+    }
+
+    // Templates are append-only for almost every model, so a turn's segment
+    // is whatever it adds to the rendering of the turns before it. When a
+    // template rewrites earlier text the whole rendering is folded into
+    // this message and the mismatch re-decodes from the first change.
+    r_folded = !rendered.begins_with(previous);
+    r_segment = r_folded ? rendered : rendered.substr(previous.length());
+    rendered_text = rendered;
+    rendered_count = p_index + 1;
+    rendered_valid = true;
+    return true;
+}
+
+bool LlamaChatSession::_segment(size_t p_index, String &r_segment, bool &r_folded) {
+    r_folded = false;
+    // A window starting at a system message or at the first turn would hit
+    // the template's special cases for those, so only later turns qualify.
+    if (window_check >= 0 && p_index >= 2 && messages[p_index - 1].role != "system") {
+        String before;
+        String with;
+        if (_render(p_index - 1, p_index, false, before) && _render(p_index - 1, p_index + 1, false, with) && with.begins_with(before)) {
+            const String window_segment = with.substr(before.length());
+            if (window_check > 0) {
+                r_segment = window_segment;
+                return true;
+            }
+            if (!_full_segment(p_index, r_segment, r_folded)) {
+                return false;
+            }
+            window_check = !r_folded && r_segment == window_segment ? 1 : -1;
+            return true;
+        }
+    }
+    return _full_segment(p_index, r_segment, r_folded);
+}
+
+void LlamaChatSession::_invalidate_renders(bool p_template_changed) {
+    rendered_valid = false;
+    if (p_template_changed) {
+        window_check = 0;
+        assistant_prefix_ready = false;
+        assistant_prefix_tokens.clear();
+    }
+}
+
+void LlamaChatSession::_set_message_text(Message &r_message, const String &p_role, const String &p_content) {
+    r_message.role = p_role;
+    r_message.content = p_content;
+    r_message.role_utf8 = p_role.utf8();
+    r_message.content_utf8 = p_content.utf8();
+}
+
+bool LlamaChatSession::_tokenize_pending(String &r_error) {
+    size_t first = messages.size();
+    for (size_t i = 0; i < messages.size(); i++) {
+        if (!messages[i].tokenized) {
+            first = i;
+            break;
+        }
+    }
+    if (first == messages.size()) {
+        return true;
+    }
+
+    const Ref<LlamaModel> model = context->get_model();
+    for (size_t i = first; i < messages.size(); i++) {
+        String segment;
+        bool folded = false;
+        if (!_segment(i, segment, folded)) {
+            r_error = "Chat template is not supported by llama_chat_apply_template.";
+            return false;
+        }
+        if (folded) {
+            for (size_t j = 0; j < i; j++) {
+                messages[j].tokens.clear();
+            }
+        }
+
+        messages[i].tokens.clear();
+        if (!segment.is_empty()) {
+            _append_tokens(messages[i].tokens, model->tokenize(segment, false, true));
+        }
+        messages[i].tokenized = true;
+    }
+    return true;
+}
+
+bool LlamaChatSession::_build_target(bool p_add_assistant, std::vector<int32_t> &r_target, String &r_error) {
+    if (!_tokenize_pending(r_error)) {
+        return false;
+    }
+
+    const Ref<LlamaModel> model = context->get_model();
+    bos_tokens.clear();
+    _append_tokens(bos_tokens, model->tokenize("", true));
+
+    r_target = bos_tokens;
+    for (const Message &message : messages) {
+        r_target.insert(r_target.end(), message.tokens.begin(), message.tokens.end());
+    }
+
+    if (p_add_assistant && !messages.empty()) {
+        // The assistant opener does not depend on the history, so it is
+        // rendered next to the last message once per template.
+        if (!assistant_prefix_ready) {
+            const size_t last = messages.size() - 1;
+            String closed;
+            String open;
+            if (!_render(last, last + 1, false, closed) || !_render(last, last + 1, true, open)) {
+                r_error = "Chat template is not supported by llama_chat_apply_template.";
+                return false;
+            }
+            assistant_prefix_tokens.clear();
+            if (open.begins_with(closed) && open.length() > closed.length()) {
+                _append_tokens(assistant_prefix_tokens, model->tokenize(open.substr(closed.length()), false, true));
+            }
+            assistant_prefix_ready = true;
+        }
+        r_target.insert(r_target.end(), assistant_prefix_tokens.begin(), assistant_prefix_tokens.end());
+    }
+    return true;
+}
+
+void LlamaChatSession::_remove_message(size_t p_index) {
+    const Message removed = messages[p_index];
+    messages.erase(messages.begin() + static_cast<ptrdiff_t>(p_index));
+    _invalidate_renders(false);
+    if (!removed.tokenized) {
+        return;
+    }
+
+    // A message that rendered to nothing was folded into a later segment (or
+    // the template merges it into the next turn), so its text cannot be cut
+    // out of the KV on its own.
+    if (removed.tokens.empty()) {
+        for (Message &message : messages) {
+            message.tokenized = false;
+            message.tokens.clear();
+        }
+        return;
+    }
+
+    size_t start = bos_tokens.size();
+    for (size_t i = 0; i < p_index; i++) {
+        start += messages[i].tokens.size();
+    }
+    const size_t end = start + removed.tokens.size();
+    if (!context.is_valid() || kv_tokens.size() < end ||
+            !std::equal(removed.tokens.begin(), removed.tokens.end(), kv_tokens.begin() + static_cast<ptrdiff_t>(start))) {
+        return;
+    }
+
+    // On success later positions were shifted down; otherwise the mirror still
+    // holds the old range and the next sync re-decodes from its start.
+    if (context->remove_conversation_range(_get_conversation(), static_cast<int>(start), static_cast<int>(end)) == OK) {
+        kv_tokens.erase(kv_tokens.begin() + static_cast<ptrdiff_t>(start), kv_tokens.begin() + static_cast<ptrdiff_t>(end));
+    }
+}
+
+void LlamaChatSession::_apply_history_limit() {
+    if (max_history_messages > 0) {
+        trim_history(max_history_messages);
+    }
+}
+
+void LlamaChatSession::_sync_mirror() {
+    const String conversation_id = _get_conversation();
+    if (context->get_conversation_length(conversation_id) != static_cast<int>(kv_tokens.size())) {
+        // The sequence was dropped, reset or written by someone else.
+        kv_tokens.clear();
+        context->truncate_conversation(conversation_id, 0);
+    }
+}
+
+String LlamaChatSession::_generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming) {
+    if (!_is_ready()) {
+        UtilityFunctions::push_error("godot_llama: chat session needs a context created with a loaded model.");
+        return "";
+    }
+    if (messages.empty()) {
+        UtilityFunctions::push_error("godot_llama: chat session has no messages.");
+        return "";
+    }
+
+    _sync_mirror();
+
+    // Drop the oldest non-system turns until the prompt and the reply fit.
+    // params["max_tokens"], when set, is what the context generates with.
+    const int max_tokens = LlamaGenerationParams::resolve_max_tokens(p_params, p_max_tokens);
+    const size_t n_ctx_seq = static_cast<size_t>(context->get_n_ctx_seq());
+    std::vector<int32_t> target;
+    String error;
+    while (true) {
+        if (!_build_target(true, target, error)) {
+            UtilityFunctions::push_error("godot_llama: ", error);
+            return "";
+        }
+        if (n_ctx_seq == 0 || target.size() + static_cast<size_t>(std::max(0, max_tokens)) <= n_ctx_seq) {
+            break;
+        }
+        size_t oldest = messages.size();
+        for (size_t i = 0; i + 1 < messages.size(); i++) {
+            if (messages[i].role != "system") {
+                oldest = i;
+                break;
+            }
+        }
+        if (oldest == messages.size()) {
+            break;
+        }
+        _remove_message(oldest);
+    }
+
+    size_t common = 0;
+    const size_t limit = std::min(kv_tokens.size(), target.size());
+    while (common < limit && kv_tokens[common] == target[common]) {
+        common++;
+    }
+    // Sampling needs logits for the last prompt token, so at least one token
+    // is always decoded even when the whole prompt is already in the KV.
+    if (common == target.size() && common > 0) {
+        common--;
+    }
+    const String conversation_id = _get_conversation();
+    if (common < kv_tokens.size()) {
+        context->truncate_conversation(conversation_id, static_cast<int>(common));
+        kv_tokens.resize(common);
+    }
+
+    PackedInt32Array pending;
+    for (size_t i = common; i < target.size(); i++) {
+        pending.append(target[i]);
+    }
+    tokens_reused += static_cast<int64_t>(common);
+    tokens_decoded += pending.size();
+
+    Dictionary params = p_params.duplicate();
+    params["conversation"] = conversation_id;
+    params["reuse_kv"] = true;
+    const String reply = context->generate_continuation(pending, max_tokens, params, p_streaming);
+
+    kv_tokens = target;
+    _append_tokens(kv_tokens, context->get_last_tokens());
+    if (context->get_conversation_length(conversation_id) != static_cast<int>(kv_tokens.size())) {
+        kv_tokens.clear();
+    }
+
+    // The reply is re-tokenized canonically on the next turn; the generated
+    // tokens already in the KV are kept as far as they match it.
+    const String clean_reply = reply.strip_edges();
+    if (!clean_reply.is_empty()) {
+        Message message;
+        _set_message_text(message, "assistant", clean_reply);
+        messages.push_back(message);
+        _apply_history_limit();
+    }
+    return reply;
+}
+
+void LlamaChatSession::set_context(const Ref<LlamaContext> &p_context) {
+    if (context == p_context) {
+        return;
+    }
+    context = p_context;
+    kv_tokens.clear();
+    _invalidate_renders(true);
+    for (Message &message : messages) {
+        message.tokenized = false;
+        message.tokens.clear();
+    }
+}
+
+Ref<LlamaContext> LlamaChatSession::get_context() const {
+    return context;
+}
+
+void LlamaChatSession::set_conversation(const String &p_conversation) {
+    conversation = p_conversation;
+    kv_tokens.clear();
+}
+
+String LlamaChatSession::get_conversation() const {
+    return conversation;
+}
+
+void LlamaChatSession::set_chat_template(const String &p_chat_template) {
+    chat_template = p_chat_template;
+    _invalidate_renders(true);
+    for (Message &message : messages) {
+        message.tokenized = false;
+        message.tokens.clear();
+    }
+}
+
+String LlamaChatSession::get_chat_template() const {
+    return chat_template;
+}
+
+void LlamaChatSession::set_max_history_messages(int p_max_history_messages) {
+    max_history_messages = std::max(0, p_max_history_messages);
+    _apply_history_limit();
+}
+
+int LlamaChatSession::get_max_history_messages() const {
+    return max_history_messages;
+}
+
+void LlamaChatSession::add_message(const String &p_role, const String &p_content) {
+    Message message;
+    _set_message_text(message, p_role, p_content);
+    messages.push_back(message);
+    _apply_history_limit();
+}
+
+Error LlamaChatSession::set_message(int p_index, const String &p_content) {
+    if (p_index < 0 || p_index >= static_cast<int>(messages.size())) {
+        return ERR_INVALID_PARAMETER;
+    }
+    _set_message_text(messages[p_index], messages[p_index].role, p_content);
+    _invalidate_renders(false);
+    for (size_t i = static_cast<size_t>(p_index); i < messages.size(); i++) {
+        messages[i].tokenized = false;
+        messages[i].tokens.clear();
+    }
+    return OK;
+}
+
+Error LlamaChatSession::remove_message(int p_index) {
+    if (p_index < 0 || p_index >= static_cast<int>(messages.size())) {
+        return ERR_INVALID_PARAMETER;
+    }
+    _remove_message(static_cast<size_t>(p_index));
+    return OK;
+}
+
+void LlamaChatSession::trim_history(int p_max_messages) {
+    const int max_messages = std::max(0, p_max_messages);
+    int count = 0;
+    for (const Message &message : messages) {
+        if (message.role != "system") {
+            count++;
+        }
+    }
+    size_t i = 0;
+    while (count > max_messages && i < messages.size()) {
+        if (messages[i].role == "system") {
+            i++;
+            continue;
+        }
+        _remove_message(i);
+        count--;
+    }
+}
+
+Array LlamaChatSession::get_messages() const {
+    Array result;
+    for (const Message &message : messages) {
+        Dictionary entry;
+        entry["role"] = message.role;
+        entry["content"] = message.content;
+        entry["n_tokens"] = static_cast<int64_t>(message.tokens.size());
+        result.append(entry);
+    }
+    return result;
+}
+
+int LlamaChatSession::get_message_count() const {
+    return static_cast<int>(messages.size());
+}
+
+void LlamaChatSession::clear() {
+    messages.clear();
+    _invalidate_renders(false);
+    kv_tokens.clear();
+    if (context.is_valid() && context->is_initialized()) {
+        context->drop_conversation(_get_conversation());
+    }
+}
+
+String LlamaChatSession::generate(int p_max_tokens, const Dictionary &p_params) {
+    return _generate_internal(p_max_tokens, p_params, false);
+}
+
+void LlamaChatSession::generate_stream(int p_max_tokens, const Dictionary &p_params) {
+    _generate_internal(p_max_tokens, p_params, true);
+}
+
+String LlamaChatSession::render_prompt(bool p_add_assistant) const {
+    String text;
+    if (!_is_ready() || !_render(0, messages.size(), p_add_assistant, text)) {
+        return "";
+    }
+    return text;
+}
+
+Dictionary LlamaChatSession::get_stats() const {
+    Dictionary stats;
+    int64_t message_tokens = 0;
+    for (const Message &message : messages) {
+        message_tokens += static_cast<int64_t>(message.tokens.size());
+    }
+    stats["messages"] = static_cast<int64_t>(messages.size());
+    stats["message_tokens"] = message_tokens;
+    stats["kv_tokens"] = static_cast<int64_t>(kv_tokens.size());
+    stats["tokens_decoded"] = tokens_decoded;
+    stats["tokens_reused"] = tokens_reused;
+    stats["template_renders"] = template_renders;
+    return stats;
+}
@@ -0,0 +1,103 @@
+#ifndef GODOT_LLAMA_CHAT_SESSION_H
+#define GODOT_LLAMA_CHAT_SESSION_H
+
+#include "llama_context.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace godot {
+
+// Structured chat history bound to one conversation of a LlamaContext. Each
+// message keeps the exact tokens its chat-template segment decoded to, so new
+// turns only tokenize and decode their own segment and trimming a turn removes
+// exactly its KV range.
+class LlamaChatSession : public RefCounted {
+    GDCLASS(LlamaChatSession, RefCounted);
+
+private:
+    struct Message {
+        String role;
+        String content;
+        // Encoded once, since every render needs them.
+        CharString role_utf8;
+        CharString content_utf8;
+        std::vector<int32_t> tokens;
+        bool tokenized = false;
+    };
+
+    Ref<LlamaContext> context;
+    String conversation;
+    String chat_template;
+    int max_history_messages = 0;
+    std::vector<Message> messages;
+    // Mirror of the tokens currently decoded into the conversation's sequence.
+    std::vector<int32_t> kv_tokens;
+    std::vector<int32_t> bos_tokens;
+    int64_t tokens_decoded = 0;
+    int64_t tokens_reused = 0;
+    // Closed rendering of the first rendered_count messages, so a new turn
+    // does not render the history before it again.
+    String rendered_text;
+    size_t rendered_count = 0;
+    bool rendered_valid = false;
+    // Whether a turn rendered after only its predecessor yields the same
+    // segment as rendering the whole history: 0 until checked once per
+    // template, then 1 (render two-message windows) or -1 (render all).
+    int window_check = 0;
+    // Text the template appends to open the assistant's turn.
+    std::vector<int32_t> assistant_prefix_tokens;
+    bool assistant_prefix_ready = false;
+    mutable int64_t template_renders = 0;
+
+    bool _is_ready() const;
+    String _get_conversation() const;
+    bool _render(size_t p_begin, size_t p_end, bool p_add_assistant, String &r_text) const;
+    bool _full_segment(size_t p_index, String &r_segment, bool &r_folded);
+    bool _segment(size_t p_index, String &r_segment, bool &r_folded);
+    void _invalidate_renders(bool p_template_changed);
+    void _set_message_text(Message &r_message, const String &p_role, const String &p_content);
+    bool _tokenize_pending(String &r_error);
+    bool _build_target(bool p_add_assistant, std::vector<int32_t> &r_target, String &r_error);
+    void _remove_message(size_t p_index);
+    void _apply_history_limit();
+    void _fit_window(int p_max_tokens);
+    void _sync_mirror();
+    String _generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming);
+
+protected:
+    static void _bind_methods();
+
+public:
+    void set_context(const Ref<LlamaContext> &p_context);
+    Ref<LlamaContext> get_context() const;
+    void set_conversation(const String &p_conversation);
+    String get_conversation() const;
+    void set_chat_template(const String &p_chat_template);
+    String get_chat_template() const;
+    void set_max_history_messages(int p_max_history_messages);
+    int get_max_history_messages() const;
+
+    void add_message(const String &p_role, const String &p_content);
+    Error set_message(int p_index, const String &p_content);
+    Error remove_message(int p_index);
+    void trim_history(int p_max_messages);
+    Array get_messages() const;
+    int get_message_count() const;
+    void clear();
+
+    String generate(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    void generate_stream(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    String render_prompt(bool p_add_assistant = true) const;
+    Dictionary get_stats() const;
+};
+
+} // namespace godot
+
+#endif
@@ -1,5 +1,10 @@
 #include "llama_context.h"
 
+#include "llama_autotuner.h"
+#include "llama_batch_scheduler.h"
+#include "llama_memory_planner.h"
+#include "llama_state_file.h"
+
 #include <godot_cpp/classes/project_settings.hpp>
 #include <godot_cpp/classes/os.hpp>
 #include <godot_cpp/classes/time.hpp>
@@ -14,6 +19,12 @@
 
 using namespace godot;
 
+// Upper bound on phrase rewinds per generation, so a model that keeps steering
+// into banned phrases still finishes.
+static constexpr int32_t PHRASE_FILTER_MAX_REWINDS = 16;
+// In-memory snapshots of evicted conversations beyond this are dropped.
+static constexpr int64_t LLAMA_CONTEXT_DEFAULT_EVICTED_MAX_BYTES = 256 * 1024 * 1024;
+
 static String _globalize_context_path(const String &p_path) {
     if (p_path.begins_with("res://") || p_path.begins_with("user://")) {
         return ProjectSettings::get_singleton()->globalize_path(p_path);
@@ -21,6 +32,35 @@ static String _globalize_context_path(const String &p_path) {
     return p_path;
 }
 
+// Prompt-lookup drafting: finds the most recent earlier occurrence of the
+// last n tokens (longest n first) and proposes the tokens that followed it.
+// Single-token matches are too common to be worth verifying.
+static void _lookup_draft(const std::vector<int32_t> &p_prompt, const std::vector<int32_t> &p_output, int32_t p_ngram_max, int32_t p_draft_max, std::vector<int32_t> &r_draft) {
+    r_draft.clear();
+    const int64_t n_prompt = static_cast<int64_t>(p_prompt.size());
+    const int64_t length = n_prompt + static_cast<int64_t>(p_output.size());
+    auto at = [&](int64_t p_index) {
+        return p_index < n_prompt ? p_prompt[p_index] : p_output[p_index - n_prompt];
+    };
+
+    const int32_t ngram_min = std::min(2, p_ngram_max);
+    for (int64_t n = std::min<int64_t>(p_ngram_max, length - 1); n >= ngram_min; n--) {
+        for (int64_t start = length - n - 1; start >= 0; start--) {
+            int64_t matched = 0;
+            while (matched < n && at(start + matched) == at(length - n + matched)) {
+                matched++;
+            }
+            if (matched < n) {
+                continue;
+            }
+            for (int64_t j = start + n; j < length && static_cast<int32_t>(r_draft.size()) < p_draft_max; j++) {
+                r_draft.push_back(at(j));
+            }
+            return;
+        }
+    }
+}
+
 void LlamaContext::_bind_methods() {
     ClassDB::bind_method(D_METHOD("create", "model", "params"), &LlamaContext::create, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("reset"), &LlamaContext::reset);
@@ -28,22 +68,54 @@ void LlamaContext::_bind_methods() {
     ClassDB::bind_method(D_METHOD("set_prompt", "prompt"), &LlamaContext::set_prompt);
     ClassDB::bind_method(D_METHOD("generate", "max_tokens", "params"), &LlamaContext::generate, DEFVAL(128), DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("generate_stream", "max_tokens", "params"), &LlamaContext::generate_stream, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("generate_tokens", "tokens", "max_tokens", "params"), &LlamaContext::generate_tokens, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("generate_tokens_stream", "tokens", "max_tokens", "params"), &LlamaContext::generate_tokens_stream, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("get_last_tokens"), &LlamaContext::get_last_tokens);
+    ClassDB::bind_method(D_METHOD("generate_batch", "requests", "params"), &LlamaContext::generate_batch, DEFVAL(Dictionary()));
     ClassDB::bind_method(D_METHOD("cancel"), &LlamaContext::cancel);
+    ClassDB::bind_method(D_METHOD("set_lora", "name", "scale"), &LlamaContext::set_lora, DEFVAL(1.0f));
+    ClassDB::bind_method(D_METHOD("clear_loras"), &LlamaContext::clear_loras);
+    ClassDB::bind_method(D_METHOD("get_loras"), &LlamaContext::get_loras);
+    ClassDB::bind_method(D_METHOD("drop_conversation", "conversation"), &LlamaContext::drop_conversation);
+    ClassDB::bind_method(D_METHOD("evict_conversation", "conversation"), &LlamaContext::evict_conversation);
+    ClassDB::bind_method(D_METHOD("has_conversation", "conversation"), &LlamaContext::has_conversation);
+    ClassDB::bind_method(D_METHOD("get_conversation_ids"), &LlamaContext::get_conversation_ids);
+    ClassDB::bind_method(D_METHOD("get_conversation_length", "conversation"), &LlamaContext::get_conversation_length);
+    ClassDB::bind_method(D_METHOD("truncate_conversation", "conversation", "length"), &LlamaContext::truncate_conversation);
+    ClassDB::bind_method(D_METHOD("remove_conversation_range", "conversation", "from", "to"), &LlamaContext::remove_conversation_range);
+    ClassDB::bind_method(D_METHOD("set_result_cache", "cache"), &LlamaContext::set_result_cache);
+    ClassDB::bind_method(D_METHOD("get_result_cache"), &LlamaContext::get_result_cache);
+    ClassDB::bind_method(D_METHOD("set_thread_governor", "governor"), &LlamaContext::set_thread_governor);
+    ClassDB::bind_method(D_METHOD("get_thread_governor"), &LlamaContext::get_thread_governor);
     ClassDB::bind_method(D_METHOD("get_stats"), &LlamaContext::get_stats);
+    ClassDB::bind_static_method("LlamaContext", D_METHOD("get_global_metrics"), &LlamaContext::get_global_metrics);
     ClassDB::bind_method(D_METHOD("save_state"), &LlamaContext::save_state);
     ClassDB::bind_method(D_METHOD("load_state", "state"), &LlamaContext::load_state);
     ClassDB::bind_method(D_METHOD("save_state_file", "path"), &LlamaContext::save_state_file);
     ClassDB::bind_method(D_METHOD("load_state_file", "path"), &LlamaContext::load_state_file);
+    ClassDB::bind_method(D_METHOD("save_state_file_async", "path"), &LlamaContext::save_state_file_async);
+    ClassDB::bind_method(D_METHOD("load_state_file_async", "path"), &LlamaContext::load_state_file_async);
     ClassDB::bind_method(D_METHOD("get_model"), &LlamaContext::get_model);
     ClassDB::bind_method(D_METHOD("get_prompt"), &LlamaContext::get_prompt);
     ClassDB::bind_method(D_METHOD("is_initialized"), &LlamaContext::is_initialized);
+    ClassDB::bind_method(D_METHOD("is_serving"), &LlamaContext::is_serving);
+
+    ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "result_cache", PROPERTY_HINT_RESOURCE_TYPE, "LlamaResultCache"), "set_result_cache", "get_result_cache");
+    ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "thread_governor", PROPERTY_HINT_RESOURCE_TYPE, "LlamaThreadGovernor"), "set_thread_governor", "get_thread_governor");
 
     ADD_SIGNAL(MethodInfo("token_generated", PropertyInfo(Variant::STRING, "token_text"), PropertyInfo(Variant::INT, "token_id")));
     ADD_SIGNAL(MethodInfo("generation_finished", PropertyInfo(Variant::STRING, "full_text")));
     ADD_SIGNAL(MethodInfo("generation_error", PropertyInfo(Variant::STRING, "message")));
+    ADD_SIGNAL(MethodInfo("batch_item_finished", PropertyInfo(Variant::DICTIONARY, "result")));
+    ADD_SIGNAL(MethodInfo("state_saved", PropertyInfo(Variant::STRING, "path"), PropertyInfo(Variant::INT, "error")));
+    ADD_SIGNAL(MethodInfo("state_loaded", PropertyInfo(Variant::STRING, "path"), PropertyInfo(Variant::INT, "error")));
+    ADD_SIGNAL(MethodInfo("field_completed", PropertyInfo(Variant::STRING, "path"), PropertyInfo(Variant::NIL, "value", PROPERTY_HINT_NONE, "", PROPERTY_USAGE_NIL_IS_VARIANT)));
 }
 
 LlamaContext::~LlamaContext() {
+    if (state_thread.is_valid() && state_thread->is_started()) {
+        state_thread->wait_to_finish();
+    }
     if (native_sampler != nullptr) {
         llama_sampler_free(native_sampler);
         native_sampler = nullptr;
@@ -63,7 +135,15 @@ void LlamaContext::_emit_error(const String &p_message) const {
     const_cast<LlamaContext *>(this)->emit_signal("generation_error", p_message);
 }
 
-bool LlamaContext::_decode_tokens(const std::vector<int32_t> &p_tokens) {
+bool LlamaContext::_fail_if_serving(const char *p_method) const {
+    if (!serving) {
+        return false;
+    }
+    UtilityFunctions::push_error(vformat("godot_llama: %s: Context is owned by a running LlamaServer.", p_method));
+    return true;
+}
+
+bool LlamaContext::_decode_tokens(const std::vector<int32_t> &p_tokens, bool p_all_logits) {
     last_decode_error = "";
     if (p_tokens.empty()) {
         return true;
@@ -85,18 +165,21 @@ bool LlamaContext::_decode_tokens(const std::vector<int32_t> &p_tokens) {
         const int32_t remaining = static_cast<int32_t>(tokens.size() - offset);
         const int32_t chunk = std::min(batch_size, remaining);
 
+        const int32_t n_past = sequence_cache.get_n_past(active_seq);
         std::vector<llama_pos> positions(chunk);
         std::vector<int32_t> n_seq_id(chunk, 1);
-        std::vector<llama_seq_id> seq_ids(chunk, 0);
+        std::vector<llama_seq_id> seq_ids(chunk, active_seq);
         std::vector<llama_seq_id *> seq_id_ptrs(chunk);
-        std::vector<int8_t> logits(chunk, 0);
+        std::vector<int8_t> logits(chunk, p_all_logits ? 1 : 0);
 
         for (int32_t i = 0; i < chunk; i++) {
-            positions[i] = decode_pos + i;
+            positions[i] = n_past + i;
             seq_id_ptrs[i] = &seq_ids[i];
         }
         logits[chunk - 1] = 1;
 
+        _govern_decode();
+
         llama_batch batch = {};
         batch.n_tokens = chunk;
         batch.token = tokens.data() + offset;
@@ -106,6 +189,7 @@ bool LlamaContext::_decode_tokens(const std::vector<int32_t> &p_tokens) {
         batch.logits = logits.data();
 
         int32_t rc = llama_decode(native_context, batch);
+        last_decode_end_usec = Time::get_singleton()->get_ticks_usec();
         if (rc != 0) {
             last_decode_error = vformat("llama_decode rc=%d offset=%d chunk=%d total=%d n_batch=%d",
                     rc,
@@ -116,16 +200,59 @@ bool LlamaContext::_decode_tokens(const std::vector<int32_t> &p_tokens) {
             return false;
         }
         offset += static_cast<size_t>(chunk);
-        decode_pos += chunk;
+        sequence_cache.set_n_past(active_seq, n_past + chunk);
     }
 
+    _update_kv_metric();
     return true;
 }
 
+void LlamaContext::_update_kv_metric() {
+    metric_kv_cells_used.set(sequence_cache.get_resident_tokens());
+}
+
+void LlamaContext::_govern_decode() {
+    int32_t threads = base_n_threads;
+    int32_t threads_batch = base_n_threads_batch;
+    int32_t delay_usec = 0;
+    if (thread_governor.is_valid()) {
+        const int32_t governed = thread_governor->get_n_threads();
+        if (governed > 0) {
+            // The governor only backs off: the counts from create() (explicit
+            // or autotuned) stay the ceiling, and batch threads keep their
+            // configured ratio to generation threads.
+            threads = std::min(governed, base_n_threads);
+            threads_batch = std::max(threads, base_n_threads_batch * threads / std::max(1, base_n_threads));
+        }
+        delay_usec = thread_governor->get_token_delay_usec();
+    }
+
+    if (threads != applied_n_threads || threads_batch != applied_n_threads_batch) {
+        llama_set_n_threads(native_context, threads, threads_batch);
+        applied_n_threads = threads;
+        applied_n_threads_batch = threads_batch;
+    }
+
+    if (delay_usec > 0 && last_decode_end_usec != 0) {
+        const uint64_t elapsed = Time::get_singleton()->get_ticks_usec() - last_decode_end_usec;
+        if (elapsed < static_cast<uint64_t>(delay_usec)) {
+            OS::get_singleton()->delay_usec(static_cast<int32_t>(static_cast<uint64_t>(delay_usec) - elapsed));
+        }
+    }
+}
+
 String LlamaContext::_token_to_piece(int32_t p_token) const {
-    if (!_is_ready()) {
+    const std::string piece = _token_to_bytes(p_token);
+    if (piece.empty()) {
         return "";
     }
+    return String::utf8(piece.data(), static_cast<int64_t>(piece.size()));
+}
+
+std::string LlamaContext::_token_to_bytes(int32_t p_token) const {
+    if (!_is_ready()) {
+        return std::string();
+    }
 
     const llama_vocab *vocab = model->get_vocab();
     std::vector<char> piece(64, '\0');
@@ -135,12 +262,79 @@ String LlamaContext::_token_to_piece(int32_t p_token) const {
         rc = llama_token_to_piece(vocab, static_cast<llama_token>(p_token), piece.data(), static_cast<int32_t>(piece.size()), 0, true);
     }
     if (rc <= 0) {
-        return "";
+        return std::string();
+    }
+    return std::string(piece.data(), static_cast<size_t>(rc));
+}
+
+void LlamaContext::_emit_json_fields(LlamaJsonStream &r_stream, int32_t p_token) {
+    if (r_stream.is_complete() || r_stream.has_error()) {
+        return;
+    }
+
+    // Raw bytes keep multi-byte characters that span tokens intact.
+    const std::string bytes = _token_to_bytes(p_token);
+    std::vector<LlamaJsonStream::Field> fields;
+    r_stream.feed(bytes.data(), bytes.size(), fields);
+    for (const LlamaJsonStream::Field &field : fields) {
+        emit_signal("field_completed", field.path, field.value);
+    }
+    if (r_stream.has_error()) {
+        UtilityFunctions::push_warning("godot_llama: json_stream stopped: ", r_stream.get_error());
+    }
+}
+
+bool LlamaContext::_apply_loras(const Variant &p_selection) {
+    Dictionary selection;
+    if (p_selection.get_type() == Variant::STRING || p_selection.get_type() == Variant::STRING_NAME) {
+        selection[String(p_selection)] = 1.0;
+    } else if (p_selection.get_type() == Variant::DICTIONARY) {
+        selection = p_selection;
+    } else if (p_selection.get_type() != Variant::NIL) {
+        _emit_error("lora must be an adapter name or a Dictionary of name -> scale.");
+        return false;
+    }
+
+    std::vector<std::pair<llama_adapter_lora *, float>> wanted;
+    String wanted_key;
+    const Array names = selection.keys();
+    for (int i = 0; i < names.size(); i++) {
+        const String name = names[i];
+        llama_adapter_lora *adapter = model->get_lora(name);
+        if (adapter == nullptr) {
+            _emit_error(vformat("Unknown LoRA adapter '%s'. Call LlamaModel.load_lora() first.", name));
+            return false;
+        }
+        const float scale = static_cast<float>(double(selection[names[i]]));
+        if (scale != 0.0f) {
+            wanted.emplace_back(adapter, scale);
+            wanted_key += vformat("%s:%f;", name, scale);
+        }
+    }
+
+    // Adapters are applied to the graph at decode time, so switching is just a
+    // matter of updating the context's adapter set; weights stay shared.
+    applied_lora_key = wanted_key;
+    if (wanted == applied_loras) {
+        return true;
+    }
+    llama_clear_adapter_lora(native_context);
+    for (const std::pair<llama_adapter_lora *, float> &entry : wanted) {
+        if (llama_set_adapter_lora(native_context, entry.first, entry.second) != 0) {
+            applied_loras.clear();
+            llama_clear_adapter_lora(native_context);
+            _emit_error("llama_set_adapter_lora failed.");
+            return false;
+        }
     }
-    return String::utf8(piece.data(), rc);
+    applied_loras = wanted;
+    return true;
 }
 
 Error LlamaContext::create(const Ref<LlamaModel> &p_model, const Dictionary &p_params) {
+    if (_fail_if_serving("create")) {
+        return ERR_BUSY;
+    }
     if (native_sampler != nullptr) {
         llama_sampler_free(native_sampler);
         native_sampler = nullptr;
@@ -151,7 +345,13 @@ Error LlamaContext::create(const Ref<LlamaModel> &p_model, const Dictionary &p_p
     }
 
     model = p_model;
-    decode_pos = 0;
+    active_seq = 0;
+    applied_loras.clear();
+    sequence_cache.attach(nullptr);
+    metric_contexts.set(0);
+    metric_kv_cells_used.set(0);
+    metric_kv_cells_total.set(0);
+    metric_context_bytes.set(0);
     if (model.is_null() || !model->is_loaded()) {
         return ERR_UNCONFIGURED;
     }
@@ -163,12 +363,39 @@ Error LlamaContext::create(const Ref<LlamaModel> &p_model, const Dictionary &p_p
     cparams.n_threads = std::max(1, OS::get_singleton()->get_processor_count() - 1);
     cparams.n_threads_batch = cparams.n_threads;
 
+    // Settings measured by LlamaAutotuner on this machine replace the
+    // defaults; explicit params still win.
+    const Dictionary tuned = bool(p_params.get("autotune", true)) ? LlamaAutotuner::lookup(model) : Dictionary();
+    if (tuned.has("n_batch")) {
+        cparams.n_batch = static_cast<uint32_t>(int64_t(tuned["n_batch"]));
+    }
+    if (tuned.has("n_ubatch")) {
+        cparams.n_ubatch = static_cast<uint32_t>(int64_t(tuned["n_ubatch"]));
+    }
+    if (tuned.has("threads")) {
+        cparams.n_threads = static_cast<int32_t>(int64_t(tuned["threads"]));
+    }
+    if (tuned.has("threads_batch")) {
+        cparams.n_threads_batch = static_cast<int32_t>(int64_t(tuned["threads_batch"]));
+    }
+    autotuned = !tuned.is_empty();
+
     if (p_params.has("n_ctx")) {
         cparams.n_ctx = static_cast<uint32_t>(int64_t(p_params["n_ctx"]));
     }
     if (p_params.has("n_batch")) {
         cparams.n_batch = static_cast<uint32_t>(int64_t(p_params["n_batch"]));
-        cparams.n_ubatch = cparams.n_batch;
+        // A larger logical batch does not need a larger physical one.
+        cparams.n_ubatch = std::min(cparams.n_ubatch, cparams.n_batch);
+    }
+    if (p_params.has("n_ubatch")) {
+        cparams.n_ubatch = static_cast<uint32_t>(int64_t(p_params["n_ubatch"]));
+    }
+    if (p_params.has("n_seq_max")) {
+        cparams.n_seq_max = static_cast<uint32_t>(std::max<int64_t>(1, int64_t(p_params["n_seq_max"])));
+    }
+    if (p_params.has("kv_unified")) {
+        cparams.kv_unified = bool(p_params["kv_unified"]);
     }
     if (p_params.has("threads")) {
         cparams.n_threads = static_cast<int32_t>(int64_t(p_params["threads"]));
@@ -177,10 +404,61 @@ Error LlamaContext::create(const Ref<LlamaModel> &p_model, const Dictionary &p_p
         cparams.n_threads_batch = static_cast<int32_t>(int64_t(p_params["threads_batch"]));
     }
 
+    int32_t type_k = cparams.type_k;
+    int32_t type_v = cparams.type_v;
+    int32_t flash_attn = cparams.flash_attn_type;
+    if (p_params.has("type_k") && !LlamaMemoryPlanner::parse_kv_type(p_params["type_k"], type_k)) {
+        UtilityFunctions::push_error("godot_llama: invalid type_k: ", p_params["type_k"]);
+        return ERR_INVALID_PARAMETER;
+    }
+    if (p_params.has("type_v") && !LlamaMemoryPlanner::parse_kv_type(p_params["type_v"], type_v)) {
+        UtilityFunctions::push_error("godot_llama: invalid type_v: ", p_params["type_v"]);
+        return ERR_INVALID_PARAMETER;
+    }
+    if (p_params.has("flash_attn") && !LlamaMemoryPlanner::parse_flash_attn(p_params["flash_attn"], flash_attn)) {
+        UtilityFunctions::push_error("godot_llama: invalid flash_attn: ", p_params["flash_attn"]);
+        return ERR_INVALID_PARAMETER;
+    }
+    // llama.cpp can only store a quantized V cache through the flash-attention path.
+    if (LlamaMemoryPlanner::is_quantized_kv_type(type_v)) {
+        if (flash_attn == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+            UtilityFunctions::push_error("godot_llama: quantized type_v requires flash_attn");
+            return ERR_INVALID_PARAMETER;
+        }
+        flash_attn = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    }
+    cparams.type_k = static_cast<ggml_type>(type_k);
+    cparams.type_v = static_cast<ggml_type>(type_v);
+    cparams.flash_attn_type = static_cast<llama_flash_attn_type>(flash_attn);
+
     native_context = llama_init_from_model(const_cast<llama_model *>(model->get_native_model()), cparams);
     if (native_context == nullptr) {
         return ERR_CANT_CREATE;
     }
+    base_n_threads = cparams.n_threads;
+    base_n_threads_batch = cparams.n_threads_batch;
+    applied_n_threads = cparams.n_threads;
+    applied_n_threads_batch = cparams.n_threads_batch;
+    last_decode_end_usec = 0;
+
+    Dictionary planned;
+    planned["n_ctx"] = static_cast<int64_t>(llama_n_ctx(native_context));
+    planned["n_seq_max"] = static_cast<int64_t>(llama_n_seq_max(native_context));
+    planned["n_batch"] = static_cast<int64_t>(llama_n_batch(native_context));
+    planned["n_ubatch"] = static_cast<int64_t>(llama_n_ubatch(native_context));
+    planned["type_k"] = LlamaMemoryPlanner::kv_type_name(type_k);
+    planned["type_v"] = LlamaMemoryPlanner::kv_type_name(type_v);
+    planned["flash_attn"] = flash_attn == LLAMA_FLASH_ATTN_TYPE_ENABLED ? "on" : (flash_attn == LLAMA_FLASH_ATTN_TYPE_DISABLED ? "off" : "auto");
+    metric_contexts.set(1);
+    metric_kv_cells_total.set(static_cast<int64_t>(llama_n_ctx(native_context)));
+    metric_context_bytes.set(int64_t(LlamaMemoryPlanner::estimate(model, planned).get("context_bytes", 0)));
+
+    sequence_cache.attach(native_context);
+    sequence_cache.configure(
+            p_params.has("kv_budget_tokens") ? int64_t(p_params["kv_budget_tokens"]) : 0,
+            p_params.has("kv_spill_path") ? _globalize_context_path(p_params["kv_spill_path"]) : String(),
+            p_params.has("kv_compress") ? bool(p_params["kv_compress"]) : true,
+            p_params.has("kv_evicted_max_bytes") ? int64_t(p_params["kv_evicted_max_bytes"]) : LLAMA_CONTEXT_DEFAULT_EVICTED_MAX_BYTES);
 
     llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
     native_sampler = llama_sampler_chain_init(chain_params);
@@ -193,6 +471,9 @@ Error LlamaContext::create(const Ref<LlamaModel> &p_model, const Dictionary &p_p
 }
 
 void LlamaContext::reset() {
+    if (_fail_if_serving("reset")) {
+        return;
+    }
     if (native_context != nullptr) {
         llama_memory_t memory = llama_get_memory(native_context);
         if (memory != nullptr) {
@@ -205,10 +486,14 @@ void LlamaContext::reset() {
     if (native_sampler != nullptr) {
         llama_sampler_reset(native_sampler);
     }
-    decode_pos = 0;
+    sequence_cache.clear_all();
+    _update_kv_metric();
 }
 
 void LlamaContext::clear_kv_cache() {
+    if (_fail_if_serving("clear_kv_cache")) {
+        return;
+    }
     if (native_context != nullptr) {
         llama_memory_t memory = llama_get_memory(native_context);
         if (memory != nullptr) {
@@ -216,149 +501,69 @@ void LlamaContext::clear_kv_cache() {
             llama_memory_clear(memory, true);
         }
     }
-    decode_pos = 0;
+    sequence_cache.clear_resident();
+    _update_kv_metric();
 }
 
 void LlamaContext::set_prompt(const String &p_prompt) {
     prompt = p_prompt;
 }
 
-String LlamaContext::_generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming) {
+String LlamaContext::_generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming, const PackedInt32Array *p_prompt_tokens) {
+    last_tokens = PackedInt32Array();
     if (!_is_ready()) {
         _emit_error("Context is not initialized. Call create() with a loaded model.");
         return "";
     }
 
-    if (prompt.is_empty()) {
+    if (p_prompt_tokens == nullptr && prompt.is_empty()) {
         _emit_error("Prompt is empty. Call set_prompt() first.");
         return "";
     }
+    if (p_prompt_tokens != nullptr && p_prompt_tokens->is_empty()) {
+        _emit_error("Token prompt is empty.");
+        return "";
+    }
 
-    int max_tokens = p_max_tokens;
-    if (p_params.has("max_tokens")) {
-        max_tokens = static_cast<int>(int64_t(p_params["max_tokens"]));
+    if (serving) {
+        _emit_error("Context is owned by a running LlamaServer.");
+        return "";
     }
+
+    const LlamaGenerationParams gen_params = LlamaGenerationParams::from_dictionary(p_params, p_max_tokens);
+    const int max_tokens = gen_params.max_tokens;
     if (max_tokens <= 0) {
         return "";
     }
-
-    bool reuse_kv = false;
+    const uint64_t request_usec = Time::get_singleton()->get_ticks_usec();
+    LlamaMetrics::Contribution metric_active(LlamaMetrics::GAUGE_ACTIVE_GENERATIONS);
+    metric_active.set(1);
+
+    // Named conversations continue from their own KV by default; the anonymous
+    // conversation keeps the historical "fresh prompt every call" behaviour.
+    const String conversation = p_params.has("conversation") ? String(p_params["conversation"]) : String();
+    bool reuse_kv = p_params.has("conversation");
     if (p_params.has("reuse_kv")) {
         reuse_kv = bool(p_params["reuse_kv"]);
     }
 
-    if (!reuse_kv && native_context != nullptr) {
-        llama_memory_t memory = llama_get_memory(native_context);
-        if (memory != nullptr) {
-            const uint32_t n_seq_max = llama_n_seq_max(native_context);
-            for (uint32_t seq_id = 0; seq_id < n_seq_max; seq_id++) {
-                llama_memory_seq_rm(memory, static_cast<llama_seq_id>(seq_id), -1, -1);
-            }
-            llama_memory_seq_rm(memory, -1, -1, -1);
-            llama_memory_clear(memory, true);
-        }
-        decode_pos = 0;
-    }
-
-    float temperature = 0.7f;
-    float top_p = 0.9f;
-    float min_p = 0.0f;
-    int32_t top_k = 40;
-    float repeat_penalty = 1.0f;
-    float frequency_penalty = 0.0f;
-    float presence_penalty = 0.0f;
-    int32_t penalty_last_n = 64;
-    uint32_t seed = static_cast<uint32_t>(Time::get_singleton()->get_unix_time_from_system());
-    if (p_params.has("temperature")) {
-        temperature = static_cast<float>(double(p_params["temperature"]));
-    }
-    if (p_params.has("top_p")) {
-        top_p = static_cast<float>(double(p_params["top_p"]));
-    }
-    if (p_params.has("min_p")) {
-        min_p = static_cast<float>(double(p_params["min_p"]));
-    }
-    if (p_params.has("top_k")) {
-        top_k = static_cast<int32_t>(int64_t(p_params["top_k"]));
-    }
-    if (p_params.has("repeat_penalty")) {
-        repeat_penalty = static_cast<float>(double(p_params["repeat_penalty"]));
-    }
-    if (p_params.has("frequency_penalty")) {
-        frequency_penalty = static_cast<float>(double(p_params["frequency_penalty"]));
-    }
-    if (p_params.has("presence_penalty")) {
-        presence_penalty = static_cast<float>(double(p_params["presence_penalty"]));
-    }
-    if (p_params.has("penalty_last_n")) {
-        penalty_last_n = static_cast<int32_t>(int64_t(p_params["penalty_last_n"]));
-    }
-    if (p_params.has("seed")) {
-        seed = static_cast<uint32_t>(int64_t(p_params["seed"]));
-    }
-
-    temperature = std::max(0.0f, temperature);
-    top_p = std::clamp(top_p, 0.0f, 1.0f);
-    min_p = std::clamp(min_p, 0.0f, 1.0f);
-    top_k = std::max(0, top_k);
-    penalty_last_n = std::max(-1, penalty_last_n);
-    const bool use_penalties = repeat_penalty != 1.0f || frequency_penalty != 0.0f || presence_penalty != 0.0f;
-
-    Array stop_sequences;
-    auto add_stop_sequence = [&stop_sequences](const String &p_value) {
-        if (!p_value.is_empty()) {
-            stop_sequences.append(p_value);
-        }
-    };
-
-    auto collect_stop_sequences = [&add_stop_sequence](const Variant &p_stop_value) {
-        if (p_stop_value.get_type() == Variant::STRING) {
-            add_stop_sequence(static_cast<String>(p_stop_value));
-            return;
-        }
-        if (p_stop_value.get_type() == Variant::PACKED_STRING_ARRAY) {
-            PackedStringArray values = p_stop_value;
-            for (int i = 0; i < values.size(); i++) {
-                add_stop_sequence(values[i]);
-            }
-            return;
-        }
-        if (p_stop_value.get_type() == Variant::ARRAY) {
-            Array values = p_stop_value;
-            for (int i = 0; i < values.size(); i++) {
-                if (values[i].get_type() == Variant::STRING) {
-                    add_stop_sequence(static_cast<String>(values[i]));
-                }
-            }
-        }
-    };
-
-    if (p_params.has("stop")) {
-        collect_stop_sequences(p_params["stop"]);
-    }
-    if (p_params.has("stop_sequences")) {
-        collect_stop_sequences(p_params["stop_sequences"]);
-    }
-
     if (native_sampler != nullptr) {
         llama_sampler_free(native_sampler);
     }
-    llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
-    native_sampler = llama_sampler_chain_init(chain_params);
-    llama_sampler_chain_add(native_sampler, llama_sampler_init_top_k(top_k));
-    llama_sampler_chain_add(native_sampler, llama_sampler_init_top_p(top_p, 1));
-    if (min_p > 0.0f) {
-        llama_sampler_chain_add(native_sampler, llama_sampler_init_min_p(min_p, 1));
-    }
-    if (use_penalties) {
-        llama_sampler_chain_add(native_sampler, llama_sampler_init_penalties(penalty_last_n, repeat_penalty, frequency_penalty, presence_penalty));
+    phrase_filter_state = gen_params.create_phrase_filter_state(model->get_vocab());
+    LlamaPhraseFilterState *filter = phrase_filter_state.get();
+    const bool filter_text = filter != nullptr && gen_params.phrase_filter->get_match_text();
+    native_sampler = gen_params.create_sampler_chain(filter);
+
+    if (!_apply_loras(p_params.has("lora") ? p_params["lora"] : Variant(lora_scales))) {
+        return "";
     }
-    llama_sampler_chain_add(native_sampler, llama_sampler_init_temp(temperature));
-    llama_sampler_chain_add(native_sampler, llama_sampler_init_dist(seed));
 
     cancel_requested = false;
 
-    PackedInt32Array prompt_tokens_gd = model->tokenize(prompt, true);
+    // Pre-tokenized prompts (chat sessions, prompt builders) are continuations
+    // and already carry whatever special tokens they need.
+    const PackedInt32Array prompt_tokens_gd = p_prompt_tokens != nullptr ? *p_prompt_tokens : model->tokenize(prompt, true);
     if (prompt_tokens_gd.is_empty()) {
         _emit_error("Tokenization failed for prompt.");
         return "";
@@ -370,23 +575,66 @@ String LlamaContext::_generate_internal(int p_max_tokens, const Dictionary &p_pa
         prompt_tokens.push_back(prompt_tokens_gd[i]);
     }
 
+    const bool use_result_cache = result_cache.is_valid() && !reuse_kv && gen_params.is_deterministic() && bool(p_params.get("cache", true));
+    std::string cache_key;
+    if (use_result_cache) {
+        cache_key = _result_cache_key(prompt_tokens, gen_params);
+        String cached_text;
+        std::vector<int32_t> cached_tokens;
+        if (result_cache->lookup(cache_key, cached_text, cached_tokens)) {
+            if (p_streaming) {
+                LlamaJsonStream json_stream;
+                for (int32_t token : cached_tokens) {
+                    emit_signal("token_generated", _token_to_piece(token), static_cast<int64_t>(token));
+                    if (gen_params.json_stream) {
+                        _emit_json_fields(json_stream, token);
+                    }
+                }
+            }
+            for (int32_t token : cached_tokens) {
+                last_tokens.append(token);
+            }
+            // The KV still holds whatever ran before, not this prompt and
+            // reply, so a later reuse_kv call must not continue from it.
+            sequence_cache.drop(conversation);
+            emit_signal("generation_finished", cached_text);
+            return cached_text;
+        }
+    }
+
+    String acquire_error;
+    active_seq = sequence_cache.acquire(conversation, static_cast<int32_t>(prompt_tokens.size()) + max_tokens, acquire_error);
+    if (active_seq < 0) {
+        active_seq = 0;
+        _emit_error(acquire_error);
+        return "";
+    }
+    if (!reuse_kv) {
+        sequence_cache.truncate(active_seq, 0);
+    }
+
     const size_t n_ctx = static_cast<size_t>(llama_n_ctx(native_context));
     const size_t n_ctx_seq = static_cast<size_t>(llama_n_ctx_seq(native_context));
+    const size_t n_past = static_cast<size_t>(sequence_cache.get_n_past(active_seq));
     size_t max_prompt_tokens = n_ctx;
     if (n_ctx_seq > 0 && (max_prompt_tokens == 0 || n_ctx_seq < max_prompt_tokens)) {
         max_prompt_tokens = n_ctx_seq;
     }
-    if (max_prompt_tokens > 0 && prompt_tokens.size() >= max_prompt_tokens) {
-        const size_t keep = max_prompt_tokens - 1;
+    if (max_prompt_tokens > 0 && n_past + prompt_tokens.size() >= max_prompt_tokens) {
+        const size_t keep = n_past < max_prompt_tokens ? max_prompt_tokens - n_past - 1 : 0;
         if (keep == 0) {
-            _emit_error("Context window too small for prompt.");
+            _emit_error(n_past > 0 ? "Conversation fills the context window. Drop it or generate with reuse_kv=false."
+                                   : "Context window too small for prompt.");
             return "";
         }
         const size_t drop = prompt_tokens.size() - keep;
         prompt_tokens.erase(prompt_tokens.begin(), prompt_tokens.begin() + static_cast<ptrdiff_t>(drop));
     }
 
-    if (!_decode_tokens(prompt_tokens)) {
+    const uint64_t prompt_start_usec = Time::get_singleton()->get_ticks_usec();
+    const bool prompt_decoded = _decode_tokens(prompt_tokens);
+    LlamaMetrics::record_prompt_eval(static_cast<int64_t>(prompt_tokens.size()), Time::get_singleton()->get_ticks_usec() - prompt_start_usec);
+    if (!prompt_decoded) {
         _emit_error(vformat("llama_decode failed while processing prompt. prompt_tokens=%d n_ctx=%d n_ctx_seq=%d n_batch=%d detail=%s",
                 static_cast<int32_t>(prompt_tokens.size()),
                 static_cast<int32_t>(llama_n_ctx(native_context)),
@@ -396,21 +644,111 @@ String LlamaContext::_generate_internal(int p_max_tokens, const Dictionary &p_pa
         return "";
     }
 
+    const PackedStringArray &stop_sequences = gen_params.stop_sequences;
+    LlamaJsonStream json_stream;
+    std::vector<int32_t> emitted_tokens;
+    std::vector<int64_t> token_ends;
     String full_text;
     const llama_vocab *vocab = model->get_vocab();
+    const int32_t generation_start = sequence_cache.get_n_past(active_seq);
+    size_t n_streamed = 0;
+    int32_t rewinds = 0;
+    bool rewind_failed = false;
+    // Lookup drafts decoded after the last committed token, and the batch
+    // index whose logits give the next sample (-1 = last decode).
+    std::vector<int32_t> draft;
+    size_t draft_cursor = 0;
+    int32_t sample_index = -1;
+    const int32_t draft_limit = std::min<int32_t>(gen_params.lookup_draft, static_cast<int32_t>(llama_n_batch(native_context)) - 1);
+
+    auto stream_until = [&](size_t p_count) {
+        for (; n_streamed < p_count; n_streamed++) {
+            const int64_t from = n_streamed > 0 ? token_ends[n_streamed - 1] : 0;
+            const int32_t token = emitted_tokens[n_streamed];
+            emit_signal("token_generated", full_text.substr(from, token_ends[n_streamed] - from), static_cast<int64_t>(token));
+            if (gen_params.json_stream) {
+                _emit_json_fields(json_stream, token);
+            }
+        }
+    };
+
+    // Drops the tokens from p_start on and bans the token that began the
+    // phrase there, so the next sample takes another path. The logits for
+    // p_start come from re-decoding the token before it.
+    auto rewind_phrase = [&](int32_t p_start, int32_t p_current_token) -> bool {
+        const int32_t n_emitted = static_cast<int32_t>(emitted_tokens.size());
+        if (p_start < static_cast<int32_t>(n_streamed) || p_start > n_emitted || n_emitted - p_start > filter->get_max_backtrack() ||
+                rewinds >= PHRASE_FILTER_MAX_REWINDS) {
+            return false;
+        }
+        const int32_t banned = p_start < n_emitted ? emitted_tokens[p_start] : p_current_token;
+        if (p_start < n_emitted) {
+            const int32_t previous = p_start > 0 ? emitted_tokens[p_start - 1] : prompt_tokens.back();
+            sequence_cache.truncate(active_seq, generation_start + p_start - 1);
+            draft.clear();
+            draft_cursor = 0;
+            sample_index = -1;
+            if (!_decode_tokens({ previous })) {
+                rewind_failed = true;
+                return true;
+            }
+        }
+        emitted_tokens.resize(p_start);
+        token_ends.resize(p_start);
+        full_text = full_text.substr(0, p_start > 0 ? token_ends[p_start - 1] : 0);
+        filter->rewind(p_start);
+        filter->ban(p_start, banned);
+        rewinds++;
+        return true;
+    };
+
     for (int i = 0; i < max_tokens; i++) {
+        if (rewind_failed) {
+            _emit_error(vformat("llama_decode failed while rewinding a banned phrase. detail=%s", last_decode_error));
+            return full_text;
+        }
         if (cancel_requested) {
             break;
         }
 
-        llama_token token = llama_sampler_sample(native_sampler, native_context, -1);
+        const uint64_t sample_start_usec = Time::get_singleton()->get_ticks_usec();
+        llama_token token = llama_sampler_sample(native_sampler, native_context, sample_index);
+        sample_usec += static_cast<int64_t>(Time::get_singleton()->get_ticks_usec() - sample_start_usec);
+        sampled_tokens++;
+        if (i == 0 && rewinds == 0) {
+            LlamaMetrics::record_first_token(Time::get_singleton()->get_ticks_usec() - request_usec);
+        }
+        if (filter != nullptr) {
+            const int32_t start = filter->take_backtrack_request();
+            if (start >= 0 && rewind_phrase(start, token)) {
+                i = static_cast<int>(emitted_tokens.size()) - 1;
+                continue;
+            }
+        }
         if (llama_vocab_is_eog(vocab, token)) {
+            // A phrase at the very end had no following character to test.
+            if (filter_text) {
+                const int64_t match = filter->find_text_match(full_text, full_text.length(), true);
+                if (match >= 0 && rewind_phrase(static_cast<int32_t>(std::upper_bound(token_ends.begin(), token_ends.end(), match) - token_ends.begin()), token)) {
+                    i = static_cast<int>(emitted_tokens.size()) - 1;
+                    continue;
+                }
+            }
             break;
         }
 
+        const int64_t previous_length = full_text.length();
         const String token_text = _token_to_piece(token);
         full_text += token_text;
 
+        if (filter_text) {
+            const int64_t match = filter->find_text_match(full_text, previous_length, false);
+            if (match >= 0 && rewind_phrase(static_cast<int32_t>(std::upper_bound(token_ends.begin(), token_ends.end(), match) - token_ends.begin()), token)) {
+                i = static_cast<int>(emitted_tokens.size()) - 1;
+                continue;
+            }
+        }
+
         bool reached_stop_sequence = false;
         if (!stop_sequences.is_empty()) {
             int first_stop_pos = -1;
@@ -427,22 +765,90 @@ String LlamaContext::_generate_internal(int p_max_tokens, const Dictionary &p_pa
             }
         }
 
-        if (p_streaming && !reached_stop_sequence) {
-            emit_signal("token_generated", token_text, static_cast<int64_t>(token));
-        }
-
         if (reached_stop_sequence) {
             break;
         }
 
+        // A sample that matches the next draft token is already in the KV;
+        // the first mismatch drops the rest of the draft.
+        bool already_decoded = false;
+        if (draft_cursor < draft.size()) {
+            if (draft[draft_cursor] == token) {
+                already_decoded = true;
+                draft_cursor++;
+                sample_index++;
+                lookup_accepted_tokens++;
+            } else {
+                sequence_cache.truncate(active_seq, generation_start + static_cast<int32_t>(emitted_tokens.size()));
+                draft.clear();
+                draft_cursor = 0;
+            }
+        }
+
+        emitted_tokens.push_back(static_cast<int32_t>(token));
+        token_ends.push_back(full_text.length());
+        if (filter != nullptr) {
+            filter->push(token);
+        }
+        if (p_streaming) {
+            // Tokens that may still be rewound stay back until they are safe.
+            size_t stable = emitted_tokens.size();
+            if (filter != nullptr) {
+                stable = static_cast<size_t>(filter->get_stable_length());
+                if (filter_text) {
+                    const int64_t safe_end = full_text.length() - filter->get_max_phrase_chars();
+                    stable = std::min<size_t>(stable, std::upper_bound(token_ends.begin(), token_ends.end(), safe_end) - token_ends.begin());
+                }
+                stable = std::max<size_t>(stable, emitted_tokens.size() - std::min<size_t>(emitted_tokens.size(), filter->get_max_backtrack()));
+            }
+            stream_until(stable);
+        }
+
         llama_sampler_accept(native_sampler, token);
-        std::vector<int32_t> next_token = { static_cast<int32_t>(token) };
-        if (!_decode_tokens(next_token)) {
-            _emit_error(vformat("llama_decode failed while generating tokens. detail=%s", last_decode_error));
-            return full_text;
+        LlamaMetrics::add_generated_tokens(1);
+        if (!already_decoded) {
+            std::vector<int32_t> next_tokens = { static_cast<int32_t>(token) };
+            draft.clear();
+            draft_cursor = 0;
+            if (draft_limit > 0) {
+                // The sampled token and its draft must all fit in the sequence.
+                const int32_t room = static_cast<int32_t>(llama_n_ctx_seq(native_context)) - sequence_cache.get_n_past(active_seq) - 1;
+                _lookup_draft(prompt_tokens, emitted_tokens, gen_params.lookup_ngram, std::min({ draft_limit, max_tokens - i - 1, room }), draft);
+                next_tokens.insert(next_tokens.end(), draft.begin(), draft.end());
+                lookup_drafted_tokens += static_cast<int64_t>(draft.size());
+            }
+            sample_index = draft.empty() ? -1 : 0;
+            if (!_decode_tokens(next_tokens, !draft.empty())) {
+                _emit_error(vformat("llama_decode failed while generating tokens. detail=%s", last_decode_error));
+                return full_text;
+            }
+        }
+
+        // Anything after the closing brace is chatter the caller asked to skip.
+        if (gen_params.json_stream && gen_params.json_stop && json_stream.is_complete()) {
+            break;
         }
     }
+    if (p_streaming) {
+        stream_until(emitted_tokens.size());
+    }
+    if (draft_cursor < draft.size()) {
+        sequence_cache.truncate(active_seq, generation_start + static_cast<int32_t>(emitted_tokens.size()));
+    }
+    if (filter != nullptr) {
+        phrase_rewinds += rewinds;
+        phrase_blocked_tokens += filter->get_blocked_tokens();
+    }
 
+    if (use_result_cache && !cancel_requested) {
+        result_cache->store(cache_key, full_text, emitted_tokens);
+    }
+    for (int32_t token : emitted_tokens) {
+        last_tokens.append(token);
+    }
+
+    sequence_cache.touch(active_seq);
+    _update_kv_metric();
     emit_signal("generation_finished", full_text);
     return full_text;
 }
@@ -455,10 +861,163 @@ void LlamaContext::generate_stream(int p_max_tokens, const Dictionary &p_params)
     _generate_internal(p_max_tokens, p_params, true);
 }
 
+String LlamaContext::generate_tokens(const PackedInt32Array &p_tokens, int p_max_tokens, const Dictionary &p_params) {
+    return _generate_internal(p_max_tokens, p_params, false, &p_tokens);
+}
+
+void LlamaContext::generate_tokens_stream(const PackedInt32Array &p_tokens, int p_max_tokens, const Dictionary &p_params) {
+    _generate_internal(p_max_tokens, p_params, true, &p_tokens);
+}
+
+PackedInt32Array LlamaContext::get_last_tokens() const {
+    return last_tokens;
+}
+
+String LlamaContext::generate_continuation(const PackedInt32Array &p_tokens, int p_max_tokens, const Dictionary &p_params, bool p_streaming) {
+    return _generate_internal(p_max_tokens, p_params, p_streaming, &p_tokens);
+}
+
+bool LlamaContext::begin_batch(LlamaBatchScheduler &r_scheduler, const Dictionary &p_params) {
+    if (!_is_ready()) {
+        _emit_error("Context is not initialized. Call create() with a loaded model.");
+        return false;
+    }
+    if (!_apply_loras(p_params.has("lora") ? p_params["lora"] : Variant(lora_scales))) {
+        return false;
+    }
+
+    // The scheduler owns every sequence while the batch runs; conversations
+    // that were resident move to snapshots and restore on their next use.
+    const int32_t n_seq = static_cast<int32_t>(llama_n_seq_max(native_context));
+    for (int32_t seq = 0; seq < n_seq; seq++) {
+        sequence_cache.evict(seq);
+    }
+    sequence_cache.clear_resident();
+    _update_kv_metric();
+    r_scheduler.attach(native_context, model->get_vocab());
+    return true;
+}
+
+void LlamaContext::make_batch_request(const Variant &p_item, const Dictionary &p_params, int64_t p_index, LlamaBatchScheduler::Request &r_request) const {
+    Dictionary merged = p_params.duplicate();
+    String prompt_text;
+    Variant id = p_index;
+    if (p_item.get_type() == Variant::DICTIONARY) {
+        const Dictionary entry = p_item;
+        const Array keys = entry.keys();
+        for (int64_t k = 0; k < keys.size(); k++) {
+            const String key = keys[k];
+            if (key != "id" && key != "prompt" && key != "params") {
+                merged[key] = entry[keys[k]];
+            }
+        }
+        if (entry.has("params") && entry["params"].get_type() == Variant::DICTIONARY) {
+            merged.merge(Dictionary(entry["params"]), true);
+        }
+        prompt_text = entry.get("prompt", "");
+        id = entry.get("id", p_index);
+    } else {
+        prompt_text = p_item;
+    }
+
+    r_request.id = id;
+    r_request.index = p_index;
+    r_request.params = LlamaGenerationParams::from_dictionary(merged, 128);
+    r_request.prompt_tokens.clear();
+    const PackedInt32Array prompt_tokens = prompt_text.is_empty() ? PackedInt32Array() : model->tokenize(prompt_text, true);
+    for (int t = 0; t < prompt_tokens.size(); t++) {
+        r_request.prompt_tokens.push_back(prompt_tokens[t]);
+    }
+}
+
+void LlamaContext::set_serving(bool p_serving) {
+    serving = p_serving;
+}
+
+bool LlamaContext::is_serving() const {
+    return serving;
+}
+
+Array LlamaContext::generate_batch(const Array &p_requests, const Dictionary &p_params) {
+    Array results;
+    if (serving) {
+        _emit_error("Context is owned by a running LlamaServer.");
+        return results;
+    }
+    LlamaBatchScheduler scheduler;
+    if (!begin_batch(scheduler, p_params)) {
+        return results;
+    }
+    results.resize(p_requests.size());
+    cancel_requested = false;
+
+    std::vector<LlamaBatchScheduler::Result> finished;
+    for (int64_t i = 0; i < p_requests.size(); i++) {
+        LlamaBatchScheduler::Request request;
+        make_batch_request(p_requests[i], p_params, i, request);
+        scheduler.enqueue(std::move(request));
+    }
+
+    String step_error;
+    while (scheduler.has_work()) {
+        if (cancel_requested) {
+            scheduler.cancel_all(finished);
+        } else {
+            _govern_decode();
+            const bool stepped = scheduler.step(finished, step_error);
+            last_decode_end_usec = Time::get_singleton()->get_ticks_usec();
+            if (!stepped && !step_error.is_empty()) {
+                _emit_error(vformat("Batch generation failed: %s", step_error));
+                step_error = "";
+            }
+        }
+
+        for (const LlamaBatchScheduler::Result &result : finished) {
+            const Dictionary result_dict = result.to_dictionary();
+            results[result.index] = result_dict;
+            emit_signal("batch_item_finished", result_dict);
+        }
+        finished.clear();
+    }
+
+    scheduler.append_stats(last_batch_stats);
+    return results;
+}
+
 void LlamaContext::cancel() {
     cancel_requested = true;
 }
 
+Error LlamaContext::set_lora(const String &p_name, float p_scale) {
+    if (_fail_if_serving("set_lora")) {
+        return ERR_BUSY;
+    }
+    if (model.is_null() || !model->is_loaded()) {
+        return ERR_UNCONFIGURED;
+    }
+    if (!model->has_lora(p_name)) {
+        return ERR_DOES_NOT_EXIST;
+    }
+
+    if (p_scale == 0.0f) {
+        lora_scales.erase(p_name);
+    } else {
+        lora_scales[p_name] = p_scale;
+    }
+    return OK;
+}
+
+void LlamaContext::clear_loras() {
+    if (_fail_if_serving("clear_loras")) {
+        return;
+    }
+    lora_scales.clear();
+}
+
+Dictionary LlamaContext::get_loras() const {
+    return lora_scales.duplicate();
+}
+
 Dictionary LlamaContext::get_stats() const {
     Dictionary stats;
     if (!_is_ready()) {
@@ -474,10 +1033,47 @@ Dictionary LlamaContext::get_stats() const {
     stats["n_eval"] = perf.n_eval;
     stats["n_reused"] = perf.n_reused;
     stats["n_ctx"] = static_cast<int64_t>(llama_n_ctx(native_context));
+    stats["n_seq_max"] = static_cast<int64_t>(llama_n_seq_max(native_context));
+    stats["n_batch"] = static_cast<int64_t>(llama_n_batch(native_context));
+    stats["n_ubatch"] = static_cast<int64_t>(llama_n_ubatch(native_context));
+    stats["autotuned"] = autotuned;
+    stats["n_threads"] = applied_n_threads;
+    stats["n_threads_batch"] = applied_n_threads_batch;
+    stats["phrase_rewinds"] = phrase_rewinds;
+    stats["phrase_blocked_tokens"] = phrase_blocked_tokens;
+    stats["lookup_drafted_tokens"] = lookup_drafted_tokens;
+    stats["lookup_accepted_tokens"] = lookup_accepted_tokens;
+    stats["lookup_acceptance"] = lookup_drafted_tokens > 0 ? static_cast<double>(lookup_accepted_tokens) / static_cast<double>(lookup_drafted_tokens) : 0.0;
+    stats["t_sample_ms"] = static_cast<double>(sample_usec) / 1000.0;
+    stats["n_sample"] = sampled_tokens;
+    sequence_cache.append_stats(stats);
+    stats.merge(last_batch_stats, true);
+    if (result_cache.is_valid()) {
+        const Dictionary cache_stats = result_cache->get_stats();
+        stats["result_cache_hits"] = cache_stats["hits"];
+        stats["result_cache_misses"] = cache_stats["misses"];
+        stats["result_cache_hit_rate"] = cache_stats["hit_rate"];
+        stats["result_cache_entries"] = cache_stats["entries"];
+        stats["result_cache_bytes"] = cache_stats["bytes"];
+    }
+    stats["state_async_saves"] = state_async_saves;
+    stats["state_async_loads"] = state_async_loads;
+    stats["state_last_snapshot_ms"] = state_last_snapshot_ms;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        stats["state_pending_jobs"] = static_cast<int64_t>(state_jobs.size());
+    }
     return stats;
 }
 
+Dictionary LlamaContext::get_global_metrics() {
+    return LlamaMetrics::get_snapshot();
+}
+
 PackedByteArray LlamaContext::save_state() {
+    if (_fail_if_serving("save_state")) {
+        return PackedByteArray();
+    }
     PackedByteArray state;
     if (!_is_ready()) {
         return state;
@@ -503,6 +1099,9 @@ PackedByteArray LlamaContext::save_state() {
 }
 
 Error LlamaContext::load_state(const PackedByteArray &p_state) {
+    if (_fail_if_serving("load_state")) {
+        return ERR_BUSY;
+    }
     if (!_is_ready()) {
         return ERR_UNCONFIGURED;
     }
@@ -519,12 +1118,14 @@ Error LlamaContext::load_state(const PackedByteArray &p_state) {
     if (native_sampler != nullptr) {
         llama_sampler_reset(native_sampler);
     }
-    const llama_pos pos_max = llama_memory_seq_pos_max(llama_get_memory(native_context), 0);
-    decode_pos = pos_max >= 0 ? (pos_max + 1) : 0;
+    _adopt_loaded_state();
     return OK;
 }
 
 Error LlamaContext::save_state_file(const String &p_path) {
+    if (_fail_if_serving("save_state_file")) {
+        return ERR_BUSY;
+    }
     if (!_is_ready()) {
         return ERR_UNCONFIGURED;
     }
@@ -535,6 +1136,9 @@ Error LlamaContext::save_state_file(const String &p_path) {
 }
 
 Error LlamaContext::load_state_file(const String &p_path) {
+    if (_fail_if_serving("load_state_file")) {
+        return ERR_BUSY;
+    }
     if (!_is_ready()) {
         return ERR_UNCONFIGURED;
     }
@@ -548,11 +1152,262 @@ Error LlamaContext::load_state_file(const String &p_path) {
     if (native_sampler != nullptr) {
         llama_sampler_reset(native_sampler);
     }
+    _adopt_loaded_state();
+    return OK;
+}
+
+Error LlamaContext::save_state_file_async(const String &p_path) {
+    if (_fail_if_serving("save_state_file_async")) {
+        return ERR_BUSY;
+    }
+    if (!_is_ready()) {
+        return ERR_UNCONFIGURED;
+    }
+    const size_t state_size = llama_state_get_size(native_context);
+    if (state_size == 0) {
+        return ERR_CANT_CREATE;
+    }
+
+    int32_t buffer = -1;
+    {
+        std::lock_guard<std::mutex> lock(state_mutex);
+        for (int32_t i = 0; i < 2; i++) {
+            if (!state_buffer_busy[i]) {
+                buffer = i;
+                break;
+            }
+        }
+    }
+    if (buffer < 0) {
+        // One snapshot is being written and the next is already queued.
+        return ERR_BUSY;
+    }
+
+    const uint64_t start_usec = Time::get_singleton()->get_ticks_usec();
+    PackedByteArray &snapshot = state_buffers[buffer];
+    if (snapshot.size() != static_cast<int64_t>(state_size)) {
+        snapshot.resize(static_cast<int64_t>(state_size));
+    }
+    const size_t copied = llama_state_get_data(native_context, snapshot.ptrw(), state_size);
+    if (copied == 0) {
+        return ERR_CANT_CREATE;
+    }
+    if (copied < state_size) {
+        snapshot.resize(static_cast<int64_t>(copied));
+    }
+    state_last_snapshot_ms = static_cast<double>(Time::get_singleton()->get_ticks_usec() - start_usec) / 1000.0;
+
+    StateJob job;
+    job.path = p_path;
+    job.fingerprint = _state_fingerprint();
+    job.buffer = buffer;
+    _queue_state_job(std::move(job));
+    state_async_saves++;
+    return OK;
+}
+
+Error LlamaContext::load_state_file_async(const String &p_path) {
+    if (_fail_if_serving("load_state_file_async")) {
+        return ERR_BUSY;
+    }
+    if (!_is_ready()) {
+        return ERR_UNCONFIGURED;
+    }
+    if (state_load_pending) {
+        return ERR_BUSY;
+    }
+
+    StateJob job;
+    job.load = true;
+    job.path = p_path;
+    job.fingerprint = _state_fingerprint();
+    state_load_pending = true;
+    _queue_state_job(std::move(job));
+    state_async_loads++;
+    return OK;
+}
+
+String LlamaContext::_state_fingerprint() const {
+    const struct llama_model *native_model = model->get_native_model();
+    char desc[256] = {};
+    llama_model_desc(native_model, desc, sizeof(desc));
+    return vformat("%d|%d|%d|%s",
+            static_cast<int64_t>(llama_model_size(native_model)),
+            static_cast<int64_t>(llama_model_n_params(native_model)),
+            static_cast<int64_t>(llama_n_ctx(native_context)),
+            String::utf8(desc));
+}
+
+void LlamaContext::_queue_state_job(StateJob &&p_job) {
+    std::lock_guard<std::mutex> lock(state_mutex);
+    if (!p_job.load) {
+        state_buffer_busy[p_job.buffer] = true;
+    }
+    state_jobs.push_back(std::move(p_job));
+    if (state_thread_running) {
+        return;
+    }
+    // The previous worker already left its loop; joining it cannot block.
+    if (state_thread.is_null()) {
+        state_thread.instantiate();
+    } else if (state_thread->is_started()) {
+        state_thread->wait_to_finish();
+    }
+    state_thread_running = true;
+    state_thread->start(callable_mp(this, &LlamaContext::_state_thread_entry));
+}
+
+void LlamaContext::_state_thread_entry() {
+    while (true) {
+        StateJob job;
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            if (state_jobs.empty()) {
+                state_thread_running = false;
+                return;
+            }
+            job = state_jobs.front();
+        }
+
+        const Error err = job.load ? LlamaStateFile::read(job.path, job.fingerprint, state_load_buffer)
+                                   : LlamaStateFile::write(job.path, job.fingerprint, state_buffers[job.buffer]);
+        {
+            std::lock_guard<std::mutex> lock(state_mutex);
+            state_jobs.pop_front();
+            if (!job.load) {
+                state_buffer_busy[job.buffer] = false;
+            }
+        }
+        callable_mp(this, &LlamaContext::_finish_state_job).call_deferred(job.load, job.path, static_cast<int64_t>(err));
+    }
+}
+
+void LlamaContext::_finish_state_job(bool p_load, const String &p_path, int64_t p_error) {
+    Error err = static_cast<Error>(p_error);
+    if (!p_load) {
+        emit_signal("state_saved", p_path, static_cast<int64_t>(err));
+        return;
+    }
+
+    if (err == OK) {
+        err = serving ? ERR_BUSY : load_state(state_load_buffer);
+    }
+    state_load_buffer = PackedByteArray();
+    state_load_pending = false;
+    emit_signal("state_loaded", p_path, static_cast<int64_t>(err));
+}
+
+std::string LlamaContext::_result_cache_key(const std::vector<int32_t> &p_prompt_tokens, const LlamaGenerationParams &p_params) const {
+    std::string key;
+    const CharString identity = vformat("%s|%s|%d", model->get_identity(), applied_lora_key, static_cast<int64_t>(llama_n_ctx_seq(native_context))).utf8();
+    key.reserve(static_cast<size_t>(identity.length()) + p_prompt_tokens.size() * sizeof(int32_t) + 64);
+    key.append(identity.get_data(), static_cast<size_t>(identity.length()));
+    key.push_back('\0');
+    key.append(reinterpret_cast<const char *>(p_prompt_tokens.data()), p_prompt_tokens.size() * sizeof(int32_t));
+    key.push_back('\0');
+    p_params.append_cache_key(key);
+    return key;
+}
+
+void LlamaContext::_adopt_loaded_state() {
+    // A whole-context state replaces every sequence; it is re-attached as the
+    // anonymous conversation and previous conversation mappings are dropped.
+    sequence_cache.clear_resident();
+    active_seq = 0;
     const llama_pos pos_max = llama_memory_seq_pos_max(llama_get_memory(native_context), 0);
-    decode_pos = pos_max >= 0 ? (pos_max + 1) : 0;
+    if (pos_max >= 0) {
+        sequence_cache.adopt(0, String(), pos_max + 1);
+    }
+    _update_kv_metric();
+}
+
+bool LlamaContext::drop_conversation(const String &p_conversation) {
+    if (_fail_if_serving("drop_conversation")) {
+        return false;
+    }
+    if (native_context == nullptr) {
+        return false;
+    }
+    return sequence_cache.drop(p_conversation);
+}
+
+bool LlamaContext::evict_conversation(const String &p_conversation) {
+    if (_fail_if_serving("evict_conversation")) {
+        return false;
+    }
+    if (native_context == nullptr) {
+        return false;
+    }
+    return sequence_cache.evict_conversation(p_conversation);
+}
+
+bool LlamaContext::has_conversation(const String &p_conversation) const {
+    return sequence_cache.has(p_conversation);
+}
+
+PackedStringArray LlamaContext::get_conversation_ids() const {
+    return sequence_cache.get_conversation_ids();
+}
+
+int LlamaContext::get_conversation_length(const String &p_conversation) const {
+    return sequence_cache.get_length(p_conversation);
+}
+
+Error LlamaContext::truncate_conversation(const String &p_conversation, int p_length) {
+    if (_fail_if_serving("truncate_conversation")) {
+        return ERR_BUSY;
+    }
+    if (native_context == nullptr) {
+        return ERR_UNCONFIGURED;
+    }
+    if (!sequence_cache.has(p_conversation)) {
+        return p_length <= 0 ? OK : ERR_DOES_NOT_EXIST;
+    }
+    String acquire_error;
+    const int32_t seq = sequence_cache.acquire(p_conversation, 0, acquire_error);
+    if (seq < 0) {
+        UtilityFunctions::push_error("godot_llama: ", acquire_error);
+        return ERR_CANT_ACQUIRE_RESOURCE;
+    }
+    sequence_cache.truncate(seq, p_length);
     return OK;
 }
 
+Error LlamaContext::remove_conversation_range(const String &p_conversation, int p_from, int p_to) {
+    if (_fail_if_serving("remove_conversation_range")) {
+        return ERR_BUSY;
+    }
+    if (native_context == nullptr) {
+        return ERR_UNCONFIGURED;
+    }
+    if (!sequence_cache.has(p_conversation)) {
+        return ERR_DOES_NOT_EXIST;
+    }
+    String acquire_error;
+    const int32_t seq = sequence_cache.acquire(p_conversation, 0, acquire_error);
+    if (seq < 0) {
+        UtilityFunctions::push_error("godot_llama: ", acquire_error);
+        return ERR_CANT_ACQUIRE_RESOURCE;
+    }
+    return sequence_cache.remove_range(seq, p_from, p_to) ? OK : ERR_UNAVAILABLE;
+}
+
+void LlamaContext::set_result_cache(const Ref<LlamaResultCache> &p_cache) {
+    result_cache = p_cache;
+}
+
+Ref<LlamaResultCache> LlamaContext::get_result_cache() const {
+    return result_cache;
+}
+
+void LlamaContext::set_thread_governor(const Ref<LlamaThreadGovernor> &p_governor) {
+    thread_governor = p_governor;
+}
+
+Ref<LlamaThreadGovernor> LlamaContext::get_thread_governor() const {
+    return thread_governor;
+}
+
 Ref<LlamaModel> LlamaContext::get_model() const {
     return model;
 }
@@ -564,3 +1419,7 @@ String LlamaContext::get_prompt() const {
 bool LlamaContext::is_initialized() const {
     return native_context != nullptr;
 }
+
+int32_t LlamaContext::get_n_ctx_seq() const {
+    return native_context != nullptr ? static_cast<int32_t>(llama_n_ctx_seq(native_context)) : 0;
+}
@@ -1,14 +1,31 @@
 #ifndef GODOT_LLAMA_CONTEXT_H
 #define GODOT_LLAMA_CONTEXT_H
 
+#include "llama_batch_scheduler.h"
+#include "llama_generation_params.h"
+#include "llama_json_stream.h"
+#include "llama_metrics.h"
 #include "llama_model.h"
+#include "llama_phrase_filter.h"
+#include "llama_result_cache.h"
+#include "llama_sequence_cache.h"
+#include "llama_thread_governor.h"
 
 #include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/thread.hpp>
+#include <godot_cpp/variant/array.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/string.hpp>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
 #include <vector>
 
+struct llama_adapter_lora;
 struct llama_context;
 struct llama_sampler;
 
@@ -20,18 +37,80 @@ class LlamaContext : public RefCounted {
 private:
     struct llama_context *native_context = nullptr;
     struct llama_sampler *native_sampler = nullptr;
-    int32_t decode_pos = 0;
+    LlamaSequenceCache sequence_cache;
+    int32_t active_seq = 0;
     String last_decode_error;
 
     Ref<LlamaModel> model;
     String prompt;
     bool cancel_requested = false;
+    Dictionary lora_scales;
+    std::vector<std::pair<struct llama_adapter_lora *, float>> applied_loras;
+    String applied_lora_key;
+    Ref<LlamaResultCache> result_cache;
+    PackedInt32Array last_tokens;
+    Ref<LlamaThreadGovernor> thread_governor;
+    int32_t base_n_threads = 1;
+    int32_t base_n_threads_batch = 1;
+    int32_t applied_n_threads = 1;
+    int32_t applied_n_threads_batch = 1;
+    uint64_t last_decode_end_usec = 0;
+    bool autotuned = false;
+    Dictionary last_batch_stats;
+    bool serving = false;
+    std::shared_ptr<LlamaPhraseFilterState> phrase_filter_state;
+    int64_t phrase_rewinds = 0;
+    int64_t phrase_blocked_tokens = 0;
+    int64_t lookup_drafted_tokens = 0;
+    int64_t lookup_accepted_tokens = 0;
+    int64_t sample_usec = 0;
+    int64_t sampled_tokens = 0;
+    LlamaMetrics::Contribution metric_contexts{ LlamaMetrics::GAUGE_CONTEXTS };
+    LlamaMetrics::Contribution metric_kv_cells_used{ LlamaMetrics::GAUGE_KV_CELLS_USED };
+    LlamaMetrics::Contribution metric_kv_cells_total{ LlamaMetrics::GAUGE_KV_CELLS_TOTAL };
+    LlamaMetrics::Contribution metric_context_bytes{ LlamaMetrics::GAUGE_CONTEXT_BYTES };
+
+    struct StateJob {
+        bool load = false;
+        String path;
+        String fingerprint;
+        int32_t buffer = -1;
+    };
+
+    // Async state files: a save snapshots into whichever of the two buffers
+    // the worker is not writing, so the caller only pays for the copy. Loads
+    // read on the worker and apply on the main thread once complete.
+    Ref<Thread> state_thread;
+    mutable std::mutex state_mutex;
+    std::deque<StateJob> state_jobs;
+    bool state_thread_running = false;
+    PackedByteArray state_buffers[2];
+    bool state_buffer_busy[2] = { false, false };
+    PackedByteArray state_load_buffer;
+    bool state_load_pending = false;
+    int64_t state_async_saves = 0;
+    int64_t state_async_loads = 0;
+    double state_last_snapshot_ms = 0.0;
 
     bool _is_ready() const;
     void _emit_error(const String &p_message) const;
-    String _generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming);
-    bool _decode_tokens(const std::vector<int32_t> &p_tokens);
+    // Pushes an error and returns true while a LlamaServer drives the context
+    // from its own thread.
+    bool _fail_if_serving(const char *p_method) const;
+    String _generate_internal(int p_max_tokens, const Dictionary &p_params, bool p_streaming, const PackedInt32Array *p_prompt_tokens = nullptr);
+    bool _decode_tokens(const std::vector<int32_t> &p_tokens, bool p_all_logits = false);
+    void _govern_decode();
+    void _update_kv_metric();
     String _token_to_piece(int32_t p_token) const;
+    std::string _token_to_bytes(int32_t p_token) const;
+    void _emit_json_fields(LlamaJsonStream &r_stream, int32_t p_token);
+    bool _apply_loras(const Variant &p_selection);
+    void _adopt_loaded_state();
+    String _state_fingerprint() const;
+    void _queue_state_job(StateJob &&p_job);
+    void _state_thread_entry();
+    void _finish_state_job(bool p_load, const String &p_path, int64_t p_error);
+    std::string _result_cache_key(const std::vector<int32_t> &p_prompt_tokens, const LlamaGenerationParams &p_params) const;
 
 protected:
     static void _bind_methods();
@@ -45,16 +124,46 @@ public:
     void set_prompt(const String &p_prompt);
     String generate(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
     void generate_stream(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    String generate_tokens(const PackedInt32Array &p_tokens, int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    void generate_tokens_stream(const PackedInt32Array &p_tokens, int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    PackedInt32Array get_last_tokens() const;
+    Array generate_batch(const Array &p_requests, const Dictionary &p_params = Dictionary());
+    String generate_continuation(const PackedInt32Array &p_tokens, int p_max_tokens, const Dictionary &p_params, bool p_streaming);
     void cancel();
+    Error set_lora(const String &p_name, float p_scale = 1.0f);
+    void clear_loras();
+    Dictionary get_loras() const;
+    bool drop_conversation(const String &p_conversation);
+    bool evict_conversation(const String &p_conversation);
+    bool has_conversation(const String &p_conversation) const;
+    PackedStringArray get_conversation_ids() const;
+    int get_conversation_length(const String &p_conversation) const;
+    Error truncate_conversation(const String &p_conversation, int p_length);
+    Error remove_conversation_range(const String &p_conversation, int p_from, int p_to);
+    void set_result_cache(const Ref<LlamaResultCache> &p_cache);
+    Ref<LlamaResultCache> get_result_cache() const;
+    void set_thread_governor(const Ref<LlamaThreadGovernor> &p_governor);
+    Ref<LlamaThreadGovernor> get_thread_governor() const;
     Dictionary get_stats() const;
+    static Dictionary get_global_metrics();
     PackedByteArray save_state();
     Error load_state(const PackedByteArray &p_state);
     Error save_state_file(const String &p_path);
     Error load_state_file(const String &p_path);
+    Error save_state_file_async(const String &p_path);
+    Error load_state_file_async(const String &p_path);
+
+    // Hooks for LlamaServer, which drives a batch scheduler on its own thread.
+    // While serving, the generate calls on this context refuse to run.
+    bool begin_batch(LlamaBatchScheduler &r_scheduler, const Dictionary &p_params);
+    void make_batch_request(const Variant &p_item, const Dictionary &p_params, int64_t p_index, LlamaBatchScheduler::Request &r_request) const;
+    void set_serving(bool p_serving);
+    bool is_serving() const;
 
     Ref<LlamaModel> get_model() const;
     String get_prompt() const;
     bool is_initialized() const;
+    int32_t get_n_ctx_seq() const;
 };
 
 } // namespace godot
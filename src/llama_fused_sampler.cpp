@@ -0,0 +1,288 @@
+#include "llama_fused_sampler.h"
+
+#include "llama_generation_params.h"
+
+#include <llama.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GODOT_LLAMA_FUSED_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GODOT_LLAMA_FUSED_NEON
+#endif
+
+using namespace godot;
+
+namespace {
+
+// exp(-30) is about 1e-13, so even 256k tokens sitting right at the edge of
+// the window would add less than 3e-8 to the total probability.
+constexpr float FUSED_LOGIT_WINDOW = 30.0f;
+// Candidates buffered before a top-k selection raises the floor.
+constexpr size_t FUSED_MIN_BUFFER = 256;
+
+static_assert(sizeof(llama_token_data) == 3 * sizeof(float), "llama_token_data is expected to be {id, logit, p}");
+
+// Bit j is set when the logit of p_data[j] reaches p_floor, for j < 4.
+int _fused_block_mask(const llama_token_data *p_data, float p_floor) {
+#if defined(GODOT_LLAMA_FUSED_SSE2)
+    const __m128 logits = _mm_setr_ps(p_data[0].logit, p_data[1].logit, p_data[2].logit, p_data[3].logit);
+    return _mm_movemask_ps(_mm_cmpge_ps(logits, _mm_set1_ps(p_floor)));
+#elif defined(GODOT_LLAMA_FUSED_NEON)
+    // De-interleaves four {id, logit, p} records; val[1] holds the logits.
+    const float32x4x3_t fields = vld3q_f32(reinterpret_cast<const float *>(p_data));
+    const uint32x4_t hits = vcgeq_f32(fields.val[1], vdupq_n_f32(p_floor));
+    if (vmaxvq_u32(hits) == 0) {
+        return 0;
+    }
+    static const uint32_t lane_bits[4] = { 1, 2, 4, 8 };
+    return static_cast<int>(vaddvq_u32(vandq_u32(hits, vld1q_u32(lane_bits))));
+#else
+    int mask = 0;
+    for (int j = 0; j < 4; j++) {
+        if (p_data[j].logit >= p_floor) {
+            mask |= 1 << j;
+        }
+    }
+    return mask;
+#endif
+}
+
+const char *_fused_sampler_name(const struct llama_sampler *) {
+    return "godot_llama.fused";
+}
+
+void _fused_sampler_accept(struct llama_sampler *p_sampler, llama_token p_token) {
+    static_cast<LlamaFusedSampler *>(p_sampler->ctx)->accept(p_token);
+}
+
+void _fused_sampler_apply(struct llama_sampler *p_sampler, llama_token_data_array *r_cur) {
+    static_cast<LlamaFusedSampler *>(p_sampler->ctx)->apply(r_cur);
+}
+
+void _fused_sampler_reset(struct llama_sampler *p_sampler) {
+    static_cast<LlamaFusedSampler *>(p_sampler->ctx)->reset();
+}
+
+void _fused_sampler_free(struct llama_sampler *p_sampler) {
+    delete static_cast<LlamaFusedSampler *>(p_sampler->ctx);
+}
+
+} // namespace
+
+LlamaFusedSampler::LlamaFusedSampler(const LlamaGenerationParams &p_params) :
+        top_k(p_params.top_k),
+        top_p(p_params.top_p),
+        min_p(p_params.min_p),
+        temperature(p_params.temperature),
+        repeat_penalty(p_params.repeat_penalty),
+        frequency_penalty(p_params.frequency_penalty),
+        presence_penalty(p_params.presence_penalty),
+        penalty_last_n(p_params.uses_penalties() ? std::max(0, p_params.penalty_last_n) : 0),
+        seed(p_params.seed),
+        rng(p_params.seed) {
+    // Truncation happens before temperature in the chain, but a hot
+    // temperature flattens whatever survives, so the window widens with it.
+    logit_window = FUSED_LOGIT_WINDOW * std::max(1.0f, temperature);
+    // Without penalties a greedy pick is the arg-max, whatever the cutoffs.
+    if (temperature <= 0.0f && penalty_last_n == 0) {
+        top_k = 1;
+    }
+}
+
+bool LlamaFusedSampler::_candidate_before(const Candidate &p_a, const Candidate &p_b) {
+    return p_a.logit > p_b.logit || (p_a.logit == p_b.logit && p_a.index < p_b.index);
+}
+
+void LlamaFusedSampler::_collect(const llama_token_data_array *p_cur) {
+    candidates.clear();
+    const llama_token_data *data = p_cur->data;
+    const size_t size = p_cur->size;
+    const size_t keep = top_k > 0 ? static_cast<size_t>(top_k) : 0;
+    const size_t buffer_limit = keep > 0 ? std::max(FUSED_MIN_BUFFER, keep * 4) : 0;
+
+    // Both only ever rise, so a token rejected earlier stays rejected.
+    float max_logit = -std::numeric_limits<float>::infinity();
+    float floor = -std::numeric_limits<float>::infinity();
+    auto take = [&](size_t p_index) {
+        const float logit = data[p_index].logit;
+        if (logit < floor) {
+            return;
+        }
+        candidates.push_back({ logit, static_cast<int32_t>(p_index) });
+        if (logit > max_logit) {
+            max_logit = logit;
+            floor = std::max(floor, max_logit - logit_window);
+        }
+        if (buffer_limit > 0 && candidates.size() >= buffer_limit) {
+            std::nth_element(candidates.begin(), candidates.begin() + (keep - 1), candidates.end(), _candidate_before);
+            candidates.resize(keep);
+            floor = std::max(floor, candidates[keep - 1].logit);
+        }
+    };
+
+    size_t i = 0;
+    for (; i + 4 <= size; i += 4) {
+        const int mask = _fused_block_mask(data + i, floor);
+        if (mask == 0) {
+            continue;
+        }
+        for (int j = 0; j < 4; j++) {
+            if ((mask & (1 << j)) != 0) {
+                take(i + j);
+            }
+        }
+    }
+    for (; i < size; i++) {
+        if (data[i].logit >= floor) {
+            take(i);
+        }
+    }
+
+    // Early candidates were admitted against a lower floor.
+    const float final_floor = max_logit - logit_window;
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [final_floor](const Candidate &p_candidate) {
+        return p_candidate.logit < final_floor;
+    }),
+            candidates.end());
+    if (keep > 0 && candidates.size() > keep) {
+        std::nth_element(candidates.begin(), candidates.begin() + (keep - 1), candidates.end(), _candidate_before);
+        candidates.resize(keep);
+    }
+}
+
+void LlamaFusedSampler::_apply_penalties(const llama_token_data_array *p_cur) {
+    if (penalty_last_n == 0 || token_counts.empty()) {
+        return;
+    }
+    for (Candidate &candidate : candidates) {
+        auto it = token_counts.find(p_cur->data[candidate.index].id);
+        if (it == token_counts.end()) {
+            continue;
+        }
+        // Same formula as llama_sampler_init_penalties().
+        candidate.logit = candidate.logit <= 0.0f ? candidate.logit * repeat_penalty : candidate.logit / repeat_penalty;
+        candidate.logit -= static_cast<float>(it->second) * frequency_penalty + presence_penalty;
+    }
+}
+
+void LlamaFusedSampler::apply(llama_token_data_array *r_cur) {
+    if (r_cur->size == 0) {
+        return;
+    }
+    _collect(r_cur);
+    if (candidates.empty()) {
+        // Only NaN logits fail every comparison.
+        r_cur->selected = 0;
+        return;
+    }
+
+    // top_p normalizes over what top_k kept, as llama_sampler_top_p does.
+    if (top_p < 1.0f) {
+        float max_logit = candidates[0].logit;
+        for (const Candidate &candidate : candidates) {
+            max_logit = std::max(max_logit, candidate.logit);
+        }
+        float sum = 0.0f;
+        for (const Candidate &candidate : candidates) {
+            sum += std::exp(candidate.logit - max_logit);
+        }
+        // Only the nucleus needs to be in order, and with top_k 0 it is
+        // usually a tiny prefix of many candidates, so sort in growing steps.
+        const float target = top_p * sum;
+        float cumulative = 0.0f;
+        size_t sorted = 0;
+        size_t step = 64;
+        size_t keep = candidates.size();
+        while (sorted < candidates.size() && keep == candidates.size()) {
+            const size_t end = std::min(candidates.size(), sorted + step);
+            std::partial_sort(candidates.begin() + sorted, candidates.begin() + end, candidates.end(), _candidate_before);
+            for (size_t i = sorted; i < end; i++) {
+                cumulative += std::exp(candidates[i].logit - max_logit);
+                if (cumulative >= target) {
+                    keep = i + 1;
+                    break;
+                }
+            }
+            sorted = end;
+            step *= 4;
+        }
+        candidates.resize(keep);
+    }
+    if (min_p > 0.0f && candidates.size() > 1) {
+        float max_logit = candidates[0].logit;
+        for (const Candidate &candidate : candidates) {
+            max_logit = std::max(max_logit, candidate.logit);
+        }
+        const float min_logit = max_logit + std::log(min_p);
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [min_logit](const Candidate &p_candidate) {
+            return p_candidate.logit < min_logit;
+        }),
+                candidates.end());
+    }
+    _apply_penalties(r_cur);
+
+    size_t best = 0;
+    for (size_t i = 1; i < candidates.size(); i++) {
+        if (_candidate_before(candidates[i], candidates[best])) {
+            best = i;
+        }
+    }
+    if (temperature > 0.0f && candidates.size() > 1) {
+        const float max_logit = candidates[best].logit;
+        probs.resize(candidates.size());
+        float sum = 0.0f;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            probs[i] = std::exp((candidates[i].logit - max_logit) / temperature);
+            sum += probs[i];
+        }
+        const float draw = std::uniform_real_distribution<float>(0.0f, sum)(rng);
+        float cumulative = 0.0f;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            cumulative += probs[i];
+            if (draw < cumulative) {
+                best = i;
+                break;
+            }
+        }
+    }
+    r_cur->selected = candidates[best].index;
+}
+
+void LlamaFusedSampler::accept(int32_t p_token) {
+    if (penalty_last_n == 0) {
+        return;
+    }
+    if (history.size() < static_cast<size_t>(penalty_last_n)) {
+        history.push_back(p_token);
+    } else {
+        auto it = token_counts.find(history[history_next]);
+        if (it != token_counts.end() && --it->second == 0) {
+            token_counts.erase(it);
+        }
+        history[history_next] = p_token;
+        history_next = (history_next + 1) % history.size();
+    }
+    token_counts[p_token]++;
+}
+
+void LlamaFusedSampler::reset() {
+    history.clear();
+    history_next = 0;
+    token_counts.clear();
+    rng.seed(seed);
+}
+
+struct llama_sampler *LlamaFusedSampler::create(const LlamaGenerationParams &p_params) {
+    static llama_sampler_i iface = {};
+    iface.name = _fused_sampler_name;
+    iface.accept = _fused_sampler_accept;
+    iface.apply = _fused_sampler_apply;
+    iface.reset = _fused_sampler_reset;
+    iface.free = _fused_sampler_free;
+    return llama_sampler_init(&iface, new LlamaFusedSampler(p_params));
+}
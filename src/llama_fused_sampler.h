@@ -0,0 +1,67 @@
+#ifndef GODOT_LLAMA_FUSED_SAMPLER_H
+#define GODOT_LLAMA_FUSED_SAMPLER_H
+
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+struct llama_sampler;
+struct llama_token_data_array;
+
+namespace godot {
+
+struct LlamaGenerationParams;
+
+// Replaces the top_k -> top_p -> min_p -> penalties -> temp -> dist chain
+// with one stage. A single scan over the vocabulary keeps only tokens that
+// can still survive truncation; every later step runs on those few
+// candidates instead of re-walking the full array.
+//
+// Tokens more than a window of logits below the best one are never kept.
+// Their combined probability is far below float precision for any real
+// vocabulary, so the result matches the chain except for the random draw
+// itself, which uses its own generator.
+class LlamaFusedSampler {
+    struct Candidate {
+        float logit = 0.0f;
+        int32_t index = 0;
+    };
+
+    int32_t top_k = 40;
+    float top_p = 0.9f;
+    float min_p = 0.0f;
+    float temperature = 0.7f;
+    float repeat_penalty = 1.0f;
+    float frequency_penalty = 0.0f;
+    float presence_penalty = 0.0f;
+    int32_t penalty_last_n = 0;
+    uint32_t seed = 0;
+    float logit_window = 0.0f;
+
+    std::mt19937 rng;
+    // Ring of the last penalty_last_n accepted tokens and their counts.
+    std::vector<int32_t> history;
+    size_t history_next = 0;
+    std::unordered_map<int32_t, int32_t> token_counts;
+    std::vector<Candidate> candidates;
+    std::vector<float> probs;
+
+    static bool _candidate_before(const Candidate &p_a, const Candidate &p_b);
+    void _collect(const struct llama_token_data_array *p_cur);
+    void _apply_penalties(const struct llama_token_data_array *p_cur);
+
+public:
+    explicit LlamaFusedSampler(const LlamaGenerationParams &p_params);
+
+    void apply(struct llama_token_data_array *r_cur);
+    void accept(int32_t p_token);
+    void reset();
+
+    // Owned by the returned sampler and freed with it.
+    static struct llama_sampler *create(const LlamaGenerationParams &p_params);
+};
+
+} // namespace godot
+
+#endif
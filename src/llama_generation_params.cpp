@@ -0,0 +1,203 @@
+#include "llama_generation_params.h"
+
+#include "llama_fused_sampler.h"
+
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+
+using namespace godot;
+
+static void _collect_stop_sequences(const Variant &p_stop_value, PackedStringArray &r_stop_sequences) {
+    auto add_stop_sequence = [&r_stop_sequences](const String &p_value) {
+        if (!p_value.is_empty()) {
+            r_stop_sequences.append(p_value);
+        }
+    };
+
+    if (p_stop_value.get_type() == Variant::STRING) {
+        add_stop_sequence(static_cast<String>(p_stop_value));
+        return;
+    }
+    if (p_stop_value.get_type() == Variant::PACKED_STRING_ARRAY) {
+        PackedStringArray values = p_stop_value;
+        for (int i = 0; i < values.size(); i++) {
+            add_stop_sequence(values[i]);
+        }
+        return;
+    }
+    if (p_stop_value.get_type() == Variant::ARRAY) {
+        Array values = p_stop_value;
+        for (int i = 0; i < values.size(); i++) {
+            if (values[i].get_type() == Variant::STRING) {
+                add_stop_sequence(static_cast<String>(values[i]));
+            }
+        }
+    }
+}
+
+template <typename T>
+static void _append_pod(std::string &r_key, const T &p_value) {
+    r_key.append(reinterpret_cast<const char *>(&p_value), sizeof(T));
+}
+
+int LlamaGenerationParams::resolve_max_tokens(const Dictionary &p_params, int p_max_tokens) {
+    return p_params.has("max_tokens") ? static_cast<int>(int64_t(p_params["max_tokens"])) : p_max_tokens;
+}
+
+LlamaGenerationParams LlamaGenerationParams::from_dictionary(const Dictionary &p_params, int p_max_tokens) {
+    LlamaGenerationParams params;
+    params.max_tokens = resolve_max_tokens(p_params, p_max_tokens);
+    params.seed = static_cast<uint32_t>(Time::get_singleton()->get_unix_time_from_system());
+
+    if (p_params.has("temperature")) {
+        params.temperature = static_cast<float>(double(p_params["temperature"]));
+    }
+    if (p_params.has("top_p")) {
+        params.top_p = static_cast<float>(double(p_params["top_p"]));
+    }
+    if (p_params.has("min_p")) {
+        params.min_p = static_cast<float>(double(p_params["min_p"]));
+    }
+    if (p_params.has("top_k")) {
+        params.top_k = static_cast<int32_t>(int64_t(p_params["top_k"]));
+    }
+    if (p_params.has("repeat_penalty")) {
+        params.repeat_penalty = static_cast<float>(double(p_params["repeat_penalty"]));
+    }
+    if (p_params.has("frequency_penalty")) {
+        params.frequency_penalty = static_cast<float>(double(p_params["frequency_penalty"]));
+    }
+    if (p_params.has("presence_penalty")) {
+        params.presence_penalty = static_cast<float>(double(p_params["presence_penalty"]));
+    }
+    if (p_params.has("penalty_last_n")) {
+        params.penalty_last_n = static_cast<int32_t>(int64_t(p_params["penalty_last_n"]));
+    }
+    if (p_params.has("seed")) {
+        params.seed = static_cast<uint32_t>(int64_t(p_params["seed"]));
+        params.has_seed = true;
+    }
+
+    params.temperature = std::max(0.0f, params.temperature);
+    params.top_p = std::clamp(params.top_p, 0.0f, 1.0f);
+    params.min_p = std::clamp(params.min_p, 0.0f, 1.0f);
+    params.top_k = std::max(0, params.top_k);
+    params.penalty_last_n = std::max(-1, params.penalty_last_n);
+
+    if (p_params.has("stop")) {
+        _collect_stop_sequences(p_params["stop"], params.stop_sequences);
+    }
+    if (p_params.has("stop_sequences")) {
+        _collect_stop_sequences(p_params["stop_sequences"], params.stop_sequences);
+    }
+    if (p_params.has("json_stream")) {
+        params.json_stream = bool(p_params["json_stream"]);
+    }
+    if (p_params.has("json_stop")) {
+        params.json_stop = bool(p_params["json_stop"]);
+    }
+    if (p_params.has("lookup_draft")) {
+        params.lookup_draft = std::max<int32_t>(0, static_cast<int32_t>(int64_t(p_params["lookup_draft"])));
+    }
+    if (p_params.has("lookup_ngram")) {
+        params.lookup_ngram = std::max<int32_t>(1, static_cast<int32_t>(int64_t(p_params["lookup_ngram"])));
+    }
+    if (p_params.has("fused_sampler")) {
+        params.fused_sampler = bool(p_params["fused_sampler"]);
+    }
+    if (p_params.has("phrase_filter")) {
+        Object *filter_object = p_params["phrase_filter"];
+        params.phrase_filter = Object::cast_to<LlamaPhraseFilter>(filter_object);
+    }
+    return params;
+}
+
+bool LlamaGenerationParams::uses_penalties() const {
+    return repeat_penalty != 1.0f || frequency_penalty != 0.0f || presence_penalty != 0.0f;
+}
+
+bool LlamaGenerationParams::is_deterministic() const {
+    // With temperature 0 the temp sampler keeps only the arg-max token, so the
+    // dist sampler's seed no longer matters.
+    return has_seed || temperature <= 0.0f;
+}
+
+std::shared_ptr<LlamaPhraseFilterState> LlamaGenerationParams::create_phrase_filter_state(const struct llama_vocab *p_vocab) const {
+    if (phrase_filter.is_null()) {
+        return nullptr;
+    }
+    const std::shared_ptr<const LlamaPhraseSet> phrase_set = phrase_filter->get_phrase_set();
+    if (phrase_set == nullptr) {
+        return nullptr;
+    }
+    if (phrase_set->vocab != p_vocab) {
+        UtilityFunctions::push_warning("godot_llama: phrase_filter was compiled for another model, ignoring it");
+        return nullptr;
+    }
+    return std::make_shared<LlamaPhraseFilterState>(phrase_set, phrase_filter->get_max_backtrack());
+}
+
+struct llama_sampler *LlamaGenerationParams::create_sampler_chain(LlamaPhraseFilterState *p_filter_state) const {
+    llama_sampler_chain_params chain_params = llama_sampler_chain_default_params();
+    llama_sampler *sampler = llama_sampler_chain_init(chain_params);
+    // First, so bans and biases see the full vocabulary before truncation.
+    if (p_filter_state != nullptr) {
+        llama_sampler_chain_add(sampler, p_filter_state->create_sampler());
+    }
+    if (fused_sampler) {
+        llama_sampler_chain_add(sampler, LlamaFusedSampler::create(*this));
+        return sampler;
+    }
+    llama_sampler_chain_add(sampler, llama_sampler_init_top_k(top_k));
+    llama_sampler_chain_add(sampler, llama_sampler_init_top_p(top_p, 1));
+    if (min_p > 0.0f) {
+        llama_sampler_chain_add(sampler, llama_sampler_init_min_p(min_p, 1));
+    }
+    if (uses_penalties()) {
+        llama_sampler_chain_add(sampler, llama_sampler_init_penalties(penalty_last_n, repeat_penalty, frequency_penalty, presence_penalty));
+    }
+    llama_sampler_chain_add(sampler, llama_sampler_init_temp(temperature));
+    llama_sampler_chain_add(sampler, llama_sampler_init_dist(seed));
+    return sampler;
+}
+
+void LlamaGenerationParams::append_cache_key(std::string &r_key) const {
+    _append_pod(r_key, max_tokens);
+    _append_pod(r_key, temperature);
+    _append_pod(r_key, top_p);
+    _append_pod(r_key, min_p);
+    _append_pod(r_key, top_k);
+    _append_pod(r_key, repeat_penalty);
+    _append_pod(r_key, frequency_penalty);
+    _append_pod(r_key, presence_penalty);
+    _append_pod(r_key, penalty_last_n);
+    // Greedy runs are seed-independent, so they share one entry.
+    const uint32_t key_seed = temperature <= 0.0f ? 0 : seed;
+    _append_pod(r_key, key_seed);
+    // The fused sampler draws from its own generator, so seeded sampling
+    // differs from the chain; greedy picks are the same.
+    const uint8_t key_fused = fused_sampler && temperature > 0.0f ? 1 : 0;
+    _append_pod(r_key, key_fused);
+    for (int i = 0; i < stop_sequences.size(); i++) {
+        const CharString stop_utf8 = stop_sequences[i].utf8();
+        const uint32_t len = static_cast<uint32_t>(stop_utf8.length());
+        _append_pod(r_key, len);
+        r_key.append(stop_utf8.get_data(), len);
+    }
+    // Stopping at the end of the JSON value changes the text; field signals do not.
+    const uint8_t key_json_stop = json_stream && json_stop ? 1 : 0;
+    _append_pod(r_key, key_json_stop);
+    const std::shared_ptr<const LlamaPhraseSet> filter_set = phrase_filter.is_valid() ? phrase_filter->get_phrase_set() : nullptr;
+    if (filter_set != nullptr) {
+        const uint64_t filter_hash = filter_set->content_hash;
+        const int32_t filter_backtrack = phrase_filter->get_max_backtrack();
+        const uint8_t filter_text = phrase_filter->get_match_text() ? 1 : 0;
+        _append_pod(r_key, filter_hash);
+        _append_pod(r_key, filter_backtrack);
+        _append_pod(r_key, filter_text);
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef GODOT_LLAMA_GENERATION_PARAMS_H
+#define GODOT_LLAMA_GENERATION_PARAMS_H
+
+#include "llama_phrase_filter.h"
+
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+struct llama_sampler;
+struct llama_vocab;
+
+namespace godot {
+
+// Sampler settings parsed from the params Dictionary accepted by
+// LlamaContext::generate() and friends.
+struct LlamaGenerationParams {
+    int max_tokens = 128;
+    float temperature = 0.7f;
+    float top_p = 0.9f;
+    float min_p = 0.0f;
+    int32_t top_k = 40;
+    float repeat_penalty = 1.0f;
+    float frequency_penalty = 0.0f;
+    float presence_penalty = 0.0f;
+    int32_t penalty_last_n = 64;
+    uint32_t seed = 0;
+    bool has_seed = false;
+    PackedStringArray stop_sequences;
+    bool json_stream = false;
+    bool json_stop = true;
+    Ref<LlamaPhraseFilter> phrase_filter;
+    // Prompt-lookup speculation: tokens drafted per step (0 = off) and the
+    // longest n-gram matched against earlier tokens. Drafts are verified by
+    // the sampler, so they never change the text or the cache key.
+    int32_t lookup_draft = 0;
+    int32_t lookup_ngram = 3;
+    // Runs top_k, top_p, min_p, penalties and temperature as one
+    // LlamaFusedSampler stage instead of the llama.cpp chain.
+    bool fused_sampler = false;
+
+    static LlamaGenerationParams from_dictionary(const Dictionary &p_params, int p_max_tokens);
+    // params["max_tokens"] when given, else p_max_tokens. Callers that size a
+    // prompt around the reply must use this, not their own argument.
+    static int resolve_max_tokens(const Dictionary &p_params, int p_max_tokens);
+
+    bool uses_penalties() const;
+    bool is_deterministic() const;
+    // Null when no compiled filter applies to this vocabulary.
+    std::shared_ptr<LlamaPhraseFilterState> create_phrase_filter_state(const struct llama_vocab *p_vocab) const;
+    struct llama_sampler *create_sampler_chain(LlamaPhraseFilterState *p_filter_state = nullptr) const;
+    void append_cache_key(std::string &r_key) const;
+};
+
+} // namespace godot
+
+#endif
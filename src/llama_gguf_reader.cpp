@@ -0,0 +1,460 @@
+#include "llama_gguf_reader.h"
+
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <ggml.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+using namespace godot;
+
+namespace {
+
+constexpr uint32_t GGUF_MAGIC = 0x46554747; // "GGUF" read as little-endian u32.
+constexpr size_t GGUF_READ_CHUNK = 64 * 1024;
+constexpr uint64_t GGUF_MAX_STRING = 64 * 1024 * 1024;
+constexpr uint32_t GGUF_MAX_DIMS = 8;
+constexpr uint64_t GGUF_MAX_INLINE_ARRAY = 16;
+// Smallest tensor info: name length, n_dims, type and offset, no dims.
+constexpr uint64_t GGUF_MIN_TENSOR_INFO = 8 + 4 + 4 + 8;
+
+enum GGUFValueType : uint32_t {
+    GGUF_VALUE_UINT8 = 0,
+    GGUF_VALUE_INT8 = 1,
+    GGUF_VALUE_UINT16 = 2,
+    GGUF_VALUE_INT16 = 3,
+    GGUF_VALUE_UINT32 = 4,
+    GGUF_VALUE_INT32 = 5,
+    GGUF_VALUE_FLOAT32 = 6,
+    GGUF_VALUE_BOOL = 7,
+    GGUF_VALUE_STRING = 8,
+    GGUF_VALUE_ARRAY = 9,
+    GGUF_VALUE_UINT64 = 10,
+    GGUF_VALUE_INT64 = 11,
+    GGUF_VALUE_FLOAT64 = 12,
+};
+
+size_t _gguf_scalar_size(uint32_t p_type) {
+    switch (p_type) {
+        case GGUF_VALUE_UINT8:
+        case GGUF_VALUE_INT8:
+        case GGUF_VALUE_BOOL:
+            return 1;
+        case GGUF_VALUE_UINT16:
+        case GGUF_VALUE_INT16:
+            return 2;
+        case GGUF_VALUE_UINT32:
+        case GGUF_VALUE_INT32:
+        case GGUF_VALUE_FLOAT32:
+            return 4;
+        case GGUF_VALUE_UINT64:
+        case GGUF_VALUE_INT64:
+        case GGUF_VALUE_FLOAT64:
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+} // namespace
+
+bool LlamaGGUFReader::_fail(const String &p_message) {
+    if (error.is_empty()) {
+        error = p_message;
+    }
+    return false;
+}
+
+bool LlamaGGUFReader::_fill(size_t p_min_bytes) {
+    const size_t available = buffer_len - buffer_pos;
+    if (available >= p_min_bytes) {
+        return true;
+    }
+
+    if (buffer_pos > 0 && available > 0) {
+        std::memmove(buffer.data(), buffer.data() + buffer_pos, available);
+    }
+    buffer_len = available;
+    buffer_pos = 0;
+
+    const size_t wanted = std::max(p_min_bytes, GGUF_READ_CHUNK);
+    if (buffer.size() < wanted) {
+        buffer.resize(wanted);
+    }
+
+    const uint64_t file_remaining = file_length - file->get_position();
+    const size_t to_read = static_cast<size_t>(std::min<uint64_t>(buffer.size() - buffer_len, file_remaining));
+    if (to_read > 0) {
+        const PackedByteArray chunk = file->get_buffer(static_cast<int64_t>(to_read));
+        std::memcpy(buffer.data() + buffer_len, chunk.ptr(), static_cast<size_t>(chunk.size()));
+        buffer_len += static_cast<size_t>(chunk.size());
+    }
+
+    if (buffer_len < p_min_bytes) {
+        return _fail("unexpected end of file");
+    }
+    return true;
+}
+
+bool LlamaGGUFReader::_read_bytes(void *r_dst, size_t p_size) {
+    if (!_fill(p_size)) {
+        return false;
+    }
+    std::memcpy(r_dst, buffer.data() + buffer_pos, p_size);
+    buffer_pos += p_size;
+    consumed += p_size;
+    return true;
+}
+
+bool LlamaGGUFReader::_skip(uint64_t p_size) {
+    const size_t available = buffer_len - buffer_pos;
+    if (p_size <= available) {
+        buffer_pos += static_cast<size_t>(p_size);
+        consumed += p_size;
+        return true;
+    }
+
+    // Large skips (token score arrays etc.) bypass the buffer entirely.
+    // Compared without adding, so a size near 2^64 cannot wrap backwards.
+    if (p_size > file_length - consumed) {
+        return _fail("unexpected end of file");
+    }
+    const uint64_t target = consumed + p_size;
+    file->seek(target);
+    buffer_pos = 0;
+    buffer_len = 0;
+    consumed = target;
+    return true;
+}
+
+bool LlamaGGUFReader::_read_u32(uint32_t &r_value) {
+    uint8_t bytes[4];
+    if (!_read_bytes(bytes, sizeof(bytes))) {
+        return false;
+    }
+    r_value = uint32_t(bytes[0]) | (uint32_t(bytes[1]) << 8) | (uint32_t(bytes[2]) << 16) | (uint32_t(bytes[3]) << 24);
+    return true;
+}
+
+bool LlamaGGUFReader::_read_u64(uint64_t &r_value) {
+    uint32_t lo = 0;
+    uint32_t hi = 0;
+    if (!_read_u32(lo) || !_read_u32(hi)) {
+        return false;
+    }
+    r_value = uint64_t(lo) | (uint64_t(hi) << 32);
+    return true;
+}
+
+bool LlamaGGUFReader::_read_string(String &r_value) {
+    uint64_t len = 0;
+    if (!_read_u64(len)) {
+        return false;
+    }
+    if (len > GGUF_MAX_STRING || len > file_length - consumed) {
+        return _fail(vformat("string length %d out of range", static_cast<int64_t>(len)));
+    }
+    if (!_fill(static_cast<size_t>(len))) {
+        return false;
+    }
+    r_value = String::utf8(reinterpret_cast<const char *>(buffer.data() + buffer_pos), static_cast<int64_t>(len));
+    buffer_pos += static_cast<size_t>(len);
+    consumed += len;
+    return true;
+}
+
+bool LlamaGGUFReader::_skip_array(uint32_t p_elem_type, uint64_t p_count) {
+    const size_t elem_size = _gguf_scalar_size(p_elem_type);
+    if (elem_size > 0) {
+        if (p_count > (file_length - consumed) / elem_size) {
+            return _fail("array length out of range");
+        }
+        return _skip(p_count * elem_size);
+    }
+    for (uint64_t i = 0; i < p_count; i++) {
+        if (!_skip_value(p_elem_type)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LlamaGGUFReader::_skip_value(uint32_t p_type) {
+    if (p_type == GGUF_VALUE_STRING) {
+        uint64_t len = 0;
+        if (!_read_u64(len)) {
+            return false;
+        }
+        if (len > GGUF_MAX_STRING) {
+            return _fail(vformat("string length %d out of range", static_cast<int64_t>(len)));
+        }
+        return _skip(len);
+    }
+    if (p_type == GGUF_VALUE_ARRAY) {
+        uint32_t elem_type = 0;
+        uint64_t count = 0;
+        return _read_u32(elem_type) && _read_u64(count) && _skip_array(elem_type, count);
+    }
+
+    const size_t size = _gguf_scalar_size(p_type);
+    if (size == 0) {
+        return _fail(vformat("unknown value type %d", static_cast<int64_t>(p_type)));
+    }
+    return _skip(size);
+}
+
+bool LlamaGGUFReader::_read_array(uint32_t p_elem_type, uint64_t p_count, Variant &r_value) {
+    // Short arrays (e.g. rope sections) are materialized; vocab-sized arrays
+    // are skipped and only their length is reported.
+    if (p_count > GGUF_MAX_INLINE_ARRAY || p_elem_type == GGUF_VALUE_ARRAY) {
+        r_value = Variant();
+        return _skip_array(p_elem_type, p_count);
+    }
+
+    Array values;
+    for (uint64_t i = 0; i < p_count; i++) {
+        Variant element;
+        if (!_read_value(p_elem_type, element)) {
+            return false;
+        }
+        values.append(element);
+    }
+    r_value = values;
+    return true;
+}
+
+bool LlamaGGUFReader::_read_value(uint32_t p_type, Variant &r_value) {
+    uint8_t raw[8] = {};
+    switch (p_type) {
+        case GGUF_VALUE_STRING: {
+            String value;
+            if (!_read_string(value)) {
+                return false;
+            }
+            r_value = value;
+            return true;
+        }
+        case GGUF_VALUE_ARRAY: {
+            uint32_t elem_type = 0;
+            uint64_t count = 0;
+            return _read_u32(elem_type) && _read_u64(count) && _read_array(elem_type, count, r_value);
+        }
+        default:
+            break;
+    }
+
+    const size_t size = _gguf_scalar_size(p_type);
+    if (size == 0) {
+        return _fail(vformat("unknown value type %d", static_cast<int64_t>(p_type)));
+    }
+    if (!_read_bytes(raw, size)) {
+        return false;
+    }
+
+    uint64_t bits = 0;
+    for (size_t i = 0; i < size; i++) {
+        bits |= uint64_t(raw[i]) << (8 * i);
+    }
+
+    switch (p_type) {
+        case GGUF_VALUE_UINT8:
+            r_value = static_cast<int64_t>(static_cast<uint8_t>(bits));
+            break;
+        case GGUF_VALUE_INT8:
+            r_value = static_cast<int64_t>(static_cast<int8_t>(bits));
+            break;
+        case GGUF_VALUE_UINT16:
+            r_value = static_cast<int64_t>(static_cast<uint16_t>(bits));
+            break;
+        case GGUF_VALUE_INT16:
+            r_value = static_cast<int64_t>(static_cast<int16_t>(bits));
+            break;
+        case GGUF_VALUE_UINT32:
+            r_value = static_cast<int64_t>(static_cast<uint32_t>(bits));
+            break;
+        case GGUF_VALUE_INT32:
+            r_value = static_cast<int64_t>(static_cast<int32_t>(bits));
+            break;
+        case GGUF_VALUE_UINT64:
+            r_value = static_cast<int64_t>(bits);
+            break;
+        case GGUF_VALUE_INT64:
+            r_value = static_cast<int64_t>(bits);
+            break;
+        case GGUF_VALUE_BOOL:
+            r_value = bits != 0;
+            break;
+        case GGUF_VALUE_FLOAT32: {
+            const uint32_t bits32 = static_cast<uint32_t>(bits);
+            float value = 0.0f;
+            std::memcpy(&value, &bits32, sizeof(value));
+            r_value = static_cast<double>(value);
+            break;
+        }
+        case GGUF_VALUE_FLOAT64: {
+            double value = 0.0;
+            std::memcpy(&value, &bits, sizeof(value));
+            r_value = value;
+            break;
+        }
+        default:
+            break;
+    }
+    return true;
+}
+
+Dictionary LlamaGGUFReader::inspect(const String &p_path) {
+    Dictionary info;
+    error = "";
+    buffer_pos = 0;
+    buffer_len = 0;
+    consumed = 0;
+
+    file = FileAccess::open(p_path, FileAccess::READ);
+    if (file.is_null()) {
+        _fail("cannot open file");
+        return info;
+    }
+    file_length = file->get_length();
+
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint64_t n_tensors = 0;
+    uint64_t n_kv = 0;
+    if (!_read_u32(magic) || magic != GGUF_MAGIC) {
+        _fail("not a GGUF file");
+        file.unref();
+        return info;
+    }
+    if (!_read_u32(version) || version < 2) {
+        _fail(vformat("unsupported GGUF version %d", static_cast<int64_t>(version)));
+        file.unref();
+        return info;
+    }
+    if (!_read_u64(n_tensors) || !_read_u64(n_kv)) {
+        file.unref();
+        return info;
+    }
+
+    Dictionary metadata;
+    Dictionary array_lengths;
+    for (uint64_t i = 0; i < n_kv; i++) {
+        String key;
+        uint32_t type = 0;
+        if (!_read_string(key) || !_read_u32(type)) {
+            file.unref();
+            return Dictionary();
+        }
+
+        Variant value;
+        if (type == GGUF_VALUE_ARRAY) {
+            uint32_t elem_type = 0;
+            uint64_t count = 0;
+            if (!_read_u32(elem_type) || !_read_u64(count) || !_read_array(elem_type, count, value)) {
+                file.unref();
+                return Dictionary();
+            }
+            array_lengths[key] = static_cast<int64_t>(count);
+        } else if (!_read_value(type, value)) {
+            file.unref();
+            return Dictionary();
+        }
+        if (value.get_type() != Variant::NIL) {
+            metadata[key] = value;
+        }
+    }
+
+    if (n_tensors > (file_length - consumed) / GGUF_MIN_TENSOR_INFO) {
+        _fail(vformat("tensor count %d out of range", static_cast<int64_t>(n_tensors)));
+        file.unref();
+        return Dictionary();
+    }
+
+    uint64_t parameter_count = 0;
+    uint64_t tensor_bytes = 0;
+    std::vector<uint64_t> bytes_by_type(GGML_TYPE_COUNT, 0);
+    for (uint64_t i = 0; i < n_tensors; i++) {
+        String name;
+        uint32_t n_dims = 0;
+        if (!_read_string(name) || !_read_u32(n_dims)) {
+            file.unref();
+            return Dictionary();
+        }
+        if (n_dims > GGUF_MAX_DIMS) {
+            _fail(vformat("tensor %s has %d dims", name, static_cast<int64_t>(n_dims)));
+            file.unref();
+            return Dictionary();
+        }
+
+        uint64_t n_elements = 1;
+        for (uint32_t d = 0; d < n_dims; d++) {
+            uint64_t ne = 0;
+            if (!_read_u64(ne)) {
+                file.unref();
+                return Dictionary();
+            }
+            if (ne != 0 && n_elements > UINT64_MAX / ne) {
+                _fail(vformat("tensor %s has too many elements", name));
+                file.unref();
+                return Dictionary();
+            }
+            n_elements *= ne;
+        }
+
+        uint32_t type = 0;
+        uint64_t offset = 0;
+        if (!_read_u32(type) || !_read_u64(offset)) {
+            file.unref();
+            return Dictionary();
+        }
+
+        parameter_count += n_elements;
+        if (type < GGML_TYPE_COUNT) {
+            const int64_t block = ggml_blck_size(static_cast<ggml_type>(type));
+            if (block > 0) {
+                const uint64_t bytes = n_elements / static_cast<uint64_t>(block) * ggml_type_size(static_cast<ggml_type>(type));
+                tensor_bytes += bytes;
+                bytes_by_type[type] += bytes;
+            }
+        }
+    }
+    file.unref();
+
+    Dictionary by_type;
+    int32_t dominant_type = -1;
+    for (int32_t t = 0; t < GGML_TYPE_COUNT; t++) {
+        if (bytes_by_type[t] == 0) {
+            continue;
+        }
+        by_type[String(ggml_type_name(static_cast<ggml_type>(t)))] = static_cast<int64_t>(bytes_by_type[t]);
+        if (dominant_type < 0 || bytes_by_type[t] > bytes_by_type[dominant_type]) {
+            dominant_type = t;
+        }
+    }
+
+    const String arch = metadata.get("general.architecture", "");
+    info["path"] = p_path;
+    info["version"] = static_cast<int64_t>(version);
+    info["file_size"] = static_cast<int64_t>(file_length);
+    info["architecture"] = arch;
+    info["name"] = metadata.get("general.name", "");
+    info["context_length"] = metadata.get(arch + ".context_length", 0);
+    info["embedding_length"] = metadata.get(arch + ".embedding_length", 0);
+    info["block_count"] = metadata.get(arch + ".block_count", 0);
+    info["file_type"] = metadata.get("general.file_type", -1);
+    info["quant_type"] = dominant_type >= 0 ? String(ggml_type_name(static_cast<ggml_type>(dominant_type))) : String();
+    info["parameter_count"] = static_cast<int64_t>(parameter_count);
+    info["tensor_count"] = static_cast<int64_t>(n_tensors);
+    info["tensor_bytes"] = static_cast<int64_t>(tensor_bytes);
+    info["tensor_bytes_by_type"] = by_type;
+    info["metadata"] = metadata;
+    info["array_lengths"] = array_lengths;
+    return info;
+}
+
+String LlamaGGUFReader::get_error() const {
+    return error;
+}
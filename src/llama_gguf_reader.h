@@ -0,0 +1,45 @@
+#ifndef GODOT_LLAMA_GGUF_READER_H
+#define GODOT_LLAMA_GGUF_READER_H
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace godot {
+
+// Streaming reader for the GGUF header, key/value section and tensor infos.
+// Tensor data is never touched, so inspecting a multi-GB model only reads the
+// first few MB of the file (mostly tokenizer arrays, which are skipped).
+class LlamaGGUFReader {
+private:
+    Ref<FileAccess> file;
+    std::vector<uint8_t> buffer;
+    size_t buffer_pos = 0;
+    size_t buffer_len = 0;
+    uint64_t file_length = 0;
+    uint64_t consumed = 0;
+    String error;
+
+    bool _fill(size_t p_min_bytes);
+    bool _read_bytes(void *r_dst, size_t p_size);
+    bool _skip(uint64_t p_size);
+    bool _read_u32(uint32_t &r_value);
+    bool _read_u64(uint64_t &r_value);
+    bool _read_string(String &r_value);
+    bool _skip_array(uint32_t p_elem_type, uint64_t p_count);
+    bool _skip_value(uint32_t p_type);
+    bool _read_array(uint32_t p_elem_type, uint64_t p_count, Variant &r_value);
+    bool _read_value(uint32_t p_type, Variant &r_value);
+    bool _fail(const String &p_message);
+
+public:
+    Dictionary inspect(const String &p_path);
+    String get_error() const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,322 @@
+#include "llama_json_stream.h"
+
+using namespace godot;
+
+static bool _json_is_whitespace(char p_char) {
+    return p_char == ' ' || p_char == '\t' || p_char == '\n' || p_char == '\r';
+}
+
+static int _json_hex_value(char p_char) {
+    if (p_char >= '0' && p_char <= '9') {
+        return p_char - '0';
+    }
+    if (p_char >= 'a' && p_char <= 'f') {
+        return p_char - 'a' + 10;
+    }
+    if (p_char >= 'A' && p_char <= 'F') {
+        return p_char - 'A' + 10;
+    }
+    return -1;
+}
+
+void LlamaJsonStream::reset() {
+    state = STATE_SCAN;
+    stack.clear();
+    text.clear();
+    string_is_key = false;
+    unicode_value = 0;
+    unicode_digits = 0;
+    pending_high_surrogate = 0;
+    error = "";
+}
+
+String LlamaJsonStream::_child_path(const Frame &p_parent) const {
+    if (p_parent.is_object) {
+        return p_parent.path.is_empty() ? p_parent.key : p_parent.path + "." + p_parent.key;
+    }
+    return p_parent.path + "[" + String::num_int64(p_parent.array.size()) + "]";
+}
+
+void LlamaJsonStream::_push(bool p_is_object, const String &p_path) {
+    Frame frame;
+    frame.is_object = p_is_object;
+    frame.path = p_path;
+    frame.expect = p_is_object ? EXPECT_KEY_OR_END : EXPECT_VALUE_OR_END;
+    stack.push_back(frame);
+}
+
+void LlamaJsonStream::_attach(const String &p_path, const Variant &p_value, std::vector<Field> &r_fields) {
+    Field field;
+    field.path = p_path;
+    field.value = p_value;
+    r_fields.push_back(field);
+
+    if (stack.empty()) {
+        state = STATE_DONE;
+        return;
+    }
+    Frame &parent = stack.back();
+    if (parent.is_object) {
+        parent.object[parent.key] = p_value;
+    } else {
+        parent.array.append(p_value);
+    }
+    parent.expect = EXPECT_COMMA_OR_END;
+}
+
+void LlamaJsonStream::_close(std::vector<Field> &r_fields) {
+    const Frame frame = stack.back();
+    stack.pop_back();
+    _attach(frame.path, frame.is_object ? Variant(frame.object) : Variant(frame.array), r_fields);
+}
+
+bool LlamaJsonStream::_finish_literal(std::vector<Field> &r_fields) {
+    const String path = _child_path(stack.back());
+    Variant value;
+    if (text == "true") {
+        value = true;
+    } else if (text == "false") {
+        value = false;
+    } else if (text != "null") {
+        const String literal = String::utf8(text.data(), static_cast<int64_t>(text.size()));
+        if (literal.is_valid_int()) {
+            value = literal.to_int();
+        } else if (literal.is_valid_float()) {
+            value = literal.to_float();
+        } else {
+            _fail("invalid literal '" + literal + "' at " + path);
+            return false;
+        }
+    }
+    text.clear();
+    _attach(path, value, r_fields);
+    return true;
+}
+
+void LlamaJsonStream::_append_code_point(uint32_t p_code_point) {
+    if (p_code_point < 0x80) {
+        text.push_back(static_cast<char>(p_code_point));
+    } else if (p_code_point < 0x800) {
+        text.push_back(static_cast<char>(0xC0 | (p_code_point >> 6)));
+        text.push_back(static_cast<char>(0x80 | (p_code_point & 0x3F)));
+    } else if (p_code_point < 0x10000) {
+        text.push_back(static_cast<char>(0xE0 | (p_code_point >> 12)));
+        text.push_back(static_cast<char>(0x80 | ((p_code_point >> 6) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | (p_code_point & 0x3F)));
+    } else {
+        text.push_back(static_cast<char>(0xF0 | (p_code_point >> 18)));
+        text.push_back(static_cast<char>(0x80 | ((p_code_point >> 12) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | ((p_code_point >> 6) & 0x3F)));
+        text.push_back(static_cast<char>(0x80 | (p_code_point & 0x3F)));
+    }
+}
+
+bool LlamaJsonStream::_structure(char p_char, std::vector<Field> &r_fields) {
+    if (_json_is_whitespace(p_char)) {
+        return true;
+    }
+
+    Frame &top = stack.back();
+    switch (top.expect) {
+        case EXPECT_KEY_OR_END:
+            if (p_char == '}') {
+                _close(r_fields);
+                return true;
+            }
+            [[fallthrough]];
+        case EXPECT_KEY:
+            if (p_char == '"') {
+                string_is_key = true;
+                text.clear();
+                state = STATE_STRING;
+                return true;
+            }
+            _fail("expected a key in " + (top.path.is_empty() ? String("root object") : top.path));
+            return false;
+        case EXPECT_COLON:
+            if (p_char == ':') {
+                top.expect = EXPECT_VALUE;
+                return true;
+            }
+            _fail("expected ':' after key " + _child_path(top));
+            return false;
+        case EXPECT_VALUE_OR_END:
+            if (p_char == ']') {
+                _close(r_fields);
+                return true;
+            }
+            [[fallthrough]];
+        case EXPECT_VALUE:
+            if (p_char == '{' || p_char == '[') {
+                _push(p_char == '{', _child_path(top));
+                return true;
+            }
+            if (p_char == '"') {
+                string_is_key = false;
+                text.clear();
+                state = STATE_STRING;
+                return true;
+            }
+            if (p_char == '-' || (p_char >= '0' && p_char <= '9') || p_char == 't' || p_char == 'f' || p_char == 'n') {
+                text.clear();
+                text.push_back(p_char);
+                state = STATE_LITERAL;
+                return true;
+            }
+            _fail("expected a value at " + _child_path(top));
+            return false;
+        case EXPECT_COMMA_OR_END:
+            if (p_char == ',') {
+                top.expect = top.is_object ? EXPECT_KEY : EXPECT_VALUE;
+                return true;
+            }
+            if ((p_char == '}' && top.is_object) || (p_char == ']' && !top.is_object)) {
+                _close(r_fields);
+                return true;
+            }
+            _fail("expected ',' or end of " + (top.path.is_empty() ? String("root") : top.path));
+            return false;
+    }
+    return false;
+}
+
+void LlamaJsonStream::_fail(const String &p_message) {
+    error = p_message;
+    state = STATE_ERROR;
+}
+
+void LlamaJsonStream::feed(const char *p_data, size_t p_size, std::vector<Field> &r_fields) {
+    for (size_t i = 0; i < p_size; i++) {
+        const char c = p_data[i];
+        switch (state) {
+            case STATE_SCAN:
+                if (c == '{' || c == '[') {
+                    _push(c == '{', String());
+                    state = STATE_STRUCTURE;
+                }
+                break;
+            case STATE_DONE:
+            case STATE_ERROR:
+                return;
+            case STATE_STRUCTURE:
+                _structure(c, r_fields);
+                break;
+            case STATE_STRING:
+                if (pending_high_surrogate != 0 && c != '\\') {
+                    _append_code_point(0xFFFD);
+                    pending_high_surrogate = 0;
+                }
+                if (c == '\\') {
+                    state = STATE_STRING_ESCAPE;
+                } else if (c == '"') {
+                    const String value = String::utf8(text.data(), static_cast<int64_t>(text.size()));
+                    text.clear();
+                    state = STATE_STRUCTURE;
+                    if (string_is_key) {
+                        stack.back().key = value;
+                        stack.back().expect = EXPECT_COLON;
+                    } else {
+                        _attach(_child_path(stack.back()), value, r_fields);
+                    }
+                } else {
+                    // Raw control characters are invalid JSON, but models emit
+                    // literal newlines often enough that rejecting them hurts.
+                    text.push_back(c);
+                }
+                break;
+            case STATE_STRING_ESCAPE:
+                if (c == 'u') {
+                    unicode_value = 0;
+                    unicode_digits = 0;
+                    state = STATE_STRING_UNICODE;
+                    break;
+                }
+                if (pending_high_surrogate != 0) {
+                    _append_code_point(0xFFFD);
+                    pending_high_surrogate = 0;
+                }
+                switch (c) {
+                    case '"':
+                    case '\\':
+                    case '/':
+                        text.push_back(c);
+                        break;
+                    case 'b':
+                        text.push_back('\b');
+                        break;
+                    case 'f':
+                        text.push_back('\f');
+                        break;
+                    case 'n':
+                        text.push_back('\n');
+                        break;
+                    case 'r':
+                        text.push_back('\r');
+                        break;
+                    case 't':
+                        text.push_back('\t');
+                        break;
+                    default:
+                        _fail(String("invalid escape '\\") + String::chr(static_cast<char32_t>(static_cast<unsigned char>(c))) + "'");
+                        return;
+                }
+                state = STATE_STRING;
+                break;
+            case STATE_STRING_UNICODE: {
+                const int digit = _json_hex_value(c);
+                if (digit < 0) {
+                    _fail("invalid \\u escape");
+                    return;
+                }
+                unicode_value = (unicode_value << 4) | static_cast<uint32_t>(digit);
+                if (++unicode_digits < 4) {
+                    break;
+                }
+                if (unicode_value >= 0xD800 && unicode_value <= 0xDBFF) {
+                    if (pending_high_surrogate != 0) {
+                        _append_code_point(0xFFFD);
+                    }
+                    pending_high_surrogate = unicode_value;
+                } else if (unicode_value >= 0xDC00 && unicode_value <= 0xDFFF) {
+                    if (pending_high_surrogate != 0) {
+                        _append_code_point(0x10000 + ((pending_high_surrogate - 0xD800) << 10) + (unicode_value - 0xDC00));
+                        pending_high_surrogate = 0;
+                    } else {
+                        _append_code_point(0xFFFD);
+                    }
+                } else {
+                    if (pending_high_surrogate != 0) {
+                        _append_code_point(0xFFFD);
+                        pending_high_surrogate = 0;
+                    }
+                    _append_code_point(unicode_value);
+                }
+                state = STATE_STRING;
+                break;
+            }
+            case STATE_LITERAL:
+                if (c == ',' || c == '}' || c == ']' || _json_is_whitespace(c)) {
+                    if (!_finish_literal(r_fields)) {
+                        return;
+                    }
+                    state = STATE_STRUCTURE;
+                    _structure(c, r_fields);
+                } else {
+                    text.push_back(c);
+                }
+                break;
+        }
+    }
+}
+
+bool LlamaJsonStream::is_complete() const {
+    return state == STATE_DONE;
+}
+
+bool LlamaJsonStream::has_error() const {
+    return state == STATE_ERROR;
+}
+
+String LlamaJsonStream::get_error() const {
+    return error;
+}
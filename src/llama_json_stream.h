@@ -0,0 +1,86 @@
+#ifndef GODOT_LLAMA_JSON_STREAM_H
+#define GODOT_LLAMA_JSON_STREAM_H
+
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+#include <godot_cpp/variant/variant.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace godot {
+
+// Incremental JSON parser fed with raw UTF-8 token bytes. Every value is
+// reported as soon as it closes, children before their parents, with a path
+// such as "action", "target.name" or "items[2]" (the root has path "").
+// Text before the first '{' or '[' (e.g. a code fence) and after the root
+// value is ignored.
+class LlamaJsonStream {
+public:
+    struct Field {
+        String path;
+        Variant value;
+    };
+
+private:
+    enum State {
+        STATE_SCAN,
+        STATE_STRUCTURE,
+        STATE_STRING,
+        STATE_STRING_ESCAPE,
+        STATE_STRING_UNICODE,
+        STATE_LITERAL,
+        STATE_DONE,
+        STATE_ERROR,
+    };
+
+    enum Expect {
+        EXPECT_KEY_OR_END,
+        EXPECT_KEY,
+        EXPECT_COLON,
+        EXPECT_VALUE_OR_END,
+        EXPECT_VALUE,
+        EXPECT_COMMA_OR_END,
+    };
+
+    struct Frame {
+        bool is_object = false;
+        Dictionary object;
+        Array array;
+        String path;
+        String key;
+        Expect expect = EXPECT_VALUE;
+    };
+
+    State state = STATE_SCAN;
+    std::vector<Frame> stack;
+    std::string text;
+    bool string_is_key = false;
+    uint32_t unicode_value = 0;
+    int unicode_digits = 0;
+    uint32_t pending_high_surrogate = 0;
+    String error;
+
+    String _child_path(const Frame &p_parent) const;
+    void _push(bool p_is_object, const String &p_path);
+    void _attach(const String &p_path, const Variant &p_value, std::vector<Field> &r_fields);
+    void _close(std::vector<Field> &r_fields);
+    bool _finish_literal(std::vector<Field> &r_fields);
+    void _append_code_point(uint32_t p_code_point);
+    bool _structure(char p_char, std::vector<Field> &r_fields);
+    void _fail(const String &p_message);
+
+public:
+    void reset();
+    void feed(const char *p_data, size_t p_size, std::vector<Field> &r_fields);
+
+    bool is_complete() const;
+    bool has_error() const;
+    String get_error() const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,312 @@
+#include "llama_memory_planner.h"
+
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+
+using namespace godot;
+
+namespace {
+
+constexpr uint32_t PLANNER_CTX_PAD = 256;
+
+struct KvTypeName {
+    const char *name;
+    ggml_type type;
+};
+
+const KvTypeName KV_TYPE_NAMES[] = {
+    { "f32", GGML_TYPE_F32 },
+    { "f16", GGML_TYPE_F16 },
+    { "bf16", GGML_TYPE_BF16 },
+    { "q8_0", GGML_TYPE_Q8_0 },
+    { "q5_1", GGML_TYPE_Q5_1 },
+    { "q5_0", GGML_TYPE_Q5_0 },
+    { "q4_1", GGML_TYPE_Q4_1 },
+    { "q4_0", GGML_TYPE_Q4_0 },
+    { "iq4_nl", GGML_TYPE_IQ4_NL },
+};
+
+uint32_t _pad_ctx(uint32_t p_n_ctx) {
+    return ((p_n_ctx + PLANNER_CTX_PAD - 1) / PLANNER_CTX_PAD) * PLANNER_CTX_PAD;
+}
+
+int64_t _metadata_int(const Dictionary &p_metadata, const String &p_key, int64_t p_default) {
+    if (!p_metadata.has(p_key)) {
+        return p_default;
+    }
+    const String value = p_metadata[p_key];
+    return value.is_valid_int() ? value.to_int() : p_default;
+}
+
+bool _row_bytes(int32_t p_type, int64_t p_n, uint64_t &r_bytes) {
+    const ggml_type type = static_cast<ggml_type>(p_type);
+    const int64_t block = ggml_blck_size(type);
+    if (block <= 0 || p_n % block != 0) {
+        return false;
+    }
+    r_bytes = ggml_row_size(type, p_n);
+    return true;
+}
+
+} // namespace
+
+void LlamaMemoryPlanner::_bind_methods() {
+    ClassDB::bind_static_method("LlamaMemoryPlanner", D_METHOD("estimate", "model", "params"), &LlamaMemoryPlanner::estimate, DEFVAL(Dictionary()));
+    ClassDB::bind_static_method("LlamaMemoryPlanner", D_METHOD("fit", "model", "budget_bytes", "params"), &LlamaMemoryPlanner::fit, DEFVAL(Dictionary()));
+}
+
+bool LlamaMemoryPlanner::parse_kv_type(const Variant &p_value, int32_t &r_type) {
+    if (p_value.get_type() == Variant::INT) {
+        const int64_t type = p_value;
+        if (type < 0 || type >= GGML_TYPE_COUNT) {
+            return false;
+        }
+        r_type = static_cast<int32_t>(type);
+        return true;
+    }
+
+    const String name = String(p_value).strip_edges().to_lower();
+    for (const KvTypeName &entry : KV_TYPE_NAMES) {
+        if (name == entry.name) {
+            r_type = entry.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LlamaMemoryPlanner::parse_flash_attn(const Variant &p_value, int32_t &r_flash_attn_type) {
+    if (p_value.get_type() == Variant::BOOL) {
+        r_flash_attn_type = bool(p_value) ? LLAMA_FLASH_ATTN_TYPE_ENABLED : LLAMA_FLASH_ATTN_TYPE_DISABLED;
+        return true;
+    }
+
+    const String name = String(p_value).strip_edges().to_lower();
+    if (name == "auto") {
+        r_flash_attn_type = LLAMA_FLASH_ATTN_TYPE_AUTO;
+    } else if (name == "on" || name == "enabled" || name == "true") {
+        r_flash_attn_type = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    } else if (name == "off" || name == "disabled" || name == "false") {
+        r_flash_attn_type = LLAMA_FLASH_ATTN_TYPE_DISABLED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool LlamaMemoryPlanner::is_quantized_kv_type(int32_t p_type) {
+    return ggml_is_quantized(static_cast<ggml_type>(p_type));
+}
+
+String LlamaMemoryPlanner::kv_type_name(int32_t p_type) {
+    if (p_type < 0 || p_type >= GGML_TYPE_COUNT) {
+        return "";
+    }
+    return ggml_type_name(static_cast<ggml_type>(p_type));
+}
+
+Dictionary LlamaMemoryPlanner::estimate(const Ref<LlamaModel> &p_model, const Dictionary &p_params) {
+    Dictionary result;
+    if (p_model.is_null() || !p_model->is_loaded()) {
+        UtilityFunctions::push_error("godot_llama: estimate() needs a loaded model");
+        return result;
+    }
+
+    const llama_model *native_model = p_model->get_native_model();
+    uint32_t n_ctx = 2048;
+    uint32_t n_seq_max = 1;
+    uint32_t n_batch = 512;
+    int32_t type_k = GGML_TYPE_F16;
+    int32_t type_v = GGML_TYPE_F16;
+    int32_t flash_attn = LLAMA_FLASH_ATTN_TYPE_AUTO;
+
+    if (p_params.has("n_ctx")) {
+        n_ctx = static_cast<uint32_t>(int64_t(p_params["n_ctx"]));
+    }
+    if (n_ctx == 0) {
+        n_ctx = static_cast<uint32_t>(llama_model_n_ctx_train(native_model));
+    }
+    if (p_params.has("n_seq_max")) {
+        n_seq_max = static_cast<uint32_t>(std::max<int64_t>(1, int64_t(p_params["n_seq_max"])));
+    }
+    if (p_params.has("n_batch")) {
+        n_batch = static_cast<uint32_t>(int64_t(p_params["n_batch"]));
+    }
+    uint32_t n_ubatch = n_batch;
+    if (p_params.has("n_ubatch")) {
+        n_ubatch = static_cast<uint32_t>(int64_t(p_params["n_ubatch"]));
+    }
+    if ((p_params.has("type_k") && !parse_kv_type(p_params["type_k"], type_k)) ||
+            (p_params.has("type_v") && !parse_kv_type(p_params["type_v"], type_v)) ||
+            (p_params.has("flash_attn") && !parse_flash_attn(p_params["flash_attn"], flash_attn))) {
+        UtilityFunctions::push_error("godot_llama: invalid type_k, type_v or flash_attn value");
+        return result;
+    }
+    // Same rule as LlamaContext::create(): a quantized V cache needs flash attention.
+    if (is_quantized_kv_type(type_v)) {
+        if (flash_attn == LLAMA_FLASH_ATTN_TYPE_DISABLED) {
+            UtilityFunctions::push_error("godot_llama: quantized type_v requires flash_attn");
+            return result;
+        }
+        flash_attn = LLAMA_FLASH_ATTN_TYPE_ENABLED;
+    }
+
+    n_ctx = _pad_ctx(std::max<uint32_t>(n_ctx, 1));
+    n_ubatch = std::max<uint32_t>(1, std::min(n_ubatch, n_batch));
+
+    const Dictionary metadata = p_model->get_metadata();
+    const String arch = metadata.get("general.architecture", "");
+    const int64_t n_layer = llama_model_n_layer(native_model);
+    const int64_t n_embd = llama_model_n_embd(native_model);
+    const int64_t n_head = std::max(1, llama_model_n_head(native_model));
+    const int64_t n_head_kv = std::max(1, llama_model_n_head_kv(native_model));
+    const int64_t n_vocab = llama_vocab_n_tokens(p_model->get_vocab());
+    const int64_t head_k = _metadata_int(metadata, arch + ".attention.key_length", n_embd / n_head);
+    const int64_t head_v = _metadata_int(metadata, arch + ".attention.value_length", n_embd / n_head);
+    const int64_t n_ff = _metadata_int(metadata, arch + ".feed_forward_length", 4 * n_embd);
+
+    uint64_t k_row = 0;
+    uint64_t v_row = 0;
+    if (!_row_bytes(type_k, head_k * n_head_kv, k_row) || !_row_bytes(type_v, head_v * n_head_kv, v_row)) {
+        UtilityFunctions::push_error("godot_llama: KV cache type is not compatible with this model's head size");
+        return result;
+    }
+
+    // KV cells are shared by all sequences: n_ctx is the total, not per-sequence.
+    const uint64_t kv_bytes = static_cast<uint64_t>(n_layer) * n_ctx * (k_row + v_row);
+
+    // Worst-case graph for one ubatch where every token produces logits. Without
+    // flash attention the f32 KQ matrix dominates at long contexts.
+    const uint64_t f32 = sizeof(float);
+    uint64_t compute_bytes = static_cast<uint64_t>(n_ubatch) * n_vocab * f32;
+    compute_bytes += static_cast<uint64_t>(n_ubatch) * (4 * n_embd + 3 * n_ff) * f32;
+    if (flash_attn == LLAMA_FLASH_ATTN_TYPE_ENABLED) {
+        compute_bytes += static_cast<uint64_t>(n_ubatch) * n_head * head_v * f32;
+    } else {
+        compute_bytes += static_cast<uint64_t>(n_ubatch) * n_ctx * n_head * f32;
+    }
+    const uint64_t output_bytes = static_cast<uint64_t>(n_seq_max) * (n_vocab + n_embd) * f32;
+    const uint64_t model_bytes = llama_model_size(native_model);
+
+    result["n_ctx"] = static_cast<int64_t>(n_ctx);
+    result["n_seq_max"] = static_cast<int64_t>(n_seq_max);
+    result["n_batch"] = static_cast<int64_t>(n_batch);
+    result["n_ubatch"] = static_cast<int64_t>(n_ubatch);
+    result["type_k"] = kv_type_name(type_k);
+    result["type_v"] = kv_type_name(type_v);
+    result["flash_attn"] = flash_attn == LLAMA_FLASH_ATTN_TYPE_ENABLED ? String("on") : (flash_attn == LLAMA_FLASH_ATTN_TYPE_DISABLED ? String("off") : String("auto"));
+    result["kv_bytes"] = static_cast<int64_t>(kv_bytes);
+    result["compute_bytes"] = static_cast<int64_t>(compute_bytes);
+    result["output_bytes"] = static_cast<int64_t>(output_bytes);
+    result["context_bytes"] = static_cast<int64_t>(kv_bytes + compute_bytes + output_bytes);
+    result["model_bytes"] = static_cast<int64_t>(model_bytes);
+    result["total_bytes"] = static_cast<int64_t>(model_bytes + kv_bytes + compute_bytes + output_bytes);
+    return result;
+}
+
+Dictionary LlamaMemoryPlanner::fit(const Ref<LlamaModel> &p_model, int64_t p_budget_bytes, const Dictionary &p_params) {
+    Dictionary result;
+    if (p_model.is_null() || !p_model->is_loaded()) {
+        UtilityFunctions::push_error("godot_llama: fit() needs a loaded model");
+        return result;
+    }
+
+    uint32_t n_ctx_max = static_cast<uint32_t>(llama_model_n_ctx_train(p_model->get_native_model()));
+    uint32_t n_ctx_min = 512;
+    if (p_params.has("n_ctx_max")) {
+        n_ctx_max = static_cast<uint32_t>(int64_t(p_params["n_ctx_max"]));
+    }
+    if (p_params.has("n_ctx_min")) {
+        n_ctx_min = static_cast<uint32_t>(int64_t(p_params["n_ctx_min"]));
+    }
+    n_ctx_min = _pad_ctx(std::max<uint32_t>(n_ctx_min, 1));
+    n_ctx_max = std::max(n_ctx_min, (n_ctx_max / PLANNER_CTX_PAD) * PLANNER_CTX_PAD);
+
+    Array type_candidates;
+    if (p_params.has("type_candidates")) {
+        type_candidates = p_params["type_candidates"];
+    } else {
+        type_candidates.append("f16");
+        type_candidates.append("q8_0");
+        type_candidates.append("q4_0");
+    }
+    const bool include_model = p_params.get("include_model", true);
+    const String budget_key = include_model ? "total_bytes" : "context_bytes";
+
+    Dictionary base_params = p_params.duplicate();
+    base_params.erase("n_ctx_max");
+    base_params.erase("n_ctx_min");
+    base_params.erase("type_candidates");
+    base_params.erase("include_model");
+
+    // create() refuses a quantized V cache with flash attention off.
+    int32_t base_flash_attn = LLAMA_FLASH_ATTN_TYPE_AUTO;
+    if (base_params.has("flash_attn") && !parse_flash_attn(base_params["flash_attn"], base_flash_attn)) {
+        UtilityFunctions::push_error("godot_llama: invalid flash_attn value");
+        return result;
+    }
+
+    // Candidates are ordered by precision; memory is monotonic in n_ctx, so a
+    // binary search per type finds the largest context that fits.
+    Dictionary best;
+    Dictionary smallest;
+    for (int i = 0; i < type_candidates.size(); i++) {
+        int32_t candidate_type = GGML_TYPE_F16;
+        if (base_flash_attn == LLAMA_FLASH_ATTN_TYPE_DISABLED && parse_kv_type(type_candidates[i], candidate_type) && is_quantized_kv_type(candidate_type)) {
+            continue;
+        }
+        Dictionary params = base_params.duplicate();
+        params["type_k"] = type_candidates[i];
+        params["type_v"] = type_candidates[i];
+
+        uint32_t lo = n_ctx_min / PLANNER_CTX_PAD;
+        uint32_t hi = n_ctx_max / PLANNER_CTX_PAD;
+        Dictionary found;
+        while (lo <= hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            params["n_ctx"] = static_cast<int64_t>(mid * PLANNER_CTX_PAD);
+            const Dictionary estimate_result = estimate(p_model, params);
+            if (estimate_result.is_empty()) {
+                break;
+            }
+            if (smallest.is_empty() || int64_t(estimate_result[budget_key]) < int64_t(smallest[budget_key])) {
+                smallest = estimate_result;
+            }
+            if (int64_t(estimate_result[budget_key]) <= p_budget_bytes) {
+                found = estimate_result;
+                lo = mid + 1;
+            } else {
+                if (mid == 0) {
+                    break;
+                }
+                hi = mid - 1;
+            }
+        }
+
+        if (!found.is_empty() && (best.is_empty() || int64_t(found["n_ctx"]) > int64_t(best["n_ctx"]))) {
+            best = found;
+        }
+    }
+
+    const bool fits = !best.is_empty();
+    const Dictionary chosen = fits ? best : smallest;
+    if (chosen.is_empty()) {
+        return result;
+    }
+
+    Dictionary create_params;
+    const char *create_keys[] = { "n_ctx", "n_seq_max", "n_batch", "n_ubatch", "type_k", "type_v", "flash_attn" };
+    for (const char *key : create_keys) {
+        create_params[key] = chosen[key];
+    }
+
+    result["fits"] = fits;
+    result["budget_bytes"] = p_budget_bytes;
+    result["params"] = create_params;
+    result["estimate"] = chosen;
+    return result;
+}
@@ -0,0 +1,31 @@
+#ifndef GODOT_LLAMA_MEMORY_PLANNER_H
+#define GODOT_LLAMA_MEMORY_PLANNER_H
+
+#include "llama_model.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+namespace godot {
+
+class LlamaMemoryPlanner : public RefCounted {
+    GDCLASS(LlamaMemoryPlanner, RefCounted);
+
+protected:
+    static void _bind_methods();
+
+public:
+    static Dictionary estimate(const Ref<LlamaModel> &p_model, const Dictionary &p_params = Dictionary());
+    static Dictionary fit(const Ref<LlamaModel> &p_model, int64_t p_budget_bytes, const Dictionary &p_params = Dictionary());
+
+    // Shared with LlamaContext::create so both sides agree on param spelling.
+    static bool parse_kv_type(const Variant &p_value, int32_t &r_type);
+    static bool parse_flash_attn(const Variant &p_value, int32_t &r_flash_attn_type);
+    static bool is_quantized_kv_type(int32_t p_type);
+    static String kv_type_name(int32_t p_type);
+};
+
+} // namespace godot
+
+#endif
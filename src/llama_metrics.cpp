@@ -0,0 +1,196 @@
+#include "llama_metrics.h"
+
+#include <godot_cpp/classes/performance.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/variant/callable_method_pointer.hpp>
+
+#include <atomic>
+#include <mutex>
+
+using namespace godot;
+
+namespace {
+
+// Rates are averaged over at least this long so a monitor polled every
+// frame does not flicker between 0 and a spike.
+constexpr uint64_t METRICS_RATE_WINDOW_USEC = 500000;
+constexpr double METRICS_BYTES_PER_MB = 1024.0 * 1024.0;
+
+std::atomic<int64_t> metrics_gauges[LlamaMetrics::GAUGE_MAX] = {};
+std::atomic<int64_t> metrics_generated_tokens{ 0 };
+std::atomic<int64_t> metrics_prompt_tokens{ 0 };
+std::atomic<uint64_t> metrics_prompt_usec{ 0 };
+std::atomic<uint64_t> metrics_first_token_usec{ 0 };
+
+std::mutex metrics_rate_mutex;
+int64_t metrics_rate_tokens = 0;
+uint64_t metrics_rate_usec = 0;
+double metrics_rate_value = 0.0;
+
+int64_t _metrics_gauge(LlamaMetrics::Gauge p_gauge) {
+    return metrics_gauges[p_gauge].load(std::memory_order_relaxed);
+}
+
+double _monitor_tokens_per_second() {
+    std::lock_guard<std::mutex> lock(metrics_rate_mutex);
+    const uint64_t now = Time::get_singleton()->get_ticks_usec();
+    const int64_t tokens = metrics_generated_tokens.load(std::memory_order_relaxed);
+    if (metrics_rate_usec == 0) {
+        metrics_rate_usec = now;
+        metrics_rate_tokens = tokens;
+    } else if (now - metrics_rate_usec >= METRICS_RATE_WINDOW_USEC) {
+        metrics_rate_value = static_cast<double>(tokens - metrics_rate_tokens) * 1000000.0 / static_cast<double>(now - metrics_rate_usec);
+        metrics_rate_usec = now;
+        metrics_rate_tokens = tokens;
+    }
+    return metrics_rate_value;
+}
+
+double _monitor_time_to_first_token_ms() {
+    return static_cast<double>(metrics_first_token_usec.load(std::memory_order_relaxed)) / 1000.0;
+}
+
+double _monitor_prompt_tokens_per_second() {
+    const uint64_t usec = metrics_prompt_usec.load(std::memory_order_relaxed);
+    const int64_t tokens = metrics_prompt_tokens.load(std::memory_order_relaxed);
+    return usec > 0 ? static_cast<double>(tokens) * 1000000.0 / static_cast<double>(usec) : 0.0;
+}
+
+int64_t _monitor_kv_cells_used() {
+    return _metrics_gauge(LlamaMetrics::GAUGE_KV_CELLS_USED);
+}
+
+int64_t _monitor_kv_cells_total() {
+    return _metrics_gauge(LlamaMetrics::GAUGE_KV_CELLS_TOTAL);
+}
+
+double _monitor_kv_usage_percent() {
+    const int64_t total = _metrics_gauge(LlamaMetrics::GAUGE_KV_CELLS_TOTAL);
+    return total > 0 ? 100.0 * static_cast<double>(_metrics_gauge(LlamaMetrics::GAUGE_KV_CELLS_USED)) / static_cast<double>(total) : 0.0;
+}
+
+int64_t _monitor_contexts() {
+    return _metrics_gauge(LlamaMetrics::GAUGE_CONTEXTS);
+}
+
+int64_t _monitor_active_generations() {
+    return _metrics_gauge(LlamaMetrics::GAUGE_ACTIVE_GENERATIONS);
+}
+
+int64_t _monitor_queued_requests() {
+    return _metrics_gauge(LlamaMetrics::GAUGE_QUEUED_REQUESTS);
+}
+
+double _monitor_model_memory_mb() {
+    return static_cast<double>(_metrics_gauge(LlamaMetrics::GAUGE_MODEL_BYTES)) / METRICS_BYTES_PER_MB;
+}
+
+double _monitor_context_memory_mb() {
+    return static_cast<double>(_metrics_gauge(LlamaMetrics::GAUGE_CONTEXT_BYTES)) / METRICS_BYTES_PER_MB;
+}
+
+const char *const METRICS_MONITOR_IDS[] = {
+    "godot_llama/tokens_per_second",
+    "godot_llama/time_to_first_token_ms",
+    "godot_llama/prompt_tokens_per_second",
+    "godot_llama/kv_cells_used",
+    "godot_llama/kv_cells_total",
+    "godot_llama/kv_usage_percent",
+    "godot_llama/contexts",
+    "godot_llama/active_generations",
+    "godot_llama/queued_requests",
+    "godot_llama/model_memory_mb",
+    "godot_llama/context_memory_mb",
+};
+
+} // namespace
+
+LlamaMetrics::Contribution::Contribution(Gauge p_gauge) :
+        gauge(p_gauge) {
+}
+
+LlamaMetrics::Contribution::~Contribution() {
+    set(0);
+}
+
+void LlamaMetrics::Contribution::set(int64_t p_value) {
+    if (p_value != value) {
+        metrics_gauges[gauge].fetch_add(p_value - value, std::memory_order_relaxed);
+        value = p_value;
+    }
+}
+
+int64_t LlamaMetrics::Contribution::get() const {
+    return value;
+}
+
+void LlamaMetrics::add_generated_tokens(int64_t p_count) {
+    metrics_generated_tokens.fetch_add(p_count, std::memory_order_relaxed);
+}
+
+void LlamaMetrics::record_prompt_eval(int64_t p_tokens, uint64_t p_usec) {
+    // Two separate stores can tear across threads; the monitor only needs a
+    // plausible recent figure, not an exact pair.
+    metrics_prompt_tokens.store(p_tokens, std::memory_order_relaxed);
+    metrics_prompt_usec.store(p_usec, std::memory_order_relaxed);
+}
+
+void LlamaMetrics::record_first_token(uint64_t p_usec) {
+    metrics_first_token_usec.store(p_usec, std::memory_order_relaxed);
+}
+
+Dictionary LlamaMetrics::get_snapshot() {
+    Dictionary snapshot;
+    snapshot["tokens_per_second"] = _monitor_tokens_per_second();
+    snapshot["time_to_first_token_ms"] = _monitor_time_to_first_token_ms();
+    snapshot["prompt_tokens_per_second"] = _monitor_prompt_tokens_per_second();
+    snapshot["kv_cells_used"] = _monitor_kv_cells_used();
+    snapshot["kv_cells_total"] = _monitor_kv_cells_total();
+    snapshot["kv_usage_percent"] = _monitor_kv_usage_percent();
+    snapshot["contexts"] = _monitor_contexts();
+    snapshot["active_generations"] = _monitor_active_generations();
+    snapshot["queued_requests"] = _monitor_queued_requests();
+    snapshot["model_memory_mb"] = _monitor_model_memory_mb();
+    snapshot["context_memory_mb"] = _monitor_context_memory_mb();
+    snapshot["generated_tokens_total"] = metrics_generated_tokens.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LlamaMetrics::register_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (performance == nullptr) {
+        return;
+    }
+    const Callable monitors[] = {
+        callable_mp_static(&_monitor_tokens_per_second),
+        callable_mp_static(&_monitor_time_to_first_token_ms),
+        callable_mp_static(&_monitor_prompt_tokens_per_second),
+        callable_mp_static(&_monitor_kv_cells_used),
+        callable_mp_static(&_monitor_kv_cells_total),
+        callable_mp_static(&_monitor_kv_usage_percent),
+        callable_mp_static(&_monitor_contexts),
+        callable_mp_static(&_monitor_active_generations),
+        callable_mp_static(&_monitor_queued_requests),
+        callable_mp_static(&_monitor_model_memory_mb),
+        callable_mp_static(&_monitor_context_memory_mb),
+    };
+    static_assert(sizeof(monitors) / sizeof(monitors[0]) == sizeof(METRICS_MONITOR_IDS) / sizeof(METRICS_MONITOR_IDS[0]), "monitor ids and callables differ");
+    for (size_t i = 0; i < sizeof(METRICS_MONITOR_IDS) / sizeof(METRICS_MONITOR_IDS[0]); i++) {
+        const StringName id = METRICS_MONITOR_IDS[i];
+        if (!performance->has_custom_monitor(id)) {
+            performance->add_custom_monitor(id, monitors[i]);
+        }
+    }
+}
+
+void LlamaMetrics::unregister_monitors() {
+    Performance *performance = Performance::get_singleton();
+    if (performance == nullptr) {
+        return;
+    }
+    for (const char *id : METRICS_MONITOR_IDS) {
+        if (performance->has_custom_monitor(id)) {
+            performance->remove_custom_monitor(id);
+        }
+    }
+}
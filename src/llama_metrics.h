@@ -0,0 +1,53 @@
+#ifndef GODOT_LLAMA_METRICS_H
+#define GODOT_LLAMA_METRICS_H
+
+#include <godot_cpp/variant/dictionary.hpp>
+
+#include <cstdint>
+
+namespace godot {
+
+// Process-wide inference counters behind the "godot_llama/*" Performance
+// monitors, summed over every live model, context and batch. Updates are
+// relaxed atomic adds, cheap enough to leave on in release builds.
+class LlamaMetrics {
+public:
+    enum Gauge {
+        GAUGE_CONTEXTS,
+        GAUGE_ACTIVE_GENERATIONS,
+        GAUGE_QUEUED_REQUESTS,
+        GAUGE_KV_CELLS_USED,
+        GAUGE_KV_CELLS_TOTAL,
+        GAUGE_MODEL_BYTES,
+        GAUGE_CONTEXT_BYTES,
+        GAUGE_MAX,
+    };
+
+    // One owner's share of a gauge. set() publishes the difference to the
+    // previous value and the destructor withdraws whatever is left.
+    class Contribution {
+        Gauge gauge;
+        int64_t value = 0;
+
+    public:
+        explicit Contribution(Gauge p_gauge);
+        ~Contribution();
+        Contribution(const Contribution &) = delete;
+        Contribution &operator=(const Contribution &) = delete;
+
+        void set(int64_t p_value);
+        int64_t get() const;
+    };
+
+    static void add_generated_tokens(int64_t p_count);
+    static void record_prompt_eval(int64_t p_tokens, uint64_t p_usec);
+    static void record_first_token(uint64_t p_usec);
+
+    static Dictionary get_snapshot();
+    static void register_monitors();
+    static void unregister_monitors();
+};
+
+} // namespace godot
+
+#endif
@@ -1,5 +1,8 @@
 #include "llama_model.h"
 
+#include "llama_backend.h"
+#include "llama_gguf_reader.h"
+
 #include <godot_cpp/classes/file_access.hpp>
 #include <godot_cpp/classes/project_settings.hpp>
 #include <godot_cpp/core/class_db.hpp>
@@ -19,7 +22,7 @@ String LlamaModel::_globalize_path(const String &p_path) {
     return p_path;
 }
 
-bool LlamaModel::_load_tokenize_internal(const String &p_text, bool p_add_bos, PackedInt32Array &r_tokens) const {
+bool LlamaModel::_load_tokenize_internal(const String &p_text, bool p_add_bos, bool p_parse_special, PackedInt32Array &r_tokens) const {
     if (!is_loaded()) {
         return false;
     }
@@ -27,7 +30,7 @@ bool LlamaModel::_load_tokenize_internal(const String &p_text, bool p_add_bos, P
     CharString text_utf8 = p_text.utf8();
     const int32_t text_len = static_cast<int32_t>(text_utf8.length());
 
-    int32_t token_count = llama_tokenize(vocab, text_utf8.get_data(), text_len, nullptr, 0, p_add_bos, false);
+    int32_t token_count = llama_tokenize(vocab, text_utf8.get_data(), text_len, nullptr, 0, p_add_bos, p_parse_special);
     if (token_count == INT32_MIN) {
         return false;
     }
@@ -40,7 +43,7 @@ bool LlamaModel::_load_tokenize_internal(const String &p_text, bool p_add_bos, P
     }
 
     std::vector<llama_token> tokens(token_count);
-    int32_t rc = llama_tokenize(vocab, text_utf8.get_data(), text_len, tokens.data(), token_count, p_add_bos, false);
+    int32_t rc = llama_tokenize(vocab, text_utf8.get_data(), text_len, tokens.data(), token_count, p_add_bos, p_parse_special);
     if (rc < 0) {
         return false;
     }
@@ -56,10 +59,16 @@ void LlamaModel::_bind_methods() {
     ClassDB::bind_method(D_METHOD("unload"), &LlamaModel::unload);
     ClassDB::bind_method(D_METHOD("is_loaded"), &LlamaModel::is_loaded);
     ClassDB::bind_method(D_METHOD("get_model_path"), &LlamaModel::get_model_path);
-    ClassDB::bind_method(D_METHOD("tokenize", "text", "add_bos"), &LlamaModel::tokenize, DEFVAL(true));
+    ClassDB::bind_method(D_METHOD("tokenize", "text", "add_bos", "parse_special"), &LlamaModel::tokenize, DEFVAL(true), DEFVAL(false));
     ClassDB::bind_method(D_METHOD("detokenize", "tokens"), &LlamaModel::detokenize);
     ClassDB::bind_method(D_METHOD("get_vocab_size"), &LlamaModel::get_vocab_size);
     ClassDB::bind_method(D_METHOD("get_metadata"), &LlamaModel::get_metadata);
+    ClassDB::bind_method(D_METHOD("get_chat_template"), &LlamaModel::get_chat_template);
+    ClassDB::bind_method(D_METHOD("load_lora", "name", "path"), &LlamaModel::load_lora);
+    ClassDB::bind_method(D_METHOD("has_lora", "name"), &LlamaModel::has_lora);
+    ClassDB::bind_method(D_METHOD("get_lora_names"), &LlamaModel::get_lora_names);
+    ClassDB::bind_static_method("LlamaModel", D_METHOD("inspect", "model_path"), &LlamaModel::inspect);
+    ClassDB::bind_static_method("LlamaModel", D_METHOD("get_backend_info"), &LlamaModel::get_backend_info);
 }
 
 LlamaModel::~LlamaModel() {
@@ -100,16 +109,35 @@ Error LlamaModel::load(const String &p_model_path, const Dictionary &p_params) {
 
     vocab = llama_model_get_vocab(native_model);
     model_path = p_model_path;
+    _build_metadata_cache();
+
+    char desc[256] = {};
+    llama_model_desc(native_model, desc, sizeof(desc));
+    model_identity = vformat("%s|%d|%d|%d|%s",
+            global_path,
+            static_cast<int64_t>(FileAccess::get_modified_time(global_path)),
+            static_cast<int64_t>(llama_model_size(native_model)),
+            static_cast<int64_t>(llama_model_n_params(native_model)),
+            String::utf8(desc));
+    metric_model_bytes.set(static_cast<int64_t>(llama_model_size(native_model)));
     return OK;
 }
 
 void LlamaModel::unload() {
+    for (LoraAdapter &lora : lora_adapters) {
+        llama_adapter_lora_free(lora.adapter);
+    }
+    lora_adapters.clear();
+
     if (native_model != nullptr) {
         llama_model_free(native_model);
         native_model = nullptr;
     }
     vocab = nullptr;
+    metric_model_bytes.set(0);
     model_path = "";
+    model_identity = "";
+    metadata_cache = Dictionary();
 }
 
 bool LlamaModel::is_loaded() const {
@@ -120,9 +148,9 @@ String LlamaModel::get_model_path() const {
     return model_path;
 }
 
-PackedInt32Array LlamaModel::tokenize(const String &p_text, bool p_add_bos) const {
+PackedInt32Array LlamaModel::tokenize(const String &p_text, bool p_add_bos, bool p_parse_special) const {
     PackedInt32Array tokens;
-    if (!_load_tokenize_internal(p_text, p_add_bos, tokens)) {
+    if (!_load_tokenize_internal(p_text, p_add_bos, p_parse_special, tokens)) {
         UtilityFunctions::push_error("godot_llama: tokenize failed");
     }
     return tokens;
@@ -163,26 +191,102 @@ int LlamaModel::get_vocab_size() const {
     return llama_vocab_n_tokens(vocab);
 }
 
-Dictionary LlamaModel::get_metadata() const {
-    Dictionary metadata;
-    if (!is_loaded()) {
-        return metadata;
-    }
+void LlamaModel::_build_metadata_cache() {
+    metadata_cache = Dictionary();
 
+    std::vector<char> key_buf(256, '\0');
+    std::vector<char> val_buf(1024, '\0');
     const int32_t count = llama_model_meta_count(native_model);
     for (int32_t i = 0; i < count; i++) {
-        std::vector<char> key_buf(512, '\0');
-        std::vector<char> val_buf(2048, '\0');
-
-        int32_t key_len = llama_model_meta_key_by_index(native_model, i, key_buf.data(), static_cast<size_t>(key_buf.size()));
-        int32_t val_len = llama_model_meta_val_str_by_index(native_model, i, val_buf.data(), static_cast<size_t>(val_buf.size()));
+        // Both getters return the full length snprintf-style, so grow and retry
+        // instead of truncating long values such as chat templates.
+        int32_t key_len = llama_model_meta_key_by_index(native_model, i, key_buf.data(), key_buf.size());
+        if (key_len >= static_cast<int32_t>(key_buf.size())) {
+            key_buf.resize(static_cast<size_t>(key_len) + 1);
+            key_len = llama_model_meta_key_by_index(native_model, i, key_buf.data(), key_buf.size());
+        }
+        int32_t val_len = llama_model_meta_val_str_by_index(native_model, i, val_buf.data(), val_buf.size());
+        if (val_len >= static_cast<int32_t>(val_buf.size())) {
+            val_buf.resize(static_cast<size_t>(val_len) + 1);
+            val_len = llama_model_meta_val_str_by_index(native_model, i, val_buf.data(), val_buf.size());
+        }
         if (key_len <= 0 || val_len < 0) {
             continue;
         }
 
-        metadata[String::utf8(key_buf.data())] = String::utf8(val_buf.data());
+        metadata_cache[String::utf8(key_buf.data(), key_len)] = String::utf8(val_buf.data(), val_len);
     }
-    return metadata;
+    metadata_cache.make_read_only();
+}
+
+Dictionary LlamaModel::get_metadata() const {
+    return metadata_cache;
+}
+
+String LlamaModel::get_chat_template() const {
+    if (!is_loaded()) {
+        return "";
+    }
+    const char *tmpl = llama_model_chat_template(native_model, nullptr);
+    return tmpl != nullptr ? String::utf8(tmpl) : String();
+}
+
+Error LlamaModel::load_lora(const String &p_name, const String &p_path) {
+    if (!is_loaded()) {
+        return ERR_UNCONFIGURED;
+    }
+    if (p_name.is_empty()) {
+        return ERR_INVALID_PARAMETER;
+    }
+    // Contexts keep raw adapter pointers, so a name is never rebound while the
+    // base model is loaded.
+    if (has_lora(p_name)) {
+        return ERR_ALREADY_EXISTS;
+    }
+
+    const String global_path = _globalize_path(p_path);
+    if (!FileAccess::file_exists(global_path)) {
+        return ERR_FILE_NOT_FOUND;
+    }
+
+    CharString path_utf8 = global_path.utf8();
+    llama_adapter_lora *adapter = llama_adapter_lora_init(native_model, path_utf8.get_data());
+    if (adapter == nullptr) {
+        UtilityFunctions::push_error("godot_llama: failed to load LoRA adapter: ", global_path);
+        return ERR_CANT_OPEN;
+    }
+
+    LoraAdapter lora;
+    lora.name = p_name;
+    lora.path = p_path;
+    lora.adapter = adapter;
+    lora_adapters.push_back(lora);
+    return OK;
+}
+
+bool LlamaModel::has_lora(const String &p_name) const {
+    return get_lora(p_name) != nullptr;
+}
+
+PackedStringArray LlamaModel::get_lora_names() const {
+    PackedStringArray names;
+    for (const LoraAdapter &lora : lora_adapters) {
+        names.append(lora.name);
+    }
+    return names;
+}
+
+Dictionary LlamaModel::inspect(const String &p_model_path) {
+    LlamaGGUFReader reader;
+    Dictionary info = reader.inspect(p_model_path);
+    if (info.is_empty()) {
+        UtilityFunctions::push_error("godot_llama: failed to inspect model: ", p_model_path, " (", reader.get_error(), ")");
+    }
+    return info;
+}
+
+Dictionary LlamaModel::get_backend_info() {
+    return LlamaBackend::get_info();
 }
 
 const struct llama_model *LlamaModel::get_native_model() const {
@@ -192,3 +296,16 @@ const struct llama_model *LlamaModel::get_native_model() const {
 const struct llama_vocab *LlamaModel::get_vocab() const {
     return vocab;
 }
+
+String LlamaModel::get_identity() const {
+    return model_identity;
+}
+
+struct llama_adapter_lora *LlamaModel::get_lora(const String &p_name) const {
+    for (const LoraAdapter &lora : lora_adapters) {
+        if (lora.name == p_name) {
+            return lora.adapter;
+        }
+    }
+    return nullptr;
+}
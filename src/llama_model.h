@@ -1,11 +1,16 @@
 #ifndef GODOT_LLAMA_MODEL_H
 #define GODOT_LLAMA_MODEL_H
 
+#include "llama_metrics.h"
+
 #include <godot_cpp/classes/ref_counted.hpp>
 #include <godot_cpp/variant/dictionary.hpp>
 #include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
 #include <godot_cpp/variant/string.hpp>
+#include <vector>
 
+struct llama_adapter_lora;
 struct llama_model;
 struct llama_vocab;
 
@@ -15,12 +20,23 @@ class LlamaModel : public RefCounted {
     GDCLASS(LlamaModel, RefCounted);
 
 private:
+    struct LoraAdapter {
+        String name;
+        String path;
+        struct llama_adapter_lora *adapter = nullptr;
+    };
+
     struct llama_model *native_model = nullptr;
     const struct llama_vocab *vocab = nullptr;
     String model_path;
+    String model_identity;
+    Dictionary metadata_cache;
+    std::vector<LoraAdapter> lora_adapters;
+    LlamaMetrics::Contribution metric_model_bytes{ LlamaMetrics::GAUGE_MODEL_BYTES };
 
-    bool _load_tokenize_internal(const String &p_text, bool p_add_bos, PackedInt32Array &r_tokens) const;
+    bool _load_tokenize_internal(const String &p_text, bool p_add_bos, bool p_parse_special, PackedInt32Array &r_tokens) const;
     static String _globalize_path(const String &p_path);
+    void _build_metadata_cache();
 
 protected:
     static void _bind_methods();
@@ -32,13 +48,22 @@ public:
     void unload();
     bool is_loaded() const;
     String get_model_path() const;
-    PackedInt32Array tokenize(const String &p_text, bool p_add_bos = true) const;
+    PackedInt32Array tokenize(const String &p_text, bool p_add_bos = true, bool p_parse_special = false) const;
     String detokenize(const PackedInt32Array &p_tokens) const;
     int get_vocab_size() const;
     Dictionary get_metadata() const;
+    String get_chat_template() const;
+    Error load_lora(const String &p_name, const String &p_path);
+    bool has_lora(const String &p_name) const;
+    PackedStringArray get_lora_names() const;
+
+    static Dictionary inspect(const String &p_model_path);
+    static Dictionary get_backend_info();
 
     const struct llama_model *get_native_model() const;
     const struct llama_vocab *get_vocab() const;
+    String get_identity() const;
+    struct llama_adapter_lora *get_lora(const String &p_name) const;
 };
 
 } // namespace godot
@@ -0,0 +1,458 @@
+#include "llama_phrase_filter.h"
+
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/array.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+#include <limits>
+#include <map>
+
+using namespace godot;
+
+namespace {
+
+constexpr int32_t PHRASE_FILTER_MAX_MATCHES = 32;
+
+// 64-bit FNV-1a, enough to tell compiled sets apart in cache keys.
+constexpr uint64_t PHRASE_HASH_OFFSET = 14695981039346656037ULL;
+constexpr uint64_t PHRASE_HASH_PRIME = 1099511628211ULL;
+
+void _phrase_hash_bytes(uint64_t &r_hash, const void *p_data, size_t p_size) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(p_data);
+    for (size_t i = 0; i < p_size; i++) {
+        r_hash = (r_hash ^ bytes[i]) * PHRASE_HASH_PRIME;
+    }
+}
+
+template <typename T>
+void _phrase_hash_pod(uint64_t &r_hash, const T &p_value) {
+    _phrase_hash_bytes(r_hash, &p_value, sizeof(T));
+}
+
+// Covers everything a generation reads from the set: the trie, the biases
+// and the lowered phrases used for text matching.
+uint64_t _phrase_set_hash(const LlamaPhraseSet &p_set) {
+    uint64_t hash = PHRASE_HASH_OFFSET;
+    _phrase_hash_pod(hash, static_cast<uint64_t>(p_set.nodes.size()));
+    for (const LlamaPhraseSet::Node &node : p_set.nodes) {
+        const uint8_t terminal = node.terminal ? 1 : 0;
+        _phrase_hash_pod(hash, terminal);
+        _phrase_hash_pod(hash, static_cast<uint32_t>(node.children.size()));
+        for (const std::pair<int32_t, int32_t> &child : node.children) {
+            _phrase_hash_pod(hash, child.first);
+            _phrase_hash_pod(hash, child.second);
+        }
+    }
+    _phrase_hash_pod(hash, static_cast<uint64_t>(p_set.biases.size()));
+    for (const std::pair<int32_t, float> &bias : p_set.biases) {
+        _phrase_hash_pod(hash, bias.first);
+        _phrase_hash_pod(hash, bias.second);
+    }
+    _phrase_hash_pod(hash, static_cast<uint64_t>(p_set.phrases_lower.size()));
+    for (const String &phrase : p_set.phrases_lower) {
+        const CharString utf8 = phrase.utf8();
+        _phrase_hash_pod(hash, static_cast<uint32_t>(utf8.length()));
+        _phrase_hash_bytes(hash, utf8.get_data(), static_cast<size_t>(utf8.length()));
+    }
+    return hash;
+}
+
+bool _phrase_is_word_char(char32_t p_char) {
+    return (p_char >= '0' && p_char <= '9') || (p_char >= 'a' && p_char <= 'z') || (p_char >= 'A' && p_char <= 'Z') || p_char == '_' || p_char > 127;
+}
+
+int64_t _phrase_find_candidate(const llama_token_data_array *p_cur, int32_t p_token) {
+    // The filter runs first in the chain, where candidates are still in
+    // vocabulary order; later stages may have sorted or truncated them.
+    if (p_token >= 0 && static_cast<size_t>(p_token) < p_cur->size && p_cur->data[p_token].id == p_token) {
+        return p_token;
+    }
+    for (size_t i = 0; i < p_cur->size; i++) {
+        if (p_cur->data[i].id == p_token) {
+            return static_cast<int64_t>(i);
+        }
+    }
+    return -1;
+}
+
+const char *_phrase_filter_sampler_name(const struct llama_sampler *) {
+    return "godot_llama.phrase_filter";
+}
+
+void _phrase_filter_sampler_apply(struct llama_sampler *p_sampler, llama_token_data_array *r_cur) {
+    static_cast<LlamaPhraseFilterState *>(p_sampler->ctx)->apply(r_cur);
+}
+
+} // namespace
+
+int32_t LlamaPhraseSet::find_child(int32_t p_node, int32_t p_token) const {
+    const std::vector<std::pair<int32_t, int32_t>> &children = nodes[p_node].children;
+    auto it = std::lower_bound(children.begin(), children.end(), std::make_pair(p_token, std::numeric_limits<int32_t>::min()));
+    return it != children.end() && it->first == p_token ? it->second : -1;
+}
+
+LlamaPhraseFilterState::LlamaPhraseFilterState(const std::shared_ptr<const LlamaPhraseSet> &p_set, int32_t p_max_backtrack) :
+        phrase_set(p_set),
+        max_backtrack(std::max(0, p_max_backtrack)) {
+}
+
+void LlamaPhraseFilterState::apply(llama_token_data_array *r_cur) {
+    backtrack_request = -1;
+    const float blocked = -std::numeric_limits<float>::infinity();
+    const LlamaPhraseSet &set = *phrase_set;
+
+    for (const std::pair<int32_t, float> &bias : set.biases) {
+        const int64_t index = _phrase_find_candidate(r_cur, bias.first);
+        if (index >= 0) {
+            r_cur->data[index].logit += bias.second;
+        }
+    }
+
+    const int32_t position = static_cast<int32_t>(tokens.size());
+    if (static_cast<size_t>(position) < bans.size()) {
+        for (int32_t token : bans[position]) {
+            const int64_t index = _phrase_find_candidate(r_cur, token);
+            if (index >= 0) {
+                r_cur->data[index].logit = blocked;
+            }
+        }
+    }
+
+    bool have_best = false;
+    float best = blocked;
+    auto block_completions = [&](const Match &p_match) {
+        for (const std::pair<int32_t, int32_t> &child : set.nodes[p_match.node].children) {
+            if (!set.nodes[child.second].terminal) {
+                continue;
+            }
+            const int64_t index = _phrase_find_candidate(r_cur, child.first);
+            if (index < 0 || r_cur->data[index].logit == blocked) {
+                continue;
+            }
+            // Only a completion the model actually wanted is worth rewinding
+            // for; otherwise blocking it costs nothing.
+            if (p_match.start < position && position - p_match.start <= max_backtrack) {
+                if (!have_best) {
+                    for (size_t i = 0; i < r_cur->size; i++) {
+                        best = std::max(best, r_cur->data[i].logit);
+                    }
+                    have_best = true;
+                }
+                if (r_cur->data[index].logit >= best && (backtrack_request < 0 || p_match.start < backtrack_request)) {
+                    backtrack_request = p_match.start;
+                }
+            }
+            r_cur->data[index].logit = blocked;
+            blocked_tokens++;
+        }
+    };
+
+    block_completions(Match{ 0, position });
+    if (position > 0) {
+        for (const Match &match : matches[position - 1]) {
+            block_completions(match);
+        }
+    }
+}
+
+void LlamaPhraseFilterState::push(int32_t p_token) {
+    const LlamaPhraseSet &set = *phrase_set;
+    const int32_t position = static_cast<int32_t>(tokens.size());
+    std::vector<Match> next;
+    auto advance = [&](const Match &p_match) {
+        const int32_t child = set.find_child(p_match.node, p_token);
+        if (child > 0 && !set.nodes[child].children.empty() && next.size() < PHRASE_FILTER_MAX_MATCHES) {
+            next.push_back(Match{ child, p_match.start });
+        }
+    };
+
+    if (position > 0) {
+        for (const Match &match : matches[position - 1]) {
+            advance(match);
+        }
+    }
+    advance(Match{ 0, position });
+    tokens.push_back(p_token);
+    matches.push_back(std::move(next));
+}
+
+void LlamaPhraseFilterState::rewind(int32_t p_length) {
+    const size_t length = static_cast<size_t>(std::clamp<int32_t>(p_length, 0, static_cast<int32_t>(tokens.size())));
+    tokens.resize(length);
+    matches.resize(length);
+    // Bans past the rewind point were made for a different prefix.
+    if (bans.size() > length + 1) {
+        bans.resize(length + 1);
+    }
+}
+
+void LlamaPhraseFilterState::ban(int32_t p_position, int32_t p_token) {
+    if (p_position < 0) {
+        return;
+    }
+    if (bans.size() <= static_cast<size_t>(p_position)) {
+        bans.resize(p_position + 1);
+    }
+    bans[p_position].push_back(p_token);
+}
+
+int32_t LlamaPhraseFilterState::take_backtrack_request() {
+    const int32_t request = backtrack_request;
+    backtrack_request = -1;
+    return request;
+}
+
+int32_t LlamaPhraseFilterState::get_stable_length() const {
+    int32_t stable = static_cast<int32_t>(tokens.size());
+    if (!matches.empty()) {
+        for (const Match &match : matches.back()) {
+            stable = std::min(stable, match.start);
+        }
+    }
+    return stable;
+}
+
+int64_t LlamaPhraseFilterState::find_text_match(const String &p_text, int64_t p_from, bool p_final) const {
+    const LlamaPhraseSet &set = *phrase_set;
+    if (set.phrases_lower.empty()) {
+        return -1;
+    }
+
+    // Matches ending exactly at p_from were deferred last time because the
+    // character after them was not known yet, so they are checked again.
+    const int64_t begin = std::max<int64_t>(0, p_from - set.max_phrase_chars);
+    const String tail = p_text.substr(begin).to_lower();
+    const int64_t text_length = p_text.length();
+    int64_t first = -1;
+    for (const String &phrase : set.phrases_lower) {
+        const bool word_start = _phrase_is_word_char(phrase[0]);
+        const bool word_end = _phrase_is_word_char(phrase[phrase.length() - 1]);
+        for (int64_t pos = tail.find(phrase); pos >= 0; pos = tail.find(phrase, pos + 1)) {
+            const int64_t start = begin + pos;
+            const int64_t end = start + phrase.length();
+            if (end < p_from || (first >= 0 && start >= first)) {
+                continue;
+            }
+            if (word_start && start > 0 && _phrase_is_word_char(p_text[start - 1])) {
+                continue;
+            }
+            if (word_end && (end < text_length ? _phrase_is_word_char(p_text[end]) : !p_final)) {
+                continue;
+            }
+            first = start;
+        }
+    }
+    return first;
+}
+
+int32_t LlamaPhraseFilterState::get_length() const {
+    return static_cast<int32_t>(tokens.size());
+}
+
+int32_t LlamaPhraseFilterState::get_token(int32_t p_index) const {
+    return tokens[p_index];
+}
+
+int32_t LlamaPhraseFilterState::get_max_backtrack() const {
+    return max_backtrack;
+}
+
+int32_t LlamaPhraseFilterState::get_max_phrase_chars() const {
+    return phrase_set->max_phrase_chars;
+}
+
+int64_t LlamaPhraseFilterState::get_blocked_tokens() const {
+    return blocked_tokens;
+}
+
+struct llama_sampler *LlamaPhraseFilterState::create_sampler() {
+    static llama_sampler_i iface = {};
+    iface.name = _phrase_filter_sampler_name;
+    iface.apply = _phrase_filter_sampler_apply;
+    return llama_sampler_init(&iface, this);
+}
+
+void LlamaPhraseFilter::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("compile", "model", "phrases", "logit_bias"), &LlamaPhraseFilter::compile, DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("clear"), &LlamaPhraseFilter::clear);
+    ClassDB::bind_method(D_METHOD("is_compiled"), &LlamaPhraseFilter::is_compiled);
+    ClassDB::bind_method(D_METHOD("get_phrases"), &LlamaPhraseFilter::get_phrases);
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaPhraseFilter::get_stats);
+    ClassDB::bind_method(D_METHOD("set_max_backtrack", "tokens"), &LlamaPhraseFilter::set_max_backtrack);
+    ClassDB::bind_method(D_METHOD("get_max_backtrack"), &LlamaPhraseFilter::get_max_backtrack);
+    ClassDB::bind_method(D_METHOD("set_case_variants", "enabled"), &LlamaPhraseFilter::set_case_variants);
+    ClassDB::bind_method(D_METHOD("get_case_variants"), &LlamaPhraseFilter::get_case_variants);
+    ClassDB::bind_method(D_METHOD("set_match_text", "enabled"), &LlamaPhraseFilter::set_match_text);
+    ClassDB::bind_method(D_METHOD("get_match_text"), &LlamaPhraseFilter::get_match_text);
+
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_backtrack"), "set_max_backtrack", "get_max_backtrack");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "case_variants"), "set_case_variants", "get_case_variants");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "match_text"), "set_match_text", "get_match_text");
+}
+
+void LlamaPhraseFilter::_add_variants(const String &p_phrase, bool p_case_variants, PackedStringArray &r_variants) {
+    PackedStringArray cased;
+    cased.append(p_phrase);
+    if (p_case_variants) {
+        cased.append(p_phrase.substr(0, 1).to_upper() + p_phrase.substr(1));
+        cased.append(p_phrase.substr(0, 1).to_lower() + p_phrase.substr(1));
+        cased.append(p_phrase.to_lower());
+    }
+    // The same words tokenize differently at the start of a text and after a
+    // space, and the model can produce either.
+    for (int i = 0; i < cased.size(); i++) {
+        const String spaced = " " + cased[i];
+        if (!r_variants.has(cased[i])) {
+            r_variants.append(cased[i]);
+        }
+        if (!r_variants.has(spaced)) {
+            r_variants.append(spaced);
+        }
+    }
+}
+
+Error LlamaPhraseFilter::compile(const Ref<LlamaModel> &p_model, const PackedStringArray &p_phrases, const Dictionary &p_logit_bias) {
+    if (p_model.is_null() || !p_model->is_loaded()) {
+        UtilityFunctions::push_error("godot_llama: LlamaPhraseFilter.compile() needs a loaded model");
+        return ERR_UNCONFIGURED;
+    }
+
+    std::shared_ptr<LlamaPhraseSet> set = std::make_shared<LlamaPhraseSet>();
+    set->vocab = p_model->get_vocab();
+    set->nodes.emplace_back();
+    std::vector<std::map<int32_t, int32_t>> edges(1);
+    PackedStringArray kept;
+
+    for (int i = 0; i < p_phrases.size(); i++) {
+        const String phrase = p_phrases[i].strip_edges();
+        if (phrase.is_empty() || kept.has(phrase)) {
+            continue;
+        }
+        kept.append(phrase);
+        set->phrases_lower.push_back(phrase.to_lower());
+        set->max_phrase_chars = std::max(set->max_phrase_chars, static_cast<int32_t>(phrase.length()));
+
+        PackedStringArray variants;
+        _add_variants(phrase, case_variants, variants);
+        for (int v = 0; v < variants.size(); v++) {
+            const PackedInt32Array tokens = p_model->tokenize(variants[v], false, false);
+            if (tokens.is_empty()) {
+                continue;
+            }
+            int32_t node = 0;
+            for (int t = 0; t < tokens.size(); t++) {
+                auto it = edges[node].find(tokens[t]);
+                if (it == edges[node].end()) {
+                    const int32_t child = static_cast<int32_t>(set->nodes.size());
+                    set->nodes.emplace_back();
+                    edges.emplace_back();
+                    edges[node][tokens[t]] = child;
+                    node = child;
+                } else {
+                    node = it->second;
+                }
+            }
+            if (!set->nodes[node].terminal) {
+                set->nodes[node].terminal = true;
+                set->sequence_count++;
+                set->max_sequence_tokens = std::max(set->max_sequence_tokens, static_cast<int32_t>(tokens.size()));
+            }
+        }
+    }
+    for (size_t n = 0; n < edges.size(); n++) {
+        set->nodes[n].children.assign(edges[n].begin(), edges[n].end());
+    }
+
+    // Text keys bias the first token of each spelling; that is the decision
+    // point for the whole word.
+    std::map<int32_t, float> biases;
+    const int vocab_size = p_model->get_vocab_size();
+    const Array keys = p_logit_bias.keys();
+    for (int64_t i = 0; i < keys.size(); i++) {
+        const float bias = static_cast<float>(double(p_logit_bias[keys[i]]));
+        if (keys[i].get_type() == Variant::INT) {
+            const int64_t token = keys[i];
+            if (token < 0 || token >= vocab_size) {
+                UtilityFunctions::push_warning("godot_llama: logit_bias token ", token, " is outside the vocabulary");
+                continue;
+            }
+            biases[static_cast<int32_t>(token)] = bias;
+        } else if (keys[i].get_type() == Variant::STRING) {
+            PackedStringArray variants;
+            _add_variants(String(keys[i]), case_variants, variants);
+            for (int v = 0; v < variants.size(); v++) {
+                const PackedInt32Array tokens = p_model->tokenize(variants[v], false, false);
+                if (!tokens.is_empty()) {
+                    biases[tokens[0]] = bias;
+                }
+            }
+        } else {
+            UtilityFunctions::push_warning("godot_llama: logit_bias keys must be token ids or strings");
+        }
+    }
+    set->biases.assign(biases.begin(), biases.end());
+    set->content_hash = _phrase_set_hash(*set);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    phrase_set = std::move(set);
+    phrases = kept;
+    return OK;
+}
+
+void LlamaPhraseFilter::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    phrase_set.reset();
+    phrases = PackedStringArray();
+}
+
+bool LlamaPhraseFilter::is_compiled() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return phrase_set != nullptr;
+}
+
+PackedStringArray LlamaPhraseFilter::get_phrases() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return phrases;
+}
+
+Dictionary LlamaPhraseFilter::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Dictionary stats;
+    stats["phrases"] = phrases.size();
+    stats["sequences"] = phrase_set ? phrase_set->sequence_count : 0;
+    stats["max_sequence_tokens"] = phrase_set ? phrase_set->max_sequence_tokens : 0;
+    stats["nodes"] = phrase_set ? static_cast<int64_t>(phrase_set->nodes.size()) : 0;
+    stats["bias_tokens"] = phrase_set ? static_cast<int64_t>(phrase_set->biases.size()) : 0;
+    return stats;
+}
+
+void LlamaPhraseFilter::set_max_backtrack(int p_tokens) {
+    max_backtrack = std::max(0, p_tokens);
+}
+
+int LlamaPhraseFilter::get_max_backtrack() const {
+    return max_backtrack;
+}
+
+void LlamaPhraseFilter::set_case_variants(bool p_enabled) {
+    case_variants = p_enabled;
+}
+
+bool LlamaPhraseFilter::get_case_variants() const {
+    return case_variants;
+}
+
+void LlamaPhraseFilter::set_match_text(bool p_enabled) {
+    match_text = p_enabled;
+}
+
+bool LlamaPhraseFilter::get_match_text() const {
+    return match_text;
+}
+
+std::shared_ptr<const LlamaPhraseSet> LlamaPhraseFilter::get_phrase_set() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return phrase_set;
+}
@@ -0,0 +1,127 @@
+#ifndef GODOT_LLAMA_PHRASE_FILTER_H
+#define GODOT_LLAMA_PHRASE_FILTER_H
+
+#include "llama_model.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct llama_sampler;
+struct llama_token_data_array;
+struct llama_vocab;
+
+namespace godot {
+
+// Immutable result of LlamaPhraseFilter::compile(). Generations hold it by
+// shared_ptr, so recompiling a filter never pulls data from under a sampler.
+struct LlamaPhraseSet {
+    struct Node {
+        // (token, child node) sorted by token.
+        std::vector<std::pair<int32_t, int32_t>> children;
+        bool terminal = false;
+    };
+
+    const struct llama_vocab *vocab = nullptr;
+    std::vector<Node> nodes;
+    std::vector<std::pair<int32_t, float>> biases;
+    std::vector<String> phrases_lower;
+    int32_t max_phrase_chars = 0;
+    int32_t max_sequence_tokens = 0;
+    int32_t sequence_count = 0;
+    // Hash of the trie, biases and phrases; equal sets from different
+    // filters or compiles share result-cache entries.
+    uint64_t content_hash = 0;
+
+    int32_t find_child(int32_t p_node, int32_t p_token) const;
+};
+
+// Per-generation matcher driven by the context. The context pushes every
+// committed token and rewinds on backtracking; the sampler stage returned by
+// create_sampler() reads that state, so llama_sampler_accept() is not used.
+class LlamaPhraseFilterState {
+public:
+    struct Match {
+        int32_t node = 0;
+        int32_t start = 0;
+    };
+
+private:
+    std::shared_ptr<const LlamaPhraseSet> phrase_set;
+    int32_t max_backtrack = 4;
+    std::vector<int32_t> tokens;
+    std::vector<std::vector<Match>> matches;
+    std::vector<std::vector<int32_t>> bans;
+    int32_t backtrack_request = -1;
+    int64_t blocked_tokens = 0;
+
+public:
+    LlamaPhraseFilterState(const std::shared_ptr<const LlamaPhraseSet> &p_set, int32_t p_max_backtrack);
+
+    void apply(struct llama_token_data_array *r_cur);
+    void push(int32_t p_token);
+    void rewind(int32_t p_length);
+    void ban(int32_t p_position, int32_t p_token);
+
+    // Start of the partial phrase whose completion was blocked while it was
+    // the most likely token, or -1. Cleared by the call.
+    int32_t take_backtrack_request();
+    // Tokens before this index are not part of any partial phrase match.
+    int32_t get_stable_length() const;
+    // Character offset of a banned phrase that ends after p_from in p_text,
+    // or -1. With p_final the end of the text counts as a word boundary.
+    int64_t find_text_match(const String &p_text, int64_t p_from, bool p_final) const;
+
+    int32_t get_length() const;
+    int32_t get_token(int32_t p_index) const;
+    int32_t get_max_backtrack() const;
+    int32_t get_max_phrase_chars() const;
+    int64_t get_blocked_tokens() const;
+    struct llama_sampler *create_sampler();
+};
+
+// Banned phrases and logit biases tokenized once per model into a token trie.
+// Pass the filter as params["phrase_filter"] to any generate call.
+class LlamaPhraseFilter : public RefCounted {
+    GDCLASS(LlamaPhraseFilter, RefCounted);
+
+private:
+    mutable std::mutex mutex;
+    std::shared_ptr<const LlamaPhraseSet> phrase_set;
+    PackedStringArray phrases;
+    int32_t max_backtrack = 4;
+    bool case_variants = true;
+    bool match_text = true;
+
+    static void _add_variants(const String &p_phrase, bool p_case_variants, PackedStringArray &r_variants);
+
+protected:
+    static void _bind_methods();
+
+public:
+    Error compile(const Ref<LlamaModel> &p_model, const PackedStringArray &p_phrases, const Dictionary &p_logit_bias = Dictionary());
+    void clear();
+    bool is_compiled() const;
+    PackedStringArray get_phrases() const;
+    Dictionary get_stats() const;
+
+    void set_max_backtrack(int p_tokens);
+    int get_max_backtrack() const;
+    void set_case_variants(bool p_enabled);
+    bool get_case_variants() const;
+    void set_match_text(bool p_enabled);
+    bool get_match_text() const;
+
+    std::shared_ptr<const LlamaPhraseSet> get_phrase_set() const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,353 @@
+#include "llama_prompt_builder.h"
+
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+using namespace godot;
+
+static void _append_tokens(std::vector<int32_t> &r_tokens, const PackedInt32Array &p_tokens) {
+    r_tokens.reserve(r_tokens.size() + static_cast<size_t>(p_tokens.size()));
+    for (int i = 0; i < p_tokens.size(); i++) {
+        r_tokens.push_back(p_tokens[i]);
+    }
+}
+
+void LlamaPromptBuilder::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_context", "context"), &LlamaPromptBuilder::set_context);
+    ClassDB::bind_method(D_METHOD("get_context"), &LlamaPromptBuilder::get_context);
+    ClassDB::bind_method(D_METHOD("set_token_budget", "token_budget"), &LlamaPromptBuilder::set_token_budget);
+    ClassDB::bind_method(D_METHOD("get_token_budget"), &LlamaPromptBuilder::get_token_budget);
+    ClassDB::bind_method(D_METHOD("set_parse_special", "parse_special"), &LlamaPromptBuilder::set_parse_special);
+    ClassDB::bind_method(D_METHOD("get_parse_special"), &LlamaPromptBuilder::get_parse_special);
+    ClassDB::bind_method(D_METHOD("set_section", "name", "content", "priority", "max_tokens", "keep_end"), &LlamaPromptBuilder::set_section, DEFVAL(0), DEFVAL(0), DEFVAL(false));
+    ClassDB::bind_method(D_METHOD("remove_section", "name"), &LlamaPromptBuilder::remove_section);
+    ClassDB::bind_method(D_METHOD("has_section", "name"), &LlamaPromptBuilder::has_section);
+    ClassDB::bind_method(D_METHOD("get_section_names"), &LlamaPromptBuilder::get_section_names);
+    ClassDB::bind_method(D_METHOD("clear"), &LlamaPromptBuilder::clear);
+    ClassDB::bind_method(D_METHOD("build", "max_tokens"), &LlamaPromptBuilder::build, DEFVAL(128));
+    ClassDB::bind_method(D_METHOD("generate", "max_tokens", "params"), &LlamaPromptBuilder::generate, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("generate_stream", "max_tokens", "params"), &LlamaPromptBuilder::generate_stream, DEFVAL(128), DEFVAL(Dictionary()));
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaPromptBuilder::get_stats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::OBJECT, "context", PROPERTY_HINT_RESOURCE_TYPE, "LlamaContext"), "set_context", "get_context");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "token_budget"), "set_token_budget", "get_token_budget");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "parse_special"), "set_parse_special", "get_parse_special");
+}
+
+bool LlamaPromptBuilder::_is_ready() const {
+    return context.is_valid() && context->is_initialized() && context->get_model().is_valid() && context->get_model()->is_loaded();
+}
+
+LlamaPromptBuilder::Section *LlamaPromptBuilder::_find_section(const String &p_name) {
+    for (Section &section : sections) {
+        if (section.name == p_name) {
+            return &section;
+        }
+    }
+    return nullptr;
+}
+
+bool LlamaPromptBuilder::_tokenize_pending(String &r_error) {
+    const Ref<LlamaModel> model = context->get_model();
+    if (model->get_native_model() != tokenized_model) {
+        // Token ids only mean something to the vocabulary that produced them.
+        for (Section &section : sections) {
+            for (Item &item : section.items) {
+                item.tokenized = false;
+            }
+        }
+        bos_tokens.clear();
+        _append_tokens(bos_tokens, model->tokenize("", true));
+        tokenized_model = model->get_native_model();
+    }
+
+    for (Section &section : sections) {
+        for (Item &item : section.items) {
+            if (item.tokenized) {
+                continue;
+            }
+            item.tokens.clear();
+            if (!item.text.is_empty()) {
+                _append_tokens(item.tokens, model->tokenize(item.text, false, parse_special));
+                if (item.tokens.empty()) {
+                    r_error = vformat("Tokenization failed for prompt section \"%s\".", section.name);
+                    return false;
+                }
+            }
+            item.tokenized = true;
+            items_tokenized++;
+        }
+    }
+    return true;
+}
+
+int32_t LlamaPromptBuilder::_resolve_budget(int p_max_tokens) const {
+    const int32_t n_ctx_seq = context->get_n_ctx_seq();
+    // The context drops prompt tokens once prompt and reply no longer fit,
+    // and always needs one free cell for the first sampled token.
+    const int32_t available = n_ctx_seq > 0 ? std::min(n_ctx_seq - std::max(0, p_max_tokens), n_ctx_seq - 1) : 0;
+    int32_t budget = token_budget > 0 ? token_budget : available;
+    if (n_ctx_seq > 0) {
+        budget = std::min(budget, available);
+    }
+    return budget - static_cast<int32_t>(bos_tokens.size());
+}
+
+void LlamaPromptBuilder::_fit_section(const Section &p_section, int32_t p_limit, std::vector<int32_t> &r_tokens, int32_t &r_dropped_items) const {
+    r_tokens.clear();
+    r_dropped_items = 0;
+    const size_t count = p_section.items.size();
+    if (count == 0) {
+        return;
+    }
+
+    // Whole items from the kept end inward; the first one that does not fit
+    // drops it and everything beyond it.
+    size_t taken = 0;
+    size_t used = 0;
+    while (taken < count) {
+        const Item &item = p_section.items[p_section.keep_end ? count - 1 - taken : taken];
+        if (used + item.tokens.size() > static_cast<size_t>(std::max(0, p_limit))) {
+            break;
+        }
+        used += item.tokens.size();
+        taken++;
+    }
+
+    if (taken == 0) {
+        // Not even the nearest item fits: keep as much of it as the limit allows.
+        const std::vector<int32_t> &tokens = p_section.items[p_section.keep_end ? count - 1 : 0].tokens;
+        const size_t keep = std::min(tokens.size(), static_cast<size_t>(std::max(0, p_limit)));
+        if (p_section.keep_end) {
+            r_tokens.assign(tokens.end() - static_cast<ptrdiff_t>(keep), tokens.end());
+        } else {
+            r_tokens.assign(tokens.begin(), tokens.begin() + static_cast<ptrdiff_t>(keep));
+        }
+        r_dropped_items = static_cast<int32_t>(count - (keep > 0 ? 1 : 0));
+        return;
+    }
+
+    const size_t first = p_section.keep_end ? count - taken : 0;
+    r_tokens.reserve(used);
+    for (size_t i = first; i < first + taken; i++) {
+        r_tokens.insert(r_tokens.end(), p_section.items[i].tokens.begin(), p_section.items[i].tokens.end());
+    }
+    r_dropped_items = static_cast<int32_t>(count - taken);
+}
+
+void LlamaPromptBuilder::set_context(const Ref<LlamaContext> &p_context) {
+    context = p_context;
+}
+
+Ref<LlamaContext> LlamaPromptBuilder::get_context() const {
+    return context;
+}
+
+void LlamaPromptBuilder::set_token_budget(int p_token_budget) {
+    token_budget = std::max(0, p_token_budget);
+}
+
+int LlamaPromptBuilder::get_token_budget() const {
+    return token_budget;
+}
+
+void LlamaPromptBuilder::set_parse_special(bool p_parse_special) {
+    if (parse_special != p_parse_special) {
+        tokenized_model = nullptr;
+    }
+    parse_special = p_parse_special;
+}
+
+bool LlamaPromptBuilder::get_parse_special() const {
+    return parse_special;
+}
+
+void LlamaPromptBuilder::set_section(const String &p_name, const Variant &p_content, int p_priority, int p_max_tokens, bool p_keep_end) {
+    Section *section = _find_section(p_name);
+    if (section == nullptr) {
+        sections.push_back(Section());
+        section = &sections.back();
+        section->name = p_name;
+    }
+    section->priority = p_priority;
+    section->max_tokens = std::max(0, p_max_tokens);
+    section->keep_end = p_keep_end;
+
+    PackedStringArray texts;
+    if (p_content.get_type() == Variant::ARRAY || p_content.get_type() == Variant::PACKED_STRING_ARRAY) {
+        const Array content = p_content;
+        for (int64_t i = 0; i < content.size(); i++) {
+            texts.append(String(content[i]));
+        }
+    } else {
+        texts.append(String(p_content));
+    }
+
+    // Items whose text did not change keep their tokens, wherever they moved.
+    std::unordered_map<std::string, std::vector<int32_t>> previous;
+    for (Item &item : section->items) {
+        if (item.tokenized) {
+            const CharString key = item.text.utf8();
+            previous.emplace(std::string(key.get_data(), static_cast<size_t>(key.length())), std::move(item.tokens));
+        }
+    }
+
+    std::vector<Item> items;
+    items.reserve(static_cast<size_t>(texts.size()));
+    for (int64_t i = 0; i < texts.size(); i++) {
+        Item item;
+        item.text = texts[i];
+        const CharString key = item.text.utf8();
+        const auto it = previous.find(std::string(key.get_data(), static_cast<size_t>(key.length())));
+        if (it != previous.end()) {
+            item.tokens = it->second;
+            item.tokenized = true;
+            items_reused++;
+        }
+        items.push_back(std::move(item));
+    }
+    section->items = std::move(items);
+}
+
+bool LlamaPromptBuilder::remove_section(const String &p_name) {
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i].name == p_name) {
+            sections.erase(sections.begin() + static_cast<ptrdiff_t>(i));
+            return true;
+        }
+    }
+    return false;
+}
+
+bool LlamaPromptBuilder::has_section(const String &p_name) const {
+    for (const Section &section : sections) {
+        if (section.name == p_name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PackedStringArray LlamaPromptBuilder::get_section_names() const {
+    PackedStringArray names;
+    for (const Section &section : sections) {
+        names.append(section.name);
+    }
+    return names;
+}
+
+void LlamaPromptBuilder::clear() {
+    sections.clear();
+    last_budget = 0;
+    last_tokens = 0;
+}
+
+PackedInt32Array LlamaPromptBuilder::build(int p_max_tokens) {
+    PackedInt32Array result;
+    if (!_is_ready()) {
+        UtilityFunctions::push_error("godot_llama: prompt builder needs an initialized context.");
+        return result;
+    }
+    String error;
+    if (!_tokenize_pending(error)) {
+        UtilityFunctions::push_error("godot_llama: ", error);
+        return result;
+    }
+    const int32_t budget = _resolve_budget(p_max_tokens);
+    if (budget <= 0) {
+        UtilityFunctions::push_error(vformat("godot_llama: max_tokens=%d leaves no room for the prompt.", p_max_tokens));
+        return result;
+    }
+
+    std::vector<size_t> by_priority(sections.size());
+    for (size_t i = 0; i < sections.size(); i++) {
+        by_priority[i] = i;
+    }
+    std::stable_sort(by_priority.begin(), by_priority.end(), [this](size_t a, size_t b) {
+        return sections[a].priority > sections[b].priority;
+    });
+
+    std::vector<std::vector<int32_t>> fitted(sections.size());
+    int32_t remaining = budget;
+    for (size_t index : by_priority) {
+        Section &section = sections[index];
+        const int32_t limit = section.max_tokens > 0 ? std::min(section.max_tokens, remaining) : remaining;
+        _fit_section(section, limit, fitted[index], section.dropped_items);
+        section.built_tokens = static_cast<int32_t>(fitted[index].size());
+        remaining -= section.built_tokens;
+    }
+
+    result.resize(static_cast<int64_t>(bos_tokens.size()) + budget - remaining);
+    int64_t pos = 0;
+    for (int32_t token : bos_tokens) {
+        result.set(pos++, token);
+    }
+    for (const std::vector<int32_t> &tokens : fitted) {
+        for (int32_t token : tokens) {
+            result.set(pos++, token);
+        }
+    }
+    last_budget = budget + static_cast<int32_t>(bos_tokens.size());
+    last_tokens = static_cast<int32_t>(result.size());
+    return result;
+}
+
+String LlamaPromptBuilder::generate(int p_max_tokens, const Dictionary &p_params) {
+    // The context generates up to params["max_tokens"] when it is set, and
+    // would cut the front of a prompt built for a smaller reply.
+    const int max_tokens = LlamaGenerationParams::resolve_max_tokens(p_params, p_max_tokens);
+    const PackedInt32Array tokens = build(max_tokens);
+    if (tokens.is_empty()) {
+        return "";
+    }
+    // The built prompt is complete, so it replaces the conversation's KV
+    // unless the caller asks otherwise.
+    Dictionary params = p_params.duplicate();
+    if (!params.has("reuse_kv")) {
+        params["reuse_kv"] = false;
+    }
+    return context->generate_tokens(tokens, max_tokens, params);
+}
+
+void LlamaPromptBuilder::generate_stream(int p_max_tokens, const Dictionary &p_params) {
+    const int max_tokens = LlamaGenerationParams::resolve_max_tokens(p_params, p_max_tokens);
+    const PackedInt32Array tokens = build(max_tokens);
+    if (tokens.is_empty()) {
+        return;
+    }
+    Dictionary params = p_params.duplicate();
+    if (!params.has("reuse_kv")) {
+        params["reuse_kv"] = false;
+    }
+    context->generate_tokens_stream(tokens, max_tokens, params);
+}
+
+Dictionary LlamaPromptBuilder::get_stats() const {
+    Array section_stats;
+    for (const Section &section : sections) {
+        int64_t tokens = 0;
+        for (const Item &item : section.items) {
+            tokens += static_cast<int64_t>(item.tokens.size());
+        }
+        Dictionary entry;
+        entry["name"] = section.name;
+        entry["priority"] = section.priority;
+        entry["items"] = static_cast<int64_t>(section.items.size());
+        entry["tokens"] = tokens;
+        entry["built_tokens"] = section.built_tokens;
+        entry["dropped_items"] = section.dropped_items;
+        section_stats.push_back(entry);
+    }
+
+    Dictionary stats;
+    stats["sections"] = section_stats;
+    stats["items_tokenized"] = items_tokenized;
+    stats["items_reused"] = items_reused;
+    stats["last_budget"] = last_budget;
+    stats["last_tokens"] = last_tokens;
+    return stats;
+}
@@ -0,0 +1,87 @@
+#ifndef GODOT_LLAMA_PROMPT_BUILDER_H
+#define GODOT_LLAMA_PROMPT_BUILDER_H
+
+#include "llama_context.h"
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_int32_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct llama_model;
+
+namespace godot {
+
+// Assembles a prompt from named sections straight into tokens. Each section
+// keeps the tokens of its items between builds, so only changed text is
+// tokenized again. build() fills an exact token budget in priority order,
+// dropping whole items before cutting inside one, and lays the survivors out
+// in the order the sections were added.
+class LlamaPromptBuilder : public RefCounted {
+    GDCLASS(LlamaPromptBuilder, RefCounted);
+
+private:
+    struct Item {
+        String text;
+        std::vector<int32_t> tokens;
+        bool tokenized = false;
+    };
+
+    struct Section {
+        String name;
+        int priority = 0;
+        int max_tokens = 0;
+        bool keep_end = false;
+        std::vector<Item> items;
+        // Filled by the last build().
+        int32_t built_tokens = 0;
+        int32_t dropped_items = 0;
+    };
+
+    Ref<LlamaContext> context;
+    int token_budget = 0;
+    bool parse_special = true;
+    std::vector<Section> sections;
+    std::vector<int32_t> bos_tokens;
+    const struct llama_model *tokenized_model = nullptr;
+    int64_t items_tokenized = 0;
+    int64_t items_reused = 0;
+    int32_t last_budget = 0;
+    int32_t last_tokens = 0;
+
+    bool _is_ready() const;
+    Section *_find_section(const String &p_name);
+    bool _tokenize_pending(String &r_error);
+    int32_t _resolve_budget(int p_max_tokens) const;
+    void _fit_section(const Section &p_section, int32_t p_limit, std::vector<int32_t> &r_tokens, int32_t &r_dropped_items) const;
+
+protected:
+    static void _bind_methods();
+
+public:
+    void set_context(const Ref<LlamaContext> &p_context);
+    Ref<LlamaContext> get_context() const;
+    void set_token_budget(int p_token_budget);
+    int get_token_budget() const;
+    void set_parse_special(bool p_parse_special);
+    bool get_parse_special() const;
+
+    void set_section(const String &p_name, const Variant &p_content, int p_priority = 0, int p_max_tokens = 0, bool p_keep_end = false);
+    bool remove_section(const String &p_name);
+    bool has_section(const String &p_name) const;
+    PackedStringArray get_section_names() const;
+    void clear();
+
+    PackedInt32Array build(int p_max_tokens = 128);
+    String generate(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    void generate_stream(int p_max_tokens = 128, const Dictionary &p_params = Dictionary());
+    Dictionary get_stats() const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,204 @@
+#include "llama_result_cache.h"
+
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace godot;
+
+namespace {
+
+constexpr uint32_t RESULT_CACHE_MAGIC = 0x43524c47; // "GLRC"
+constexpr uint32_t RESULT_CACHE_VERSION = 1;
+constexpr int64_t RESULT_CACHE_ENTRY_OVERHEAD = 96;
+
+} // namespace
+
+void LlamaResultCache::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_max_bytes", "max_bytes"), &LlamaResultCache::set_max_bytes);
+    ClassDB::bind_method(D_METHOD("get_max_bytes"), &LlamaResultCache::get_max_bytes);
+    ClassDB::bind_method(D_METHOD("clear"), &LlamaResultCache::clear);
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaResultCache::get_stats);
+    ClassDB::bind_method(D_METHOD("save_to_file", "path"), &LlamaResultCache::save_to_file);
+    ClassDB::bind_method(D_METHOD("load_from_file", "path"), &LlamaResultCache::load_from_file);
+
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_bytes"), "set_max_bytes", "get_max_bytes");
+}
+
+void LlamaResultCache::_evict_to(int64_t p_max_bytes) {
+    while (used_bytes > p_max_bytes && !entries.empty()) {
+        const Entry &oldest = entries.back();
+        used_bytes -= oldest.bytes;
+        index.erase(oldest.key);
+        entries.pop_back();
+    }
+}
+
+void LlamaResultCache::_insert(Entry &&p_entry) {
+    auto existing = index.find(p_entry.key);
+    if (existing != index.end()) {
+        used_bytes -= existing->second->bytes;
+        entries.erase(existing->second);
+        index.erase(existing);
+    }
+
+    p_entry.bytes = static_cast<int64_t>(p_entry.key.size()) + p_entry.text.length() * 4 +
+            static_cast<int64_t>(p_entry.tokens.size() * sizeof(int32_t)) + RESULT_CACHE_ENTRY_OVERHEAD;
+    if (p_entry.bytes > max_bytes) {
+        return;
+    }
+
+    used_bytes += p_entry.bytes;
+    entries.push_front(std::move(p_entry));
+    index[entries.front().key] = entries.begin();
+    _evict_to(max_bytes);
+}
+
+void LlamaResultCache::set_max_bytes(int64_t p_max_bytes) {
+    std::lock_guard<std::mutex> lock(mutex);
+    max_bytes = std::max<int64_t>(0, p_max_bytes);
+    _evict_to(max_bytes);
+}
+
+int64_t LlamaResultCache::get_max_bytes() const {
+    return max_bytes;
+}
+
+void LlamaResultCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    used_bytes = 0;
+    hits = 0;
+    misses = 0;
+}
+
+Dictionary LlamaResultCache::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Dictionary stats;
+    stats["entries"] = static_cast<int64_t>(entries.size());
+    stats["bytes"] = used_bytes;
+    stats["max_bytes"] = max_bytes;
+    stats["hits"] = hits;
+    stats["misses"] = misses;
+    stats["hit_rate"] = hits + misses > 0 ? static_cast<double>(hits) / static_cast<double>(hits + misses) : 0.0;
+    return stats;
+}
+
+bool LlamaResultCache::lookup(const std::string &p_key, String &r_text, std::vector<int32_t> &r_tokens) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(p_key);
+    if (found == index.end()) {
+        misses++;
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, found->second);
+    r_text = found->second->text;
+    r_tokens = found->second->tokens;
+    hits++;
+    return true;
+}
+
+void LlamaResultCache::store(const std::string &p_key, const String &p_text, const std::vector<int32_t> &p_tokens) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry;
+    entry.key = p_key;
+    entry.text = p_text;
+    entry.tokens = p_tokens;
+    _insert(std::move(entry));
+}
+
+Error LlamaResultCache::save_to_file(const String &p_path) const {
+    Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::WRITE);
+    if (file.is_null()) {
+        return FileAccess::get_open_error();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file->store_32(RESULT_CACHE_MAGIC);
+    file->store_32(RESULT_CACHE_VERSION);
+    file->store_32(static_cast<uint32_t>(entries.size()));
+
+    // Oldest first, so loading re-inserts in the same recency order.
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        PackedByteArray key;
+        key.resize(static_cast<int64_t>(it->key.size()));
+        if (!it->key.empty()) {
+            std::memcpy(key.ptrw(), it->key.data(), it->key.size());
+        }
+        file->store_32(static_cast<uint32_t>(key.size()));
+        file->store_buffer(key);
+
+        const PackedByteArray text = it->text.to_utf8_buffer();
+        file->store_32(static_cast<uint32_t>(text.size()));
+        file->store_buffer(text);
+
+        file->store_32(static_cast<uint32_t>(it->tokens.size()));
+        for (int32_t token : it->tokens) {
+            file->store_32(static_cast<uint32_t>(token));
+        }
+    }
+    return file->get_error();
+}
+
+Error LlamaResultCache::load_from_file(const String &p_path) {
+    Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+    if (file.is_null()) {
+        return FileAccess::get_open_error();
+    }
+    if (file->get_32() != RESULT_CACHE_MAGIC || file->get_32() != RESULT_CACHE_VERSION) {
+        return ERR_FILE_UNRECOGNIZED;
+    }
+
+    // Every length is checked against the bytes left before allocating, so a
+    // truncated or corrupt file cannot ask for gigabytes.
+    auto remaining = [&file]() {
+        return file->get_length() - file->get_position();
+    };
+    const uint32_t count = file->get_32();
+    // Each entry stores at least its three lengths.
+    if (count > remaining() / 12) {
+        return ERR_FILE_CORRUPT;
+    }
+    std::vector<Entry> loaded;
+    for (uint32_t i = 0; i < count; i++) {
+        Entry entry;
+        const uint32_t key_size = file->get_32();
+        if (key_size > remaining()) {
+            return ERR_FILE_CORRUPT;
+        }
+        const PackedByteArray key = file->get_buffer(key_size);
+        entry.key.assign(reinterpret_cast<const char *>(key.ptr()), static_cast<size_t>(key.size()));
+
+        const uint32_t text_size = file->get_32();
+        if (text_size > remaining()) {
+            return ERR_FILE_CORRUPT;
+        }
+        const PackedByteArray text = file->get_buffer(text_size);
+        entry.text = text.get_string_from_utf8();
+
+        const uint32_t n_tokens = file->get_32();
+        if (n_tokens > remaining() / 4) {
+            return ERR_FILE_CORRUPT;
+        }
+        entry.tokens.resize(n_tokens);
+        for (uint32_t t = 0; t < n_tokens; t++) {
+            entry.tokens[t] = static_cast<int32_t>(file->get_32());
+        }
+
+        if (file->eof_reached()) {
+            return ERR_FILE_CORRUPT;
+        }
+        loaded.push_back(std::move(entry));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (Entry &entry : loaded) {
+        _insert(std::move(entry));
+    }
+    return OK;
+}
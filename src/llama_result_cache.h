@@ -0,0 +1,59 @@
+#ifndef GODOT_LLAMA_RESULT_CACHE_H
+#define GODOT_LLAMA_RESULT_CACHE_H
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace godot {
+
+// LRU cache of finished generations, shareable between contexts. Keys are
+// opaque byte strings built by LlamaContext from the model identity, prompt
+// tokens, sampler params and seed.
+class LlamaResultCache : public RefCounted {
+    GDCLASS(LlamaResultCache, RefCounted);
+
+private:
+    struct Entry {
+        std::string key;
+        String text;
+        std::vector<int32_t> tokens;
+        int64_t bytes = 0;
+    };
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    int64_t max_bytes = 16 * 1024 * 1024;
+    int64_t used_bytes = 0;
+    int64_t hits = 0;
+    int64_t misses = 0;
+
+    void _evict_to(int64_t p_max_bytes);
+    void _insert(Entry &&p_entry);
+
+protected:
+    static void _bind_methods();
+
+public:
+    void set_max_bytes(int64_t p_max_bytes);
+    int64_t get_max_bytes() const;
+    void clear();
+    Dictionary get_stats() const;
+    Error save_to_file(const String &p_path) const;
+    Error load_from_file(const String &p_path);
+
+    bool lookup(const std::string &p_key, String &r_text, std::vector<int32_t> &r_tokens);
+    void store(const std::string &p_key, const String &p_text, const std::vector<int32_t> &p_tokens);
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,426 @@
+#include "llama_sequence_cache.h"
+
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <llama.h>
+#include <algorithm>
+
+using namespace godot;
+
+static uint64_t _sequence_cache_now_usec() {
+    return Time::get_singleton()->get_ticks_usec();
+}
+
+LlamaSequenceCache::~LlamaSequenceCache() {
+    clear_all();
+}
+
+void LlamaSequenceCache::attach(struct llama_context *p_context) {
+    clear_all();
+    native_context = p_context;
+    slots.assign(p_context != nullptr ? llama_n_seq_max(p_context) : 0, Slot());
+}
+
+void LlamaSequenceCache::configure(int64_t p_budget_tokens, const String &p_spill_dir, bool p_compress, int64_t p_evicted_budget_bytes) {
+    budget_tokens = std::max<int64_t>(0, p_budget_tokens);
+    spill_dir = p_spill_dir;
+    compress = p_compress;
+    evicted_budget_bytes = std::max<int64_t>(0, p_evicted_budget_bytes);
+    if (!spill_dir.is_empty()) {
+        DirAccess::make_dir_recursive_absolute(spill_dir);
+        // Process id for other processes, address for other live caches.
+        spill_prefix = vformat("%d_%s_", OS::get_singleton()->get_process_id(), String::num_uint64(reinterpret_cast<uintptr_t>(this), 16));
+    }
+}
+
+int32_t LlamaSequenceCache::_find_resident(const String &p_conversation) const {
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].in_use && slots[i].conversation == p_conversation) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+int32_t LlamaSequenceCache::_find_evicted(const String &p_conversation) const {
+    for (size_t i = 0; i < evicted.size(); i++) {
+        if (evicted[i].conversation == p_conversation) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+int32_t LlamaSequenceCache::_find_lru(int32_t p_exclude_seq) const {
+    int32_t lru = -1;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!slots[i].in_use || static_cast<int32_t>(i) == p_exclude_seq) {
+            continue;
+        }
+        if (lru < 0 || slots[i].last_used_usec < slots[lru].last_used_usec) {
+            lru = static_cast<int32_t>(i);
+        }
+    }
+    return lru;
+}
+
+void LlamaSequenceCache::_drop_evicted(int32_t p_index) {
+    if (!evicted[p_index].spill_file.is_empty()) {
+        DirAccess::remove_absolute(evicted[p_index].spill_file);
+    }
+    evicted_memory_bytes -= evicted[p_index].data.size();
+    evicted.erase(evicted.begin() + p_index);
+}
+
+void LlamaSequenceCache::_enforce_evicted_budget() {
+    while (evicted_budget_bytes > 0 && evicted_memory_bytes > evicted_budget_bytes) {
+        int32_t lru = -1;
+        for (size_t i = 0; i < evicted.size(); i++) {
+            if (evicted[i].data.is_empty()) {
+                continue;
+            }
+            if (lru < 0 || evicted[i].last_used_usec < evicted[lru].last_used_usec) {
+                lru = static_cast<int32_t>(i);
+            }
+        }
+        if (lru < 0) {
+            break;
+        }
+        UtilityFunctions::print_verbose(vformat("godot_llama: in-memory KV snapshots over budget, dropping conversation '%s'", evicted[lru].conversation));
+        _drop_evicted(lru);
+        evicted_dropped++;
+    }
+}
+
+int64_t LlamaSequenceCache::_resident_tokens() const {
+    int64_t total = 0;
+    for (const Slot &slot : slots) {
+        if (slot.in_use) {
+            total += slot.n_past;
+        }
+    }
+    return total;
+}
+
+int64_t LlamaSequenceCache::_capacity_tokens() const {
+    const int64_t n_ctx = native_context != nullptr ? static_cast<int64_t>(llama_n_ctx(native_context)) : 0;
+    return budget_tokens > 0 ? std::min(budget_tokens, n_ctx) : n_ctx;
+}
+
+bool LlamaSequenceCache::_restore(const Evicted &p_entry, int32_t p_seq) {
+    const uint64_t start = _sequence_cache_now_usec();
+
+    bool ok = false;
+    if (!p_entry.spill_file.is_empty()) {
+        size_t n_token_count = 0;
+        CharString path_utf8 = p_entry.spill_file.utf8();
+        ok = llama_state_seq_load_file(native_context, path_utf8.get_data(), p_seq, nullptr, 0, &n_token_count) > 0;
+    } else {
+        const PackedByteArray raw = compress ? p_entry.data.decompress(p_entry.raw_size, FileAccess::COMPRESSION_ZSTD) : p_entry.data;
+        ok = !raw.is_empty() && llama_state_seq_set_data(native_context, raw.ptr(), static_cast<size_t>(raw.size()), p_seq) > 0;
+    }
+
+    if (ok) {
+        slots[p_seq].n_past = p_entry.n_past;
+        last_restore_usec = _sequence_cache_now_usec() - start;
+        restore_usec_total += last_restore_usec;
+        restores++;
+    } else {
+        llama_memory_seq_rm(llama_get_memory(native_context), p_seq, -1, -1);
+        slots[p_seq].n_past = 0;
+    }
+    return ok;
+}
+
+int32_t LlamaSequenceCache::acquire(const String &p_conversation, int32_t p_reserve_tokens, String &r_error) {
+    if (native_context == nullptr || slots.empty()) {
+        r_error = "Sequence cache is not attached to a context.";
+        return -1;
+    }
+
+    int32_t seq = _find_resident(p_conversation);
+    if (seq >= 0) {
+        hits++;
+        touch(seq);
+        enforce_budget(seq, p_reserve_tokens);
+        return seq;
+    }
+    misses++;
+
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (!slots[i].in_use) {
+            seq = static_cast<int32_t>(i);
+            break;
+        }
+    }
+    if (seq < 0) {
+        seq = _find_lru(-1);
+        if (!evict(seq)) {
+            r_error = vformat("Failed to evict sequence %d.", seq);
+            return -1;
+        }
+    }
+
+    // Slots freed by whole-state loads may still hold stale cells.
+    llama_memory_seq_rm(llama_get_memory(native_context), seq, -1, -1);
+    Slot &slot = slots[seq];
+    slot.conversation = p_conversation;
+    slot.in_use = true;
+    slot.n_past = 0;
+    touch(seq);
+
+    const int32_t evicted_index = _find_evicted(p_conversation);
+    if (evicted_index >= 0) {
+        // Taken off the list while room is made for it, so neither the
+        // evictions below nor the snapshot memory budget can drop it.
+        Evicted entry = std::move(evicted[evicted_index]);
+        evicted_memory_bytes -= entry.data.size();
+        evicted.erase(evicted.begin() + evicted_index);
+        // A full KV cannot take the snapshot.
+        enforce_budget(seq, entry.n_past + p_reserve_tokens);
+        if (!_restore(entry, seq)) {
+            evicted_memory_bytes += entry.data.size();
+            evicted.push_back(std::move(entry));
+            slot.conversation = String();
+            slot.in_use = false;
+            r_error = vformat("Failed to restore conversation '%s'; its snapshot is kept for the next attempt.", p_conversation);
+            return -1;
+        }
+        if (!entry.spill_file.is_empty()) {
+            DirAccess::remove_absolute(entry.spill_file);
+        }
+    }
+
+    enforce_budget(seq, p_reserve_tokens);
+    return seq;
+}
+
+bool LlamaSequenceCache::evict(int32_t p_seq) {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size()) || !slots[p_seq].in_use) {
+        return false;
+    }
+
+    const uint64_t start = _sequence_cache_now_usec();
+    Slot &slot = slots[p_seq];
+    const int32_t previous = _find_evicted(slot.conversation);
+    if (previous >= 0) {
+        _drop_evicted(previous);
+    }
+
+    if (slot.n_past > 0) {
+        Evicted entry;
+        entry.conversation = slot.conversation;
+        entry.n_past = slot.n_past;
+        entry.last_used_usec = slot.last_used_usec;
+
+        bool ok = false;
+        if (!spill_dir.is_empty()) {
+            entry.spill_file = spill_dir.path_join(spill_prefix + slot.conversation.md5_text() + ".kvseq");
+            CharString path_utf8 = entry.spill_file.utf8();
+            ok = llama_state_seq_save_file(native_context, path_utf8.get_data(), p_seq, nullptr, 0) > 0;
+        } else {
+            const size_t size = llama_state_seq_get_size(native_context, p_seq);
+            PackedByteArray raw;
+            raw.resize(static_cast<int64_t>(size));
+            const size_t copied = size > 0 ? llama_state_seq_get_data(native_context, raw.ptrw(), size, p_seq) : 0;
+            if (copied > 0) {
+                raw.resize(static_cast<int64_t>(copied));
+                entry.raw_size = static_cast<int64_t>(copied);
+                entry.data = compress ? raw.compress(FileAccess::COMPRESSION_ZSTD) : raw;
+                ok = !entry.data.is_empty();
+            }
+        }
+
+        if (!ok) {
+            UtilityFunctions::push_warning("godot_llama: failed to snapshot conversation '", slot.conversation, "', dropping it");
+        } else {
+            evicted_memory_bytes += entry.data.size();
+            evicted.push_back(entry);
+            _enforce_evicted_budget();
+        }
+    }
+
+    llama_memory_seq_rm(llama_get_memory(native_context), p_seq, -1, -1);
+    slot = Slot();
+    evictions++;
+    evict_usec_total += _sequence_cache_now_usec() - start;
+    return true;
+}
+
+void LlamaSequenceCache::truncate(int32_t p_seq, int32_t p_pos) {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size())) {
+        return;
+    }
+    const int32_t pos = std::max(0, p_pos);
+    llama_memory_seq_rm(llama_get_memory(native_context), p_seq, pos, -1);
+    slots[p_seq].n_past = std::min(slots[p_seq].n_past, pos);
+}
+
+bool LlamaSequenceCache::remove_range(int32_t p_seq, int32_t p_p0, int32_t p_p1) {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size())) {
+        return false;
+    }
+    const int32_t n_past = slots[p_seq].n_past;
+    const int32_t p0 = std::max(0, p_p0);
+    const int32_t p1 = std::min(n_past, p_p1);
+    if (p0 >= p1) {
+        return true;
+    }
+
+    // Removing from the middle leaves a gap that later tokens must be shifted
+    // across; recurrent memories cannot do that and callers re-decode instead.
+    llama_memory_t memory = llama_get_memory(native_context);
+    if (p1 < n_past && !llama_memory_can_shift(memory)) {
+        return false;
+    }
+    if (!llama_memory_seq_rm(memory, p_seq, p0, p1)) {
+        return false;
+    }
+    if (p1 < n_past) {
+        llama_memory_seq_add(memory, p_seq, p1, -1, p0 - p1);
+    }
+    slots[p_seq].n_past = n_past - (p1 - p0);
+    return true;
+}
+
+void LlamaSequenceCache::touch(int32_t p_seq) {
+    if (p_seq >= 0 && p_seq < static_cast<int32_t>(slots.size())) {
+        slots[p_seq].last_used_usec = _sequence_cache_now_usec();
+    }
+}
+
+void LlamaSequenceCache::enforce_budget(int32_t p_keep_seq, int32_t p_reserve_tokens) {
+    const int64_t capacity = _capacity_tokens();
+    while (_resident_tokens() + p_reserve_tokens > capacity) {
+        const int32_t lru = _find_lru(p_keep_seq);
+        if (lru < 0 || !evict(lru)) {
+            break;
+        }
+    }
+}
+
+void LlamaSequenceCache::adopt(int32_t p_seq, const String &p_conversation, int32_t p_n_past) {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size())) {
+        return;
+    }
+    Slot &slot = slots[p_seq];
+    slot.conversation = p_conversation;
+    slot.in_use = true;
+    slot.n_past = p_n_past;
+    touch(p_seq);
+}
+
+int32_t LlamaSequenceCache::get_n_past(int32_t p_seq) const {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size())) {
+        return 0;
+    }
+    return slots[p_seq].n_past;
+}
+
+void LlamaSequenceCache::set_n_past(int32_t p_seq, int32_t p_n_past) {
+    if (p_seq >= 0 && p_seq < static_cast<int32_t>(slots.size())) {
+        slots[p_seq].n_past = p_n_past;
+    }
+}
+
+int32_t LlamaSequenceCache::get_slot_count() const {
+    return static_cast<int32_t>(slots.size());
+}
+
+int64_t LlamaSequenceCache::get_resident_tokens() const {
+    return _resident_tokens();
+}
+
+String LlamaSequenceCache::get_conversation(int32_t p_seq) const {
+    if (p_seq < 0 || p_seq >= static_cast<int32_t>(slots.size()) || !slots[p_seq].in_use) {
+        return "";
+    }
+    return slots[p_seq].conversation;
+}
+
+bool LlamaSequenceCache::drop(const String &p_conversation) {
+    bool found = false;
+    const int32_t seq = _find_resident(p_conversation);
+    if (seq >= 0) {
+        llama_memory_seq_rm(llama_get_memory(native_context), seq, -1, -1);
+        slots[seq] = Slot();
+        found = true;
+    }
+    const int32_t evicted_index = _find_evicted(p_conversation);
+    if (evicted_index >= 0) {
+        _drop_evicted(evicted_index);
+        found = true;
+    }
+    return found;
+}
+
+bool LlamaSequenceCache::evict_conversation(const String &p_conversation) {
+    return evict(_find_resident(p_conversation));
+}
+
+bool LlamaSequenceCache::has(const String &p_conversation) const {
+    return _find_resident(p_conversation) >= 0 || _find_evicted(p_conversation) >= 0;
+}
+
+int32_t LlamaSequenceCache::get_length(const String &p_conversation) const {
+    const int32_t seq = _find_resident(p_conversation);
+    if (seq >= 0) {
+        return slots[seq].n_past;
+    }
+    const int32_t evicted_index = _find_evicted(p_conversation);
+    return evicted_index >= 0 ? evicted[evicted_index].n_past : 0;
+}
+
+PackedStringArray LlamaSequenceCache::get_conversation_ids() const {
+    PackedStringArray ids;
+    for (const Slot &slot : slots) {
+        if (slot.in_use) {
+            ids.append(slot.conversation);
+        }
+    }
+    for (const Evicted &entry : evicted) {
+        ids.append(entry.conversation);
+    }
+    return ids;
+}
+
+void LlamaSequenceCache::clear_resident() {
+    for (Slot &slot : slots) {
+        slot = Slot();
+    }
+}
+
+void LlamaSequenceCache::clear_all() {
+    clear_resident();
+    while (!evicted.empty()) {
+        _drop_evicted(static_cast<int32_t>(evicted.size()) - 1);
+    }
+}
+
+void LlamaSequenceCache::append_stats(Dictionary &r_stats) const {
+    int64_t resident = 0;
+    for (const Slot &slot : slots) {
+        if (slot.in_use) {
+            resident++;
+        }
+    }
+
+    r_stats["kv_hits"] = hits;
+    r_stats["kv_misses"] = misses;
+    r_stats["kv_restores"] = restores;
+    r_stats["kv_evictions"] = evictions;
+    r_stats["kv_restore_ms_total"] = static_cast<double>(restore_usec_total) / 1000.0;
+    r_stats["kv_evict_ms_total"] = static_cast<double>(evict_usec_total) / 1000.0;
+    r_stats["kv_last_restore_ms"] = static_cast<double>(last_restore_usec) / 1000.0;
+    r_stats["kv_resident_conversations"] = resident;
+    r_stats["kv_evicted_conversations"] = static_cast<int64_t>(evicted.size());
+    r_stats["kv_evicted_bytes"] = evicted_memory_bytes;
+    r_stats["kv_evicted_budget_bytes"] = evicted_budget_bytes;
+    r_stats["kv_evicted_dropped"] = evicted_dropped;
+    r_stats["kv_resident_tokens"] = _resident_tokens();
+    r_stats["kv_budget_tokens"] = _capacity_tokens();
+}
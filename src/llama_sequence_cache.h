@@ -0,0 +1,102 @@
+#ifndef GODOT_LLAMA_SEQUENCE_CACHE_H
+#define GODOT_LLAMA_SEQUENCE_CACHE_H
+
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/packed_string_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <cstdint>
+#include <vector>
+
+struct llama_context;
+
+namespace godot {
+
+// Maps named conversations onto the sequence ids of one llama_context.
+// Resident conversations own a sequence; least-recently-used ones are
+// snapshotted (compressed in memory or spilled to disk) when sequences or the
+// KV budget run out, and restored transparently on their next use.
+class LlamaSequenceCache {
+private:
+    struct Slot {
+        String conversation;
+        bool in_use = false;
+        int32_t n_past = 0;
+        uint64_t last_used_usec = 0;
+    };
+
+    struct Evicted {
+        String conversation;
+        int32_t n_past = 0;
+        int64_t raw_size = 0;
+        PackedByteArray data;
+        String spill_file;
+        uint64_t last_used_usec = 0;
+    };
+
+    struct llama_context *native_context = nullptr;
+    std::vector<Slot> slots;
+    std::vector<Evicted> evicted;
+    int64_t budget_tokens = 0;
+    String spill_dir;
+    // Unique per cache, so contexts sharing a spill directory never read
+    // each other's snapshots for the same conversation id.
+    String spill_prefix;
+    bool compress = true;
+    // Cap on in-memory snapshots; 0 means unlimited.
+    int64_t evicted_budget_bytes = 0;
+    int64_t evicted_memory_bytes = 0;
+    int64_t evicted_dropped = 0;
+
+    int64_t hits = 0;
+    int64_t misses = 0;
+    int64_t restores = 0;
+    int64_t evictions = 0;
+    uint64_t restore_usec_total = 0;
+    uint64_t evict_usec_total = 0;
+    uint64_t last_restore_usec = 0;
+
+    int32_t _find_resident(const String &p_conversation) const;
+    int32_t _find_evicted(const String &p_conversation) const;
+    int32_t _find_lru(int32_t p_exclude_seq) const;
+    void _drop_evicted(int32_t p_index);
+    void _enforce_evicted_budget();
+    bool _restore(const Evicted &p_entry, int32_t p_seq);
+    int64_t _resident_tokens() const;
+    int64_t _capacity_tokens() const;
+
+public:
+    ~LlamaSequenceCache();
+
+    void attach(struct llama_context *p_context);
+    void configure(int64_t p_budget_tokens, const String &p_spill_dir, bool p_compress, int64_t p_evicted_budget_bytes);
+
+    int32_t acquire(const String &p_conversation, int32_t p_reserve_tokens, String &r_error);
+    bool evict(int32_t p_seq);
+    void truncate(int32_t p_seq, int32_t p_pos);
+    bool remove_range(int32_t p_seq, int32_t p_p0, int32_t p_p1);
+    void touch(int32_t p_seq);
+    void enforce_budget(int32_t p_keep_seq, int32_t p_reserve_tokens);
+    void adopt(int32_t p_seq, const String &p_conversation, int32_t p_n_past);
+
+    int32_t get_n_past(int32_t p_seq) const;
+    void set_n_past(int32_t p_seq, int32_t p_n_past);
+    int32_t get_slot_count() const;
+    int64_t get_resident_tokens() const;
+    String get_conversation(int32_t p_seq) const;
+
+    bool drop(const String &p_conversation);
+    bool evict_conversation(const String &p_conversation);
+    bool has(const String &p_conversation) const;
+    int32_t get_length(const String &p_conversation) const;
+    PackedStringArray get_conversation_ids() const;
+    void clear_resident();
+    void clear_all();
+
+    void append_stats(Dictionary &r_stats) const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,413 @@
+#include "llama_server.h"
+
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/core/class_db.hpp>
+#include <godot_cpp/variant/utility_functions.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+using namespace godot;
+
+namespace {
+
+// A request line longer than this is a broken or hostile client.
+constexpr size_t SERVER_MAX_LINE_BYTES = 1 << 20;
+constexpr int32_t SERVER_READ_CHUNK = 65536;
+constexpr size_t SERVER_WRITE_CHUNK = 65536;
+// Unsent bytes allowed per client before it is treated as stuck and dropped.
+constexpr size_t SERVER_MAX_BACKLOG_BYTES = 8 << 20;
+constexpr int32_t SERVER_IDLE_SLEEP_USEC = 2000;
+
+} // namespace
+
+void LlamaServer::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("start", "context", "port", "bind_address"), &LlamaServer::start, DEFVAL(8765), DEFVAL("127.0.0.1"));
+    ClassDB::bind_method(D_METHOD("stop"), &LlamaServer::stop);
+    ClassDB::bind_method(D_METHOD("is_running"), &LlamaServer::is_running);
+    ClassDB::bind_method(D_METHOD("get_port"), &LlamaServer::get_port);
+    ClassDB::bind_method(D_METHOD("get_context"), &LlamaServer::get_context);
+    ClassDB::bind_method(D_METHOD("set_default_params", "params"), &LlamaServer::set_default_params);
+    ClassDB::bind_method(D_METHOD("get_default_params"), &LlamaServer::get_default_params);
+    ClassDB::bind_method(D_METHOD("set_max_queue", "max_queue"), &LlamaServer::set_max_queue);
+    ClassDB::bind_method(D_METHOD("get_max_queue"), &LlamaServer::get_max_queue);
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaServer::get_stats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::DICTIONARY, "default_params"), "set_default_params", "get_default_params");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_queue", PROPERTY_HINT_RANGE, "1,65536,1"), "set_max_queue", "get_max_queue");
+}
+
+LlamaServer::~LlamaServer() {
+    stop();
+}
+
+Error LlamaServer::start(const Ref<LlamaContext> &p_context, int p_port, const String &p_bind_address) {
+    if (running.load()) {
+        return ERR_ALREADY_IN_USE;
+    }
+    if (p_context.is_null() || !p_context->is_initialized()) {
+        UtilityFunctions::push_error("godot_llama: LlamaServer needs an initialized LlamaContext.");
+        return ERR_UNCONFIGURED;
+    }
+    if (p_context->is_serving()) {
+        UtilityFunctions::push_error("godot_llama: LlamaContext is already owned by another LlamaServer.");
+        return ERR_ALREADY_IN_USE;
+    }
+    if (p_port < 0 || p_port > 65535) {
+        UtilityFunctions::push_error(vformat("godot_llama: Invalid server port %d.", p_port));
+        return ERR_INVALID_PARAMETER;
+    }
+
+    listener.instantiate();
+    const Error err = listener->listen(static_cast<uint16_t>(p_port), p_bind_address);
+    if (err != OK) {
+        UtilityFunctions::push_error(vformat("godot_llama: Could not listen on %s:%d.", p_bind_address, p_port));
+        listener.unref();
+        return err;
+    }
+    serving_params = default_params.duplicate(true);
+    serving_max_queue = max_queue;
+    if (!p_context->begin_batch(scheduler, serving_params)) {
+        listener->stop();
+        listener.unref();
+        return ERR_CANT_CREATE;
+    }
+
+    context = p_context;
+    context->set_serving(true);
+    port = listener->get_local_port();
+    json.instantiate();
+    scheduler.set_token_callback([this](const LlamaBatchScheduler::Request &p_request, int32_t p_token, const String &p_text) {
+        _on_token(p_request, p_token, p_text);
+    });
+
+    stop_requested = false;
+    running = true;
+    if (thread.is_null()) {
+        thread.instantiate();
+    }
+    thread->start(callable_mp(this, &LlamaServer::_thread_entry));
+    return OK;
+}
+
+void LlamaServer::stop() {
+    if (!running.load()) {
+        return;
+    }
+    stop_requested = true;
+    if (thread.is_valid() && thread->is_started()) {
+        thread->wait_to_finish();
+    }
+
+    for (Client &client : clients) {
+        client.peer->disconnect_from_host();
+    }
+    clients.clear();
+    pending.clear();
+    connected_clients = 0;
+    listener->stop();
+    listener.unref();
+    scheduler.set_token_callback(LlamaBatchScheduler::TokenCallback());
+    scheduler.detach();
+    context->set_serving(false);
+    context.unref();
+    port = 0;
+    running = false;
+}
+
+void LlamaServer::_thread_entry() {
+    std::vector<LlamaBatchScheduler::Result> finished;
+    String step_error;
+    while (!stop_requested.load()) {
+        _accept_clients();
+        _read_clients(finished);
+        _send_results(finished);
+
+        _flush_clients();
+
+        if (!scheduler.has_work()) {
+            OS::get_singleton()->delay_usec(SERVER_IDLE_SLEEP_USEC);
+            continue;
+        }
+        if (!scheduler.step(finished, step_error) && !step_error.is_empty()) {
+            UtilityFunctions::push_error(vformat("godot_llama: LlamaServer batch failed: %s", step_error));
+            step_error = "";
+        }
+        _send_results(finished);
+        _flush_clients();
+        active_requests = scheduler.get_active_count();
+        queued_requests = scheduler.get_queued_count();
+    }
+
+    scheduler.cancel_all(finished);
+    _send_results(finished);
+    _flush_clients();
+    active_requests = 0;
+    queued_requests = 0;
+}
+
+void LlamaServer::_accept_clients() {
+    while (listener->is_connection_available()) {
+        Client client;
+        client.id = next_client_id++;
+        client.peer = listener->take_connection();
+        if (client.peer.is_null()) {
+            break;
+        }
+        client.peer->set_no_delay(true);
+        clients.push_back(std::move(client));
+        connected_clients = static_cast<int64_t>(clients.size());
+    }
+}
+
+void LlamaServer::_read_clients(std::vector<LlamaBatchScheduler::Result> &r_finished) {
+    std::vector<int64_t> closed;
+    for (Client &client : clients) {
+        client.peer->poll();
+        if (client.broken || client.peer->get_status() != StreamPeerTCP::STATUS_CONNECTED) {
+            closed.push_back(client.id);
+            continue;
+        }
+
+        const int32_t available = client.peer->get_available_bytes();
+        if (available <= 0) {
+            continue;
+        }
+        const Array read = client.peer->get_partial_data(std::min(available, SERVER_READ_CHUNK));
+        if (read.size() < 2 || static_cast<int64_t>(read[0]) != OK) {
+            closed.push_back(client.id);
+            continue;
+        }
+        const PackedByteArray data = read[1];
+        client.buffer.append(reinterpret_cast<const char *>(data.ptr()), static_cast<size_t>(data.size()));
+
+        size_t line_start = 0;
+        size_t newline;
+        while ((newline = client.buffer.find('\n', line_start)) != std::string::npos) {
+            _handle_line(client, client.buffer.substr(line_start, newline - line_start), r_finished);
+            line_start = newline + 1;
+        }
+        client.buffer.erase(0, line_start);
+        if (client.buffer.size() > SERVER_MAX_LINE_BYTES) {
+            _send_error(client, Variant(), "Request line too long.");
+            closed.push_back(client.id);
+        }
+    }
+
+    _drop_clients(closed, r_finished);
+}
+
+void LlamaServer::_drop_clients(const std::vector<int64_t> &p_closed, std::vector<LlamaBatchScheduler::Result> &r_finished) {
+    if (p_closed.empty()) {
+        return;
+    }
+    const std::vector<int64_t> &closed = p_closed;
+    // Best effort for a last error message; broken clients are skipped.
+    _flush_clients();
+    // Nobody is left to read these; free their sequences for other clients.
+    scheduler.cancel_where([this, &closed](const LlamaBatchScheduler::Request &p_request) {
+        const auto it = pending.find(p_request.index);
+        return it != pending.end() && std::find(closed.begin(), closed.end(), it->second.client_id) != closed.end();
+    }, r_finished);
+    clients.erase(std::remove_if(clients.begin(), clients.end(), [&closed](const Client &p_client) {
+        return std::find(closed.begin(), closed.end(), p_client.id) != closed.end();
+    }), clients.end());
+    connected_clients = static_cast<int64_t>(clients.size());
+}
+
+void LlamaServer::_handle_line(Client &r_client, const std::string &p_line, std::vector<LlamaBatchScheduler::Result> &r_finished) {
+    const String line = String::utf8(p_line.c_str(), static_cast<int64_t>(p_line.size())).strip_edges();
+    if (line.is_empty()) {
+        return;
+    }
+    if (json->parse(line) != OK || json->get_data().get_type() != Variant::DICTIONARY) {
+        _send_error(r_client, Variant(), vformat("Invalid request: %s", json->get_error_message()));
+        requests_rejected.fetch_add(1);
+        return;
+    }
+    const Dictionary message = json->get_data();
+
+    if (message.has("cancel")) {
+        const Variant target = message["cancel"];
+        const int64_t client_id = r_client.id;
+        scheduler.cancel_where([this, client_id, &target](const LlamaBatchScheduler::Request &p_request) {
+            const auto it = pending.find(p_request.index);
+            return it != pending.end() && it->second.client_id == client_id && it->second.id == target;
+        }, r_finished);
+        return;
+    }
+
+    const Variant id = message.get("id", Variant());
+    if (!message.has("prompt")) {
+        _send_error(r_client, id, "Request needs a \"prompt\".");
+        requests_rejected.fetch_add(1);
+        return;
+    }
+    if (scheduler.get_queued_count() >= serving_max_queue) {
+        _send_error(r_client, id, "Server queue is full.");
+        requests_rejected.fetch_add(1);
+        return;
+    }
+
+    LlamaBatchScheduler::Request request;
+    const int64_t index = next_request_index++;
+    context->make_batch_request(message, serving_params, index, request);
+    request.id = id;
+
+    Pending entry;
+    entry.client_id = r_client.id;
+    entry.id = id;
+    entry.stream = message.get("stream", false);
+    pending[index] = entry;
+    scheduler.enqueue(std::move(request));
+    requests_accepted.fetch_add(1);
+    queued_requests = scheduler.get_queued_count();
+}
+
+void LlamaServer::_on_token(const LlamaBatchScheduler::Request &p_request, int32_t p_token, const String &p_text) {
+    tokens_generated.fetch_add(1, std::memory_order_relaxed);
+    const auto it = pending.find(p_request.index);
+    if (it == pending.end() || !it->second.stream) {
+        return;
+    }
+    // Pieces of multi-byte characters only show up in the text once they
+    // are complete, so the delta can be empty for a token.
+    Dictionary message;
+    message["id"] = it->second.id;
+    message["token"] = p_token;
+    message["text"] = p_text.substr(it->second.sent_length);
+    it->second.sent_length = p_text.length();
+    _send(it->second.client_id, message);
+}
+
+void LlamaServer::_send_results(std::vector<LlamaBatchScheduler::Result> &r_finished) {
+    for (const LlamaBatchScheduler::Result &result : r_finished) {
+        const auto it = pending.find(result.index);
+        if (it == pending.end()) {
+            continue;
+        }
+        if (!result.error.is_empty()) {
+            requests_failed.fetch_add(1);
+        } else if (result.stop_reason == "cancelled") {
+            requests_cancelled.fetch_add(1);
+        } else {
+            requests_completed.fetch_add(1);
+        }
+
+        Dictionary message = result.to_dictionary();
+        message.erase("index");
+        message["done"] = true;
+        _send(it->second.client_id, message);
+        pending.erase(it);
+    }
+    r_finished.clear();
+}
+
+void LlamaServer::_send(int64_t p_client_id, const Dictionary &p_message) {
+    Client *client = _find_client(p_client_id);
+    if (client == nullptr || client->broken) {
+        return;
+    }
+    // Queued rather than written: a blocking write to a client that stopped
+    // reading would stall every other client's batch.
+    const CharString line = (JSON::stringify(p_message, "", false) + "\n").utf8();
+    client->outgoing.append(line.get_data(), static_cast<size_t>(line.length()));
+    if (client->outgoing.size() - client->outgoing_offset > SERVER_MAX_BACKLOG_BYTES) {
+        client->broken = true;
+        client->outgoing.clear();
+        client->outgoing_offset = 0;
+    }
+}
+
+void LlamaServer::_flush_clients() {
+    PackedByteArray chunk;
+    for (Client &client : clients) {
+        while (!client.broken && client.outgoing_offset < client.outgoing.size()) {
+            const size_t size = std::min(SERVER_WRITE_CHUNK, client.outgoing.size() - client.outgoing_offset);
+            chunk.resize(static_cast<int64_t>(size));
+            std::memcpy(chunk.ptrw(), client.outgoing.data() + client.outgoing_offset, size);
+            const Array written = client.peer->put_partial_data(chunk);
+            if (written.size() < 2 || static_cast<int64_t>(written[0]) != OK) {
+                // The next read pass sees the broken connection and drops it.
+                client.broken = true;
+                break;
+            }
+            const int64_t sent = written[1];
+            client.outgoing_offset += static_cast<size_t>(std::max<int64_t>(0, sent));
+            if (sent < static_cast<int64_t>(size)) {
+                break;
+            }
+        }
+        if (client.outgoing_offset == client.outgoing.size()) {
+            client.outgoing.clear();
+            client.outgoing_offset = 0;
+        } else if (client.outgoing_offset > SERVER_WRITE_CHUNK) {
+            client.outgoing.erase(0, client.outgoing_offset);
+            client.outgoing_offset = 0;
+        }
+    }
+}
+
+void LlamaServer::_send_error(Client &r_client, const Variant &p_id, const String &p_error) {
+    Dictionary message;
+    message["id"] = p_id;
+    message["error"] = p_error;
+    message["done"] = true;
+    _send(r_client.id, message);
+}
+
+LlamaServer::Client *LlamaServer::_find_client(int64_t p_client_id) {
+    for (Client &client : clients) {
+        if (client.id == p_client_id) {
+            return &client;
+        }
+    }
+    return nullptr;
+}
+
+bool LlamaServer::is_running() const {
+    return running.load();
+}
+
+int LlamaServer::get_port() const {
+    return port;
+}
+
+Ref<LlamaContext> LlamaServer::get_context() const {
+    return context;
+}
+
+void LlamaServer::set_default_params(const Dictionary &p_params) {
+    if (running.load()) {
+        UtilityFunctions::push_warning("godot_llama: LlamaServer default_params only apply on the next start().");
+    }
+    default_params = p_params.duplicate();
+}
+
+Dictionary LlamaServer::get_default_params() const {
+    return default_params;
+}
+
+void LlamaServer::set_max_queue(int p_max_queue) {
+    max_queue = std::max(1, p_max_queue);
+}
+
+int LlamaServer::get_max_queue() const {
+    return max_queue;
+}
+
+Dictionary LlamaServer::get_stats() const {
+    Dictionary stats;
+    stats["running"] = running.load();
+    stats["port"] = port;
+    stats["clients"] = connected_clients.load();
+    stats["active_requests"] = active_requests.load();
+    stats["queued_requests"] = queued_requests.load();
+    stats["requests_accepted"] = requests_accepted.load();
+    stats["requests_completed"] = requests_completed.load();
+    stats["requests_cancelled"] = requests_cancelled.load();
+    stats["requests_failed"] = requests_failed.load();
+    stats["requests_rejected"] = requests_rejected.load();
+    stats["tokens_generated"] = tokens_generated.load();
+    return stats;
+}
@@ -0,0 +1,113 @@
+#ifndef GODOT_LLAMA_SERVER_H
+#define GODOT_LLAMA_SERVER_H
+
+#include "llama_batch_scheduler.h"
+#include "llama_context.h"
+
+#include <godot_cpp/classes/json.hpp>
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/classes/stream_peer_tcp.hpp>
+#include <godot_cpp/classes/tcp_server.hpp>
+#include <godot_cpp/classes/thread.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace godot {
+
+// Serves completions from one LlamaContext to other local processes over
+// newline-delimited JSON on a TCP socket. Every connection shares the
+// context's sequences through a continuous-batching scheduler that runs on
+// the server's own thread; the context refuses direct generate calls while
+// the server owns it.
+class LlamaServer : public RefCounted {
+    GDCLASS(LlamaServer, RefCounted);
+
+private:
+    struct Client {
+        int64_t id = 0;
+        Ref<StreamPeerTCP> peer;
+        std::string buffer;
+        // Bytes not yet taken by the socket, starting at outgoing_offset.
+        std::string outgoing;
+        size_t outgoing_offset = 0;
+        // Set when the backlog passes its cap or a write fails; the next
+        // read pass drops the client.
+        bool broken = false;
+    };
+
+    struct Pending {
+        int64_t client_id = 0;
+        Variant id;
+        bool stream = false;
+        int64_t sent_length = 0;
+    };
+
+    Ref<LlamaContext> context;
+    Ref<TCPServer> listener;
+    Ref<Thread> thread;
+    Ref<JSON> json;
+    LlamaBatchScheduler scheduler;
+    std::vector<Client> clients;
+    std::unordered_map<int64_t, Pending> pending;
+    int64_t next_client_id = 1;
+    int64_t next_request_index = 0;
+    Dictionary default_params;
+    int max_queue = 256;
+    // Copies of the properties taken by start(); the server thread reads
+    // only these.
+    Dictionary serving_params;
+    int serving_max_queue = 256;
+    int port = 0;
+
+    std::atomic<bool> stop_requested{ false };
+    std::atomic<bool> running{ false };
+    std::atomic<int64_t> connected_clients{ 0 };
+    std::atomic<int64_t> requests_accepted{ 0 };
+    std::atomic<int64_t> requests_completed{ 0 };
+    std::atomic<int64_t> requests_cancelled{ 0 };
+    std::atomic<int64_t> requests_failed{ 0 };
+    std::atomic<int64_t> requests_rejected{ 0 };
+    std::atomic<int64_t> tokens_generated{ 0 };
+    std::atomic<int64_t> active_requests{ 0 };
+    std::atomic<int64_t> queued_requests{ 0 };
+
+    void _thread_entry();
+    void _accept_clients();
+    void _read_clients(std::vector<LlamaBatchScheduler::Result> &r_finished);
+    void _flush_clients();
+    void _drop_clients(const std::vector<int64_t> &p_closed, std::vector<LlamaBatchScheduler::Result> &r_finished);
+    void _handle_line(Client &r_client, const std::string &p_line, std::vector<LlamaBatchScheduler::Result> &r_finished);
+    void _on_token(const LlamaBatchScheduler::Request &p_request, int32_t p_token, const String &p_text);
+    void _send_results(std::vector<LlamaBatchScheduler::Result> &r_finished);
+    void _send(int64_t p_client_id, const Dictionary &p_message);
+    void _send_error(Client &r_client, const Variant &p_id, const String &p_error);
+    Client *_find_client(int64_t p_client_id);
+
+protected:
+    static void _bind_methods();
+
+public:
+    ~LlamaServer();
+
+    Error start(const Ref<LlamaContext> &p_context, int p_port = 8765, const String &p_bind_address = "127.0.0.1");
+    void stop();
+    bool is_running() const;
+    int get_port() const;
+    Ref<LlamaContext> get_context() const;
+
+    void set_default_params(const Dictionary &p_params);
+    Dictionary get_default_params() const;
+    void set_max_queue(int p_max_queue);
+    int get_max_queue() const;
+
+    Dictionary get_stats() const;
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,62 @@
+#include "llama_state_file.h"
+
+#include <godot_cpp/classes/dir_access.hpp>
+#include <godot_cpp/classes/file_access.hpp>
+
+using namespace godot;
+
+namespace {
+
+constexpr uint32_t STATE_FILE_MAGIC = 0x54534c47; // "GLST"
+constexpr uint32_t STATE_FILE_VERSION = 1;
+
+} // namespace
+
+Error LlamaStateFile::write(const String &p_path, const String &p_fingerprint, const PackedByteArray &p_data) {
+    const String temp_path = p_path + ".tmp";
+    {
+        Ref<FileAccess> file = FileAccess::open(temp_path, FileAccess::WRITE);
+        if (file.is_null()) {
+            return FileAccess::get_open_error();
+        }
+        const PackedByteArray fingerprint = p_fingerprint.to_utf8_buffer();
+        file->store_32(STATE_FILE_MAGIC);
+        file->store_32(STATE_FILE_VERSION);
+        file->store_32(static_cast<uint32_t>(fingerprint.size()));
+        file->store_buffer(fingerprint);
+        file->store_64(static_cast<uint64_t>(p_data.size()));
+        file->store_buffer(p_data);
+        file->flush();
+        const Error err = file->get_error();
+        if (err != OK) {
+            file->close();
+            DirAccess::remove_absolute(temp_path);
+            return err;
+        }
+    }
+    return DirAccess::rename_absolute(temp_path, p_path);
+}
+
+Error LlamaStateFile::read(const String &p_path, const String &p_fingerprint, PackedByteArray &r_data) {
+    Ref<FileAccess> file = FileAccess::open(p_path, FileAccess::READ);
+    if (file.is_null()) {
+        return FileAccess::get_open_error();
+    }
+    if (file->get_32() != STATE_FILE_MAGIC || file->get_32() != STATE_FILE_VERSION) {
+        return ERR_FILE_UNRECOGNIZED;
+    }
+    const uint32_t fingerprint_size = file->get_32();
+    if (fingerprint_size > file->get_length() - file->get_position()) {
+        return ERR_FILE_CORRUPT;
+    }
+    if (file->get_buffer(fingerprint_size).get_string_from_utf8() != p_fingerprint) {
+        // Another model or context size; llama.cpp would reject or misread it.
+        return ERR_INVALID_DATA;
+    }
+    const uint64_t data_size = file->get_64();
+    if (data_size == 0 || data_size > file->get_length() - file->get_position()) {
+        return ERR_FILE_CORRUPT;
+    }
+    r_data = file->get_buffer(static_cast<int64_t>(data_size));
+    return static_cast<uint64_t>(r_data.size()) == data_size ? OK : ERR_FILE_CORRUPT;
+}
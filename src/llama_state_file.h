@@ -0,0 +1,22 @@
+#ifndef GODOT_LLAMA_STATE_FILE_H
+#define GODOT_LLAMA_STATE_FILE_H
+
+#include <godot_cpp/variant/packed_byte_array.hpp>
+#include <godot_cpp/variant/string.hpp>
+
+namespace godot {
+
+// Context snapshots written by LlamaContext.save_state_file_async(): a header
+// fingerprinting the model and context the KV state came from, followed by
+// the raw llama_state_get_data() blob. Safe to call from any thread.
+class LlamaStateFile {
+public:
+    // Writes next to p_path first and renames over it, so a crash mid-write
+    // leaves the previous snapshot intact.
+    static Error write(const String &p_path, const String &p_fingerprint, const PackedByteArray &p_data);
+    static Error read(const String &p_path, const String &p_fingerprint, PackedByteArray &r_data);
+};
+
+} // namespace godot
+
+#endif
@@ -0,0 +1,232 @@
+#include "llama_thread_governor.h"
+
+#include <godot_cpp/classes/engine.hpp>
+#include <godot_cpp/classes/os.hpp>
+#include <godot_cpp/classes/scene_tree.hpp>
+#include <godot_cpp/classes/time.hpp>
+#include <godot_cpp/core/class_db.hpp>
+
+#include <algorithm>
+
+using namespace godot;
+
+namespace {
+
+// Frame time above budget * PRESSURE_RATIO (smoothed) or any single frame
+// above budget * SPIKE_RATIO counts as pressure; below budget * CALM_RATIO
+// as headroom.
+constexpr double GOVERNOR_PRESSURE_RATIO = 1.05;
+constexpr double GOVERNOR_SPIKE_RATIO = 2.0;
+constexpr double GOVERNOR_CALM_RATIO = 0.85;
+constexpr double GOVERNOR_SMOOTHING = 0.1;
+// Frames to wait after a change before reacting to pressure again, and calm
+// frames required before giving resources back to inference.
+constexpr int GOVERNOR_SETTLE_FRAMES = 10;
+constexpr int GOVERNOR_CALM_FRAMES = 30;
+constexpr int32_t GOVERNOR_MIN_DELAY_USEC = 1000;
+
+} // namespace
+
+void LlamaThreadGovernor::_bind_methods() {
+    ClassDB::bind_method(D_METHOD("set_enabled", "enabled"), &LlamaThreadGovernor::set_enabled);
+    ClassDB::bind_method(D_METHOD("is_enabled"), &LlamaThreadGovernor::is_enabled);
+    ClassDB::bind_method(D_METHOD("set_watch_frames", "watch_frames"), &LlamaThreadGovernor::set_watch_frames);
+    ClassDB::bind_method(D_METHOD("is_watching_frames"), &LlamaThreadGovernor::is_watching_frames);
+    ClassDB::bind_method(D_METHOD("set_target_fps", "target_fps"), &LlamaThreadGovernor::set_target_fps);
+    ClassDB::bind_method(D_METHOD("get_target_fps"), &LlamaThreadGovernor::get_target_fps);
+    ClassDB::bind_method(D_METHOD("set_min_threads", "min_threads"), &LlamaThreadGovernor::set_min_threads);
+    ClassDB::bind_method(D_METHOD("get_min_threads"), &LlamaThreadGovernor::get_min_threads);
+    ClassDB::bind_method(D_METHOD("set_max_threads", "max_threads"), &LlamaThreadGovernor::set_max_threads);
+    ClassDB::bind_method(D_METHOD("get_max_threads"), &LlamaThreadGovernor::get_max_threads);
+    ClassDB::bind_method(D_METHOD("set_max_token_delay_ms", "max_token_delay_ms"), &LlamaThreadGovernor::set_max_token_delay_ms);
+    ClassDB::bind_method(D_METHOD("get_max_token_delay_ms"), &LlamaThreadGovernor::get_max_token_delay_ms);
+    ClassDB::bind_method(D_METHOD("observe_frame_time", "seconds"), &LlamaThreadGovernor::observe_frame_time);
+    ClassDB::bind_method(D_METHOD("reset"), &LlamaThreadGovernor::reset);
+    ClassDB::bind_method(D_METHOD("get_stats"), &LlamaThreadGovernor::get_stats);
+
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "enabled"), "set_enabled", "is_enabled");
+    ADD_PROPERTY(PropertyInfo(Variant::BOOL, "watch_frames"), "set_watch_frames", "is_watching_frames");
+    ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "target_fps"), "set_target_fps", "get_target_fps");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "min_threads"), "set_min_threads", "get_min_threads");
+    ADD_PROPERTY(PropertyInfo(Variant::INT, "max_threads"), "set_max_threads", "get_max_threads");
+    ADD_PROPERTY(PropertyInfo(Variant::FLOAT, "max_token_delay_ms"), "set_max_token_delay_ms", "get_max_token_delay_ms");
+}
+
+LlamaThreadGovernor::LlamaThreadGovernor() {
+    reset();
+    _update_frame_signal();
+}
+
+LlamaThreadGovernor::~LlamaThreadGovernor() {
+    watch_frames = false;
+    _update_frame_signal();
+}
+
+int LlamaThreadGovernor::_resolved_max_threads() const {
+    const int max_value = max_threads > 0 ? max_threads : OS::get_singleton()->get_processor_count() - 1;
+    return std::max(std::max(1, min_threads), max_value);
+}
+
+void LlamaThreadGovernor::_update_frame_signal() {
+    const bool wanted = enabled && watch_frames;
+    if (wanted == frame_signal_connected) {
+        return;
+    }
+    SceneTree *tree = Object::cast_to<SceneTree>(Engine::get_singleton()->get_main_loop());
+    if (tree == nullptr) {
+        frame_signal_connected = false;
+        return;
+    }
+
+    const Callable callback = callable_mp(this, &LlamaThreadGovernor::_on_process_frame);
+    if (wanted) {
+        tree->connect("process_frame", callback);
+        last_frame_usec = 0;
+    } else if (tree->is_connected("process_frame", callback)) {
+        tree->disconnect("process_frame", callback);
+    }
+    frame_signal_connected = wanted;
+}
+
+void LlamaThreadGovernor::_on_process_frame() {
+    const uint64_t now = Time::get_singleton()->get_ticks_usec();
+    if (last_frame_usec != 0) {
+        observe_frame_time(static_cast<double>(now - last_frame_usec) / 1000000.0);
+    }
+    last_frame_usec = now;
+}
+
+void LlamaThreadGovernor::observe_frame_time(double p_seconds) {
+    if (!enabled || p_seconds <= 0.0) {
+        return;
+    }
+
+    const double budget_usec = 1000000.0 / target_fps;
+    const double frame_usec = p_seconds * 1000000.0;
+    // Clamp so a single loading hitch does not pin the average for seconds.
+    const double sample = std::min(frame_usec, budget_usec * 4.0);
+    smoothed_frame_usec = smoothed_frame_usec <= 0.0 ? sample : smoothed_frame_usec + (sample - smoothed_frame_usec) * GOVERNOR_SMOOTHING;
+    frames_since_change++;
+
+    const int32_t threads = n_threads.load();
+    const int32_t delay = token_delay_usec.load();
+    const int32_t max_delay = static_cast<int32_t>(max_token_delay_ms * 1000.0);
+    const int32_t low = std::max(1, min_threads);
+    const int32_t high = _resolved_max_threads();
+
+    if (smoothed_frame_usec > budget_usec * GOVERNOR_PRESSURE_RATIO || frame_usec > budget_usec * GOVERNOR_SPIKE_RATIO) {
+        calm_frames = 0;
+        if (frames_since_change < GOVERNOR_SETTLE_FRAMES) {
+            return;
+        }
+        if (threads > low) {
+            n_threads.store(threads - 1);
+        } else if (delay < max_delay) {
+            token_delay_usec.store(std::min(max_delay, std::max(GOVERNOR_MIN_DELAY_USEC, delay * 2)));
+        } else {
+            return;
+        }
+        frames_since_change = 0;
+        adjustments++;
+        return;
+    }
+
+    if (smoothed_frame_usec >= budget_usec * GOVERNOR_CALM_RATIO) {
+        calm_frames = 0;
+        return;
+    }
+    if (++calm_frames < GOVERNOR_CALM_FRAMES) {
+        return;
+    }
+    if (delay > 0) {
+        token_delay_usec.store(delay / 2 < GOVERNOR_MIN_DELAY_USEC ? 0 : delay / 2);
+    } else if (threads < high) {
+        n_threads.store(threads + 1);
+    } else {
+        return;
+    }
+    calm_frames = 0;
+    frames_since_change = 0;
+    adjustments++;
+}
+
+void LlamaThreadGovernor::reset() {
+    n_threads.store(_resolved_max_threads());
+    token_delay_usec.store(0);
+    smoothed_frame_usec = 0.0;
+    frames_since_change = 0;
+    calm_frames = 0;
+    last_frame_usec = 0;
+}
+
+Dictionary LlamaThreadGovernor::get_stats() const {
+    Dictionary stats;
+    stats["enabled"] = enabled.load();
+    stats["frame_time_ms"] = smoothed_frame_usec / 1000.0;
+    stats["target_frame_ms"] = 1000.0 / target_fps;
+    stats["n_threads"] = get_n_threads();
+    stats["token_delay_ms"] = static_cast<double>(get_token_delay_usec()) / 1000.0;
+    stats["adjustments"] = adjustments;
+    return stats;
+}
+
+int32_t LlamaThreadGovernor::get_n_threads() const {
+    return enabled ? n_threads.load() : 0;
+}
+
+int32_t LlamaThreadGovernor::get_token_delay_usec() const {
+    return enabled ? token_delay_usec.load() : 0;
+}
+
+void LlamaThreadGovernor::set_enabled(bool p_enabled) {
+    enabled = p_enabled;
+    _update_frame_signal();
+}
+
+bool LlamaThreadGovernor::is_enabled() const {
+    return enabled;
+}
+
+void LlamaThreadGovernor::set_watch_frames(bool p_watch_frames) {
+    watch_frames = p_watch_frames;
+    _update_frame_signal();
+}
+
+bool LlamaThreadGovernor::is_watching_frames() const {
+    return watch_frames;
+}
+
+void LlamaThreadGovernor::set_target_fps(double p_target_fps) {
+    target_fps = std::max(1.0, p_target_fps);
+}
+
+double LlamaThreadGovernor::get_target_fps() const {
+    return target_fps;
+}
+
+void LlamaThreadGovernor::set_min_threads(int p_min_threads) {
+    min_threads = std::max(1, p_min_threads);
+    n_threads.store(std::clamp(n_threads.load(), min_threads, _resolved_max_threads()));
+}
+
+int LlamaThreadGovernor::get_min_threads() const {
+    return min_threads;
+}
+
+void LlamaThreadGovernor::set_max_threads(int p_max_threads) {
+    max_threads = std::max(0, p_max_threads);
+    n_threads.store(std::clamp(n_threads.load(), std::max(1, min_threads), _resolved_max_threads()));
+}
+
+int LlamaThreadGovernor::get_max_threads() const {
+    return max_threads;
+}
+
+void LlamaThreadGovernor::set_max_token_delay_ms(double p_max_token_delay_ms) {
+    max_token_delay_ms = std::max(0.0, p_max_token_delay_ms);
+    token_delay_usec.store(std::min(token_delay_usec.load(), static_cast<int32_t>(max_token_delay_ms * 1000.0)));
+}
+
+double LlamaThreadGovernor::get_max_token_delay_ms() const {
+    return max_token_delay_ms;
+}
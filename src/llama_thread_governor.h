@@ -0,0 +1,74 @@
+#ifndef GODOT_LLAMA_THREAD_GOVERNOR_H
+#define GODOT_LLAMA_THREAD_GOVERNOR_H
+
+#include <godot_cpp/classes/ref_counted.hpp>
+#include <godot_cpp/variant/dictionary.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+namespace godot {
+
+// Trades inference speed for frame time. Watches the interval between engine
+// frames on the main thread and publishes thread counts and a minimum gap
+// between decodes that LlamaContext picks up from its generation thread.
+// Under pressure it sheds threads first, then paces tokens; with headroom it
+// undoes pacing first, then adds threads back.
+class LlamaThreadGovernor : public RefCounted {
+    GDCLASS(LlamaThreadGovernor, RefCounted);
+
+private:
+    // Read by get_n_threads() on the generation thread.
+    std::atomic<bool> enabled{ true };
+    bool watch_frames = true;
+    bool frame_signal_connected = false;
+    double target_fps = 60.0;
+    int min_threads = 1;
+    int max_threads = 0;
+    double max_token_delay_ms = 50.0;
+
+    std::atomic<int32_t> n_threads{ 0 };
+    std::atomic<int32_t> token_delay_usec{ 0 };
+
+    uint64_t last_frame_usec = 0;
+    double smoothed_frame_usec = 0.0;
+    int frames_since_change = 0;
+    int calm_frames = 0;
+    int64_t adjustments = 0;
+
+    int _resolved_max_threads() const;
+    void _on_process_frame();
+    void _update_frame_signal();
+
+protected:
+    static void _bind_methods();
+
+public:
+    LlamaThreadGovernor();
+    ~LlamaThreadGovernor();
+
+    void set_enabled(bool p_enabled);
+    bool is_enabled() const;
+    void set_watch_frames(bool p_watch_frames);
+    bool is_watching_frames() const;
+    void set_target_fps(double p_target_fps);
+    double get_target_fps() const;
+    void set_min_threads(int p_min_threads);
+    int get_min_threads() const;
+    void set_max_threads(int p_max_threads);
+    int get_max_threads() const;
+    void set_max_token_delay_ms(double p_max_token_delay_ms);
+    double get_max_token_delay_ms() const;
+
+    void observe_frame_time(double p_seconds);
+    void reset();
+    Dictionary get_stats() const;
+
+    // Read from the generation thread.
+    int32_t get_n_threads() const;
+    int32_t get_token_delay_usec() const;
+};
+
+} // namespace godot
+
+#endif
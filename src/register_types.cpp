@@ -1,9 +1,19 @@
 #include "register_types.h"
 
 #include "llama_async_worker.h"
+#include "llama_autotuner.h"
+#include "llama_backend.h"
+#include "llama_chat_session.h"
 #include "llama_context.h"
+#include "llama_memory_planner.h"
+#include "llama_metrics.h"
 #include "llama_model.h"
+#include "llama_phrase_filter.h"
+#include "llama_prompt_builder.h"
+#include "llama_result_cache.h"
 #include "llama_sampler.h"
+#include "llama_server.h"
+#include "llama_thread_governor.h"
 
 #include <godot_cpp/core/defs.hpp>
 #include <godot_cpp/godot.hpp>
@@ -17,12 +27,23 @@ void initialize_godot_llama_module(ModuleInitializationLevel p_level) {
         return;
     }
 
+    LlamaBackend::load_modules();
     llama_backend_init();
 
     ClassDB::register_class<LlamaModel>();
     ClassDB::register_class<LlamaSampler>();
     ClassDB::register_class<LlamaContext>();
+    ClassDB::register_class<LlamaMemoryPlanner>();
+    ClassDB::register_class<LlamaAutotuner>();
+    ClassDB::register_class<LlamaResultCache>();
+    ClassDB::register_class<LlamaPhraseFilter>();
+    ClassDB::register_class<LlamaThreadGovernor>();
+    ClassDB::register_class<LlamaChatSession>();
+    ClassDB::register_class<LlamaPromptBuilder>();
     ClassDB::register_class<LlamaAsyncWorker>();
+    ClassDB::register_class<LlamaServer>();
+
+    LlamaMetrics::register_monitors();
 }
 
 void uninitialize_godot_llama_module(ModuleInitializationLevel p_level) {
@@ -30,6 +51,7 @@ void uninitialize_godot_llama_module(ModuleInitializationLevel p_level) {
         return;
     }
 
+    LlamaMetrics::unregister_monitors();
     llama_backend_free();
 }
 